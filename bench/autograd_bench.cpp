@@ -0,0 +1,128 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "picograd/autograd.h"
+#include "picograd/no_grad.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+using Values = std::vector<Value<double>>;
+
+// Squared error of a 2 -> 16 -> 16 -> 1 tanh network on one sample, as a function of its 337
+// parameters
+struct Model {
+    Values params;
+    std::vector<double> direction;
+
+    Model() {
+        for (int i = 0; i < 2 * 16 + 16 + 16 * 16 + 16 + 16 + 1; ++i) {
+            params.emplace_back(double(i % 11) * 0.04 - 0.2);
+            direction.push_back(double(i % 5) - 2);
+        }
+    }
+
+    Value<double> loss() const {
+        std::size_t p = 0;
+        Values input{Value(0.5), Value(-0.25)};
+        auto layer = [&](const Values& in, std::size_t width) {
+            Values out;
+            for (std::size_t o = 0; o < width; ++o) {
+                Value<double> sum = params[p++];
+                for (auto& x : in) sum = sum + params[p++] * x;
+                out.push_back(width > 1 ? sum.tanh() : sum);
+            }
+            return out;
+        };
+        return (layer(layer(layer(input, 16), 16), 1)[0] - 1).square();
+    }
+
+    // Gradient at params + step * direction, by backpropagation
+    std::vector<double> gradient(double step) {
+        for (std::size_t i = 0; i < params.size(); ++i) {
+            params[i].set_data(params[i].get_data() + step * direction[i]);
+            params[i].set_grad(0);
+        }
+        loss().backward();
+        std::vector<double> out;
+        for (std::size_t i = 0; i < params.size(); ++i) {
+            out.push_back(params[i].get_grad());
+            params[i].set_data(params[i].get_data() - step * direction[i]);
+        }
+        return out;
+    }
+
+    double value(double step) {
+        NoGradGuard no_grad;
+        for (std::size_t i = 0; i < params.size(); ++i) params[i].set_data(params[i].get_data() + step * direction[i]);
+        double out = loss().get_data();
+        for (std::size_t i = 0; i < params.size(); ++i) params[i].set_data(params[i].get_data() - step * direction[i]);
+        return out;
+    }
+};
+
+constexpr double h = 1e-5;
+
+std::vector<double> hvp_fd(Model& model) {
+    auto plus = model.gradient(h);
+    auto minus = model.gradient(-h);
+    for (std::size_t i = 0; i < plus.size(); ++i) plus[i] = (plus[i] - minus[i]) / (2 * h);
+    return plus;
+}
+
+double max_error(const std::vector<double>& a, const std::vector<double>& b) {
+    double error = 0;
+    for (std::size_t i = 0; i < a.size(); ++i) error = std::max(error, std::abs(a[i] - b[i]));
+    return error;
+}
+
+} // namespace
+
+// Hessian-vector product in forward-over-reverse mode
+static void BM_HvpForwardOverReverse(benchmark::State& state) {
+    Model model;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(hvp(model.loss(), model.params, model.direction));
+    }
+    state.counters["max_error_vs_fd"] = max_error(hvp(model.loss(), model.params, model.direction), hvp_fd(model));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HvpForwardOverReverse);
+
+// The same by central differences of two gradients
+static void BM_HvpFiniteDifferences(benchmark::State& state) {
+    Model model;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(hvp_fd(model));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HvpFiniteDifferences);
+
+// Directional derivative of the loss, in forward mode over the graph
+static void BM_JvpForward(benchmark::State& state) {
+    Model model;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(jvp(Values{model.loss()}, model.params, model.direction));
+    }
+    double fd = (model.value(h) - model.value(-h)) / (2 * h);
+    state.counters["error_vs_fd"] = std::abs(jvp(Values{model.loss()}, model.params, model.direction)[0] - fd);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_JvpForward);
+
+// The same by central differences of two inference passes
+static void BM_JvpFiniteDifferences(benchmark::State& state) {
+    Model model;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize((model.value(h) - model.value(-h)) / (2 * h));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_JvpFiniteDifferences);
@@ -0,0 +1,75 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "picograd/batch.h"
+#include "picograd/tape.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+constexpr std::size_t samples = 1024;
+constexpr std::size_t hidden = 16;
+
+// Squared error of a 2-16-1 tanh network, written once for scalar and batched Values
+template<typename S>
+S loss(const std::vector<S>& w, const S& x0, const S& x1, const S& target) {
+    S out = w[3 * hidden];
+    for (std::size_t k = 0; k < hidden; ++k) {
+        out = out + w[3 * hidden + 1 + k] * (w[k] * x0 + w[hidden + k] * x1 + w[2 * hidden + k]).tanh();
+    }
+    return (out - target).square();
+}
+
+float input(std::size_t i, std::size_t j) { return float(std::sin(double(i * 2 + j))); }
+
+template<typename S>
+std::vector<S> weights() {
+    std::vector<S> w;
+    for (std::size_t i = 0; i < 4 * hidden + 1; ++i) w.emplace_back(float(std::cos(double(i))) * 0.5f);
+    return w;
+}
+
+} // namespace
+
+// One training pass (forward and backward) over 1024 samples: a graph per sample, against a graph
+// per N samples with Batch lanes. Both on a Tape.
+static void BM_SamplesScalar(benchmark::State& state) {
+    auto w = weights<Value<float>>();
+    Tape<float> tape;
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < samples; ++i) {
+            loss(w, Value<float>(input(i, 0)), Value<float>(input(i, 1)), Value<float>(input(i, 2))).backward();
+            tape.reset();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * samples);
+}
+BENCHMARK(BM_SamplesScalar)->Unit(benchmark::kMicrosecond);
+
+template<std::size_t N>
+static void BM_SamplesBatched(benchmark::State& state) {
+    using B = Batch<float, N>;
+    auto w = weights<Value<B>>();
+    Tape<B> tape;
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < samples; i += N) {
+            B x0, x1, target;
+            for (std::size_t lane = 0; lane < N; ++lane) {
+                x0[lane] = input(i + lane, 0);
+                x1[lane] = input(i + lane, 1);
+                target[lane] = input(i + lane, 2);
+            }
+            loss(w, Value<B>(x0), Value<B>(x1), Value<B>(target)).backward();
+            tape.reset();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * samples);
+}
+BENCHMARK_TEMPLATE(BM_SamplesBatched, 4)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_SamplesBatched, 8)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_SamplesBatched, 16)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,82 @@
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "picograd/checkpoint.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+using Values = std::vector<Value<float>>;
+
+constexpr std::size_t width = 8;
+constexpr int steps = 256;
+constexpr int segment_steps = 16;
+
+// Recurrence h = tanh(W h + b) unrolled over 256 steps, about 35000 nodes
+struct Recurrence {
+    Values w;
+    Values b;
+    Values h0;
+
+    Recurrence() {
+        for (std::size_t i = 0; i < width * width; ++i) w.emplace_back(float(i % 7) * 0.05f - 0.15f);
+        for (std::size_t i = 0; i < width; ++i) b.emplace_back(0.01f * float(i));
+        for (std::size_t i = 0; i < width; ++i) h0.emplace_back(0.1f * float(i) - 0.3f);
+    }
+
+    Values step(const Values& h, int count) const {
+        Values state = h;
+        for (int s = 0; s < count; ++s) {
+            Values next;
+            for (std::size_t i = 0; i < width; ++i) {
+                Value<float> sum = b[i];
+                for (std::size_t j = 0; j < width; ++j) sum = sum + w[i * width + j] * state[j];
+                next.push_back(sum.tanh());
+            }
+            state = std::move(next);
+        }
+        return state;
+    }
+
+    static Value<float> loss(const Values& h) {
+        Value<float> sum = h[0].square();
+        for (std::size_t i = 1; i < width; ++i) sum = sum + h[i].square();
+        return sum;
+    }
+};
+
+// Forward and backward pass over the whole graph; peak_bytes is the size of the graph
+void BM_UnrolledFull(benchmark::State& state) {
+    Recurrence model;
+    for (auto _ : state) {
+        auto loss = Recurrence::loss(model.step(model.h0, steps));
+        loss.backward();
+    }
+    auto nodes = Recurrence::loss(model.step(model.h0, steps)).topological_order().size();
+    state.counters["peak_bytes"] = double(nodes * Checkpoint<float>::node_size);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UnrolledFull);
+
+// The same with checkpoints every 16 steps, keeping as many segments as fit into the budget (in
+// segments, state.range(0) of 16); peak_bytes is the largest size of the segment graphs alive
+void BM_UnrolledCheckpoint(benchmark::State& state) {
+    Recurrence model;
+    std::size_t segment_bytes = (width * (2 * width + 1) * segment_steps) * Checkpoint<float>::node_size;
+    Checkpoint<float> checkpoint(std::size_t(state.range(0)) * segment_bytes);
+    auto segment = [&](const Values& in) { return model.step(in, segment_steps); };
+    for (auto _ : state) {
+        Values h = model.h0;
+        for (int s = 0; s < steps / segment_steps; ++s) h = checkpoint.segment(segment, h);
+        checkpoint.backward(Recurrence::loss(h));
+    }
+    state.counters["peak_bytes"] = double(checkpoint.peak_bytes());
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UnrolledCheckpoint)->Arg(0)->Arg(4)->Arg(8)->Arg(16);
+
+} // namespace
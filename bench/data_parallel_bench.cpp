@@ -0,0 +1,66 @@
+#include <benchmark/benchmark.h>
+
+#include <thread>
+#include <vector>
+
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+// 2 -> 32 -> 1 tanh network with squared error, about 200 nodes per sample
+struct Net {
+    std::vector<Value<float>> params;
+
+    Net() {
+        for (int i = 0; i < 32 * 4 + 1; ++i) params.emplace_back(float(i % 11) * 0.05f - 0.25f);
+    }
+
+    Value<float> loss(std::size_t begin, std::size_t end) const {
+        Value<float> sum(0.0f);
+        for (auto i = begin; i < end; ++i) {
+            float x1 = float(i % 17) * 0.1f - 0.8f;
+            float x2 = float(i % 13) * 0.1f - 0.6f;
+            Value<float> out = params[128];
+            for (std::size_t h = 0; h < 32; ++h) {
+                out = out + (params[4 * h] * x1 + params[4 * h + 1] * x2 + params[4 * h + 2]).tanh() * params[4 * h + 3];
+            }
+            sum = sum + (out - (x1 > x2 ? 1.0f : -1.0f)).pow(2);
+        }
+        return sum;
+    }
+};
+
+} // namespace
+
+// Samples per second for a batch of 4096, serial (on a Tape) and data-parallel over N threads
+static void BM_TrainStepSerial(benchmark::State& state) {
+    Net net;
+    for (auto _ : state) {
+        Tape<float> tape;
+        auto loss = net.loss(0, 4096);
+        loss.backward();
+        benchmark::DoNotOptimize(loss.get_data());
+    }
+    state.SetItemsProcessed(state.iterations() * 4096);
+}
+BENCHMARK(BM_TrainStepSerial)->Unit(benchmark::kMillisecond);
+
+static void BM_TrainStepDataParallel(benchmark::State& state) {
+    Net net;
+    ThreadPool pool(state.range(0));
+    DataParallel<float> trainer(net.params, pool);
+    for (auto _ : state) {
+        auto loss = trainer.step(4096, [&](std::size_t begin, std::size_t end) { return net.loss(begin, end); });
+        benchmark::DoNotOptimize(loss);
+    }
+    state.SetItemsProcessed(state.iterations() * 4096);
+}
+
+static void thread_counts(benchmark::internal::Benchmark* b) {
+    int64_t cores = std::max<int64_t>(std::thread::hardware_concurrency(), 1);
+    for (int64_t threads = 1; threads < cores; threads *= 2) b->Arg(threads);
+    b->Arg(cores);
+}
+BENCHMARK(BM_TrainStepDataParallel)->Apply(thread_counts)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,51 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "picograd/dual.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+// out[k] = tanh(sum over j of w[k][j] * x[j] + 0.1 * k) for `outputs` outputs, with fixed weights
+template<typename S>
+std::vector<S> layer(const std::vector<S>& x, std::size_t outputs) {
+    std::vector<S> out;
+    out.reserve(outputs);
+    for (std::size_t k = 0; k < outputs; ++k) {
+        S sum = x[0] * std::cos(double(k));
+        for (std::size_t j = 1; j < x.size(); ++j) sum = sum + x[j] * std::cos(double(k * x.size() + j));
+        out.push_back((sum + 0.1 * double(k)).tanh());
+    }
+    return out;
+}
+
+void run(benchmark::State& state, std::size_t inputs, std::size_t outputs, JacobianMode mode) {
+    std::vector<double> x(inputs);
+    for (std::size_t j = 0; j < inputs; ++j) x[j] = 0.1 * double(j) - 0.2;
+    auto f = [outputs](const auto& x) { return layer(x, outputs); };
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(jacobian<4>(f, x, mode));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+// Few inputs, many outputs: one forward run on Dual<double, 4> against one backward pass per output
+static void BM_JacobianWideForward(benchmark::State& state) { run(state, 4, 64, JacobianMode::forward); }
+BENCHMARK(BM_JacobianWideForward);
+static void BM_JacobianWideReverse(benchmark::State& state) { run(state, 4, 64, JacobianMode::reverse); }
+BENCHMARK(BM_JacobianWideReverse);
+
+// Many inputs, few outputs: 16 forward runs against two backward passes
+static void BM_JacobianTallForward(benchmark::State& state) { run(state, 64, 2, JacobianMode::forward); }
+BENCHMARK(BM_JacobianTallForward);
+static void BM_JacobianTallReverse(benchmark::State& state) { run(state, 64, 2, JacobianMode::reverse); }
+BENCHMARK(BM_JacobianTallReverse);
+static void BM_JacobianTallAutomatic(benchmark::State& state) { run(state, 64, 2, JacobianMode::automatic); }
+BENCHMARK(BM_JacobianTallAutomatic);
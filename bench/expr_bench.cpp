@@ -0,0 +1,80 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "picograd/expr.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+using expr::lazy;
+
+namespace {
+
+// Squared error of a 2 -> 16 -> 1 tanh network for one sample, built node by node or with each
+// hidden unit (and the error) fused into lazy expressions
+struct Net {
+    std::vector<Value<float>> params;
+    Value<float> x1{0.0f};
+    Value<float> x2{0.0f};
+    Value<float> target{0.0f};
+
+    Net() {
+        for (int i = 0; i < 16 * 4 + 1; ++i) params.emplace_back(float(i % 11) * 0.05f - 0.25f);
+    }
+
+    Value<float> loss() const {
+        Value<float> out = params[64];
+        for (std::size_t h = 0; h < 16; ++h) {
+            out = out + (params[4 * h] * x1 + params[4 * h + 1] * x2 + params[4 * h + 2]).tanh() * params[4 * h + 3];
+        }
+        return (out - target).pow(2);
+    }
+
+    Value<float> fused_loss() const {
+        Value<float> out = params[64];
+        for (std::size_t h = 0; h < 16; ++h) {
+            Value<float> hidden = (lazy(params[4 * h]) * x1 + lazy(params[4 * h + 1]) * x2 + params[4 * h + 2]).tanh();
+            out = lazy(out) + lazy(hidden) * params[4 * h + 3];
+        }
+        return (lazy(out) - target).pow(2);
+    }
+
+    void set_sample(std::size_t i) {
+        x1.set_data(float(i % 17) * 0.1f - 0.8f);
+        x2.set_data(float(i % 13) * 0.1f - 0.6f);
+        target.set_data(x1.get_data() > x2.get_data() ? 1.0f : -1.0f);
+    }
+};
+
+} // namespace
+
+// Forward and backward for one sample per item, graph rebuilt on a Tape every time
+static void BM_PerSampleUnfused(benchmark::State& state) {
+    Net net;
+    Tape<float> tape;
+    std::size_t i = 0;
+    for (auto _ : state) {
+        net.set_sample(i++);
+        auto loss = net.loss();
+        loss.backward();
+        state.counters["nodes"] = tape.size();
+        tape.reset();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PerSampleUnfused);
+
+static void BM_PerSampleFused(benchmark::State& state) {
+    Net net;
+    Tape<float> tape;
+    std::size_t i = 0;
+    for (auto _ : state) {
+        net.set_sample(i++);
+        auto loss = net.fused_loss();
+        loss.backward();
+        state.counters["nodes"] = tape.size();
+        tape.reset();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PerSampleFused);
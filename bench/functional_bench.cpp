@@ -0,0 +1,112 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "picograd/functional.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+std::vector<Value<float>> make_values(std::size_t n, float offset) {
+    std::vector<Value<float>> values;
+    for (std::size_t i = 0; i < n; ++i) values.emplace_back(float(i % 13) * 0.1f + offset);
+    return values;
+}
+
+// Cross-entropy and mean squared error built from elementary operations, as they were written
+// before functional.h
+Value<float> composed_cross_entropy(const std::vector<Value<float>>& logits, std::size_t target) {
+    float max = logits[0].get_data();
+    for (auto& v : logits) max = std::max(max, v.get_data());
+    Value<float> shift(max);
+    Value<float> sum(0.0f);
+    for (auto& v : logits) sum = sum + (v - shift).exp();
+    return shift + sum.log() - logits[target];
+}
+
+Value<float> composed_mse(const std::vector<Value<float>>& prediction, const std::vector<Value<float>>& target) {
+    Value<float> sum(0.0f);
+    for (std::size_t i = 0; i < prediction.size(); ++i) sum = sum + (prediction[i] - target[i]).square();
+    return sum / float(prediction.size());
+}
+
+// Runs forward and backward of loss() on a Tape, reporting the nodes built per item
+template<typename F>
+void run(benchmark::State& state, F&& loss) {
+    Tape<float> tape;
+    for (auto _ : state) {
+        auto y = loss();
+        y.backward();
+        state.counters["nodes"] = tape.size();
+        tape.reset();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+// (a - b) / c, with subtraction and division composed like before (a + b * -1, a * c^-1), and native
+static void BM_SubDivComposed(benchmark::State& state) {
+    Value<float> a(1.5f), b(0.5f), c(2.0f);
+    run(state, [&] { return (a + b * Value<float>(-1.0f)) * c.pow(-1); });
+}
+BENCHMARK(BM_SubDivComposed);
+
+static void BM_SubDivNative(benchmark::State& state) {
+    Value<float> a(1.5f), b(0.5f), c(2.0f);
+    run(state, [&] { return (a - b) / c; });
+}
+BENCHMARK(BM_SubDivNative);
+
+// Arg: number of classes
+static void BM_CrossEntropyComposed(benchmark::State& state) {
+    auto logits = make_values(state.range(0), -0.5f);
+    run(state, [&] { return composed_cross_entropy(logits, 3); });
+}
+BENCHMARK(BM_CrossEntropyComposed)->RangeMultiplier(10)->Range(10, 1000);
+
+static void BM_CrossEntropyFused(benchmark::State& state) {
+    auto logits = make_values(state.range(0), -0.5f);
+    run(state, [&] { return functional::cross_entropy(logits, 3); });
+}
+BENCHMARK(BM_CrossEntropyFused)->RangeMultiplier(10)->Range(10, 1000);
+
+// Arg: number of outputs
+static void BM_MseComposed(benchmark::State& state) {
+    auto prediction = make_values(state.range(0), -0.5f);
+    auto target = make_values(state.range(0), 0.25f);
+    run(state, [&] { return composed_mse(prediction, target); });
+}
+BENCHMARK(BM_MseComposed)->RangeMultiplier(10)->Range(10, 1000);
+
+static void BM_MseFused(benchmark::State& state) {
+    auto prediction = make_values(state.range(0), -0.5f);
+    auto target = make_values(state.range(0), 0.25f);
+    run(state, [&] { return functional::mse(prediction, target); });
+}
+BENCHMARK(BM_MseFused)->RangeMultiplier(10)->Range(10, 1000);
+
+// A chain of operations with scalar literals, with the literals turned into Values (as implicit
+// conversion did before scalar operands) and stored in the nodes
+static void BM_LiteralsAsValues(benchmark::State& state) {
+    Value<float> x(0.5f);
+    run(state, [&] {
+        auto y = x;
+        for (int i = 0; i < 8; ++i) y = (y * Value<float>(0.9f) + Value<float>(0.1f)).tanh();
+        return y;
+    });
+}
+BENCHMARK(BM_LiteralsAsValues);
+
+static void BM_LiteralsAsScalars(benchmark::State& state) {
+    Value<float> x(0.5f);
+    run(state, [&] {
+        auto y = x;
+        for (int i = 0; i < 8; ++i) y = (y * 0.9f + 0.1f).tanh();
+        return y;
+    });
+}
+BENCHMARK(BM_LiteralsAsScalars);
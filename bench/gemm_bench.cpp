@@ -0,0 +1,76 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "picograd/tensor.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+// A dense layer tanh(x W) with `width` inputs and outputs, applied to a batch of samples, forward
+// and backward. Items are multiply-adds of the forward product (the backward pass does twice that).
+namespace {
+constexpr std::size_t batch = 32;
+
+float weight(std::size_t i) {
+    return float(int(i % 13) - 6) * 0.01f;
+}
+} // namespace
+
+static void BM_DenseLayerTensor(benchmark::State& state) {
+    auto width = static_cast<std::size_t>(state.range(0));
+    auto isa = static_cast<simd::Isa>(state.range(1));
+    if (!simd::set_isa(isa)) {
+        state.SkipWithError("instruction set not supported");
+        return;
+    }
+    std::vector<float> w(width * width);
+    for (std::size_t i = 0; i < w.size(); ++i) w[i] = weight(i);
+    Tensor<float> W({width, width}, w);
+    Tensor<float> x({batch, width}, 0.5f);
+    for (auto _ : state) {
+        auto y = x.matmul(W).tanh().sum();
+        W.zero_grad();
+        y.backward();
+        benchmark::DoNotOptimize(W.get_grad().data());
+    }
+    simd::set_isa(simd::detected_isa());
+    state.SetLabel(simd::isa_str(isa));
+    state.SetItemsProcessed(state.iterations() * batch * width * width);
+}
+
+// The same layer built from scalar Values, one `x * w` node and one `+` node per multiply-add
+static void BM_DenseLayerValue(benchmark::State& state) {
+    auto width = static_cast<std::size_t>(state.range(0));
+    std::vector<Value<float>> W;
+    W.reserve(width * width);
+    for (std::size_t i = 0; i < width * width; ++i) W.emplace_back(weight(i));
+    std::vector<Value<float>> x;
+    for (std::size_t i = 0; i < batch * width; ++i) x.emplace_back(0.5f);
+    Tape<float> tape(1 << 16);
+    for (auto _ : state) {
+        Value<float> y(0.0f);
+        for (std::size_t b = 0; b < batch; ++b) {
+            for (std::size_t j = 0; j < width; ++j) {
+                Value<float> act = x[b * width] * W[j];
+                for (std::size_t i = 1; i < width; ++i) act = act + x[b * width + i] * W[i * width + j];
+                y = y + act.tanh();
+            }
+        }
+        y.backward();
+        tape.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * batch * width * width);
+}
+
+static void dense_tensor_args(benchmark::internal::Benchmark* b) {
+    for (std::int64_t width = 32; width <= 4096; width *= 2) {
+        for (auto isa : {simd::Isa::scalar, simd::Isa::neon, simd::Isa::avx2, simd::Isa::avx512}) {
+            if (simd::supported(isa)) b->Args({width, static_cast<int64_t>(isa)});
+        }
+    }
+}
+
+BENCHMARK(BM_DenseLayerTensor)->Apply(dense_tensor_args)->Unit(benchmark::kMillisecond);
+// Capped at 256: the scalar graph holds 2 * batch * width^2 nodes (64 bytes each), plus width^2 leaves
+BENCHMARK(BM_DenseLayerValue)->RangeMultiplier(2)->Range(32, 256)->Unit(benchmark::kMillisecond);
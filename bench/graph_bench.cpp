@@ -0,0 +1,74 @@
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include "picograd/graph.h"
+#include "picograd/half.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+// Sum over i of tanh(w[i] * x[i] + b), added up pairwise (so that the graph is shallow). Takes
+// four nodes per term.
+template<typename S>
+S build(const std::vector<S>& w, const S& b) {
+    std::vector<S> terms;
+    terms.reserve(w.size());
+    for (std::size_t i = 0; i < w.size(); ++i) terms.push_back((w[i] * (float(i % 7) * 0.1f) + b).tanh());
+    for (auto n = terms.size(); n > 1; n = (n + 1) / 2) {
+        for (std::size_t i = 0; i < n / 2; ++i) terms[i] = terms[2 * i] + terms[2 * i + 1];
+        if (n % 2) terms[n / 2] = terms[n - 1];
+    }
+    return terms[0];
+}
+
+void value_graph(benchmark::State& state, bool use_tape) {
+    auto terms = std::size_t(state.range(0));
+    std::vector<Value<float>> w;
+    for (std::size_t i = 0; i < terms; ++i) w.emplace_back(float(i % 5) * 0.1f);
+    Value<float> b(0.1f);
+    std::optional<Tape<float>> tape;
+    if (use_tape) tape.emplace(1 << 16);
+    for (auto _ : state) {
+        {
+            auto loss = build(w, b);
+            loss.backward();
+        }
+        if (tape) tape->reset();
+    }
+    state.counters["nodes"] = double(4 * terms);
+    state.SetItemsProcessed(state.iterations() * std::int64_t(terms));
+}
+
+} // namespace
+
+static void BM_ValueHeap(benchmark::State& state) { value_graph(state, false); }
+BENCHMARK(BM_ValueHeap)->Arg(1 << 12)->Arg(1 << 18);
+static void BM_ValueTape(benchmark::State& state) { value_graph(state, true); }
+BENCHMARK(BM_ValueTape)->Arg(1 << 12)->Arg(1 << 18);
+
+// The compact graph, with data and params stored as Storage (computed and differentiated in float)
+template<typename Storage>
+static void BM_CompactGraph(benchmark::State& state) {
+    auto terms = std::size_t(state.range(0));
+    Graph<float, Storage> graph(5 * terms);
+    std::vector<Var<float, Storage>> w;
+    for (std::size_t i = 0; i < terms; ++i) w.push_back(graph.variable(float(i % 5) * 0.1f));
+    auto b = graph.variable(0.1f);
+    auto parameters = graph.size();
+    for (auto _ : state) {
+        auto loss = build(w, b);
+        loss.backward();
+        graph.rewind(parameters);
+    }
+    state.counters["nodes"] = double(4 * terms);
+    state.counters["bytes_per_node"] = double(Graph<float, Storage>::bytes_per_node);
+    state.SetItemsProcessed(state.iterations() * std::int64_t(terms));
+}
+BENCHMARK_TEMPLATE(BM_CompactGraph, float)->Arg(1 << 12)->Arg(1 << 18);
+BENCHMARK_TEMPLATE(BM_CompactGraph, bfloat16)->Arg(1 << 12)->Arg(1 << 18);
+BENCHMARK_TEMPLATE(BM_CompactGraph, float16)->Arg(1 << 12)->Arg(1 << 18);
@@ -0,0 +1,59 @@
+#include "memory.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<std::size_t> allocation_count{0};
+std::atomic<std::size_t> current{0};
+std::atomic<std::size_t> peak{0};
+
+// Every block starts with its size, so that delete knows how much is freed. The header keeps the
+// alignment of malloc.
+constexpr std::size_t header = alignof(std::max_align_t);
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    auto block = static_cast<char*>(std::malloc(size + header));
+    if (!block) throw std::bad_alloc();
+    *reinterpret_cast<std::size_t*>(block) = size;
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    auto now = current.fetch_add(size, std::memory_order_relaxed) + size;
+    auto highest = peak.load(std::memory_order_relaxed);
+    while (now > highest && !peak.compare_exchange_weak(highest, now, std::memory_order_relaxed)) {}
+    return block + header;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    auto block = static_cast<char*>(p) - header;
+    current.fetch_sub(*reinterpret_cast<std::size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    operator delete(p);
+}
+
+namespace bench_memory {
+
+std::size_t allocations() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+std::size_t current_bytes() {
+    return current.load(std::memory_order_relaxed);
+}
+
+std::size_t peak_bytes() {
+    return peak.load(std::memory_order_relaxed);
+}
+
+void reset_peak() {
+    peak.store(current.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+} // namespace bench_memory
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+// Heap statistics of the benchmark binary, kept by its replacement of the global operator new and
+// delete (see memory.cpp). Counting is on for the whole run; read the counters around the code to
+// measure. Over-aligned allocations (operator new with std::align_val_t) are not counted.
+namespace bench_memory {
+
+std::size_t allocations();  // calls to operator new so far
+std::size_t current_bytes();  // allocated and not freed yet
+std::size_t peak_bytes();  // highest current_bytes() since the last reset_peak()
+void reset_peak();  // to current_bytes()
+
+} // namespace bench_memory
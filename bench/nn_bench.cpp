@@ -0,0 +1,135 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "picograd/nn.h"
+#include "picograd/optim.h"
+#include "picograd/tape.h"
+#include "picograd/value.h"
+
+#include "memory.h"
+
+using namespace ajs;
+
+namespace {
+
+// Micrograd's demo: two interleaved half moons of 100 points with labels -1 and 1 (as sklearn's
+// make_moons(100, noise=0.1)), a 2 -> 16 -> 16 -> 1 MLP, max-margin loss with L2 regularization,
+// and SGD over the whole dataset every step
+struct Moons {
+    std::vector<std::vector<float>> x;
+    std::vector<float> y;
+
+    Moons() {
+        std::mt19937 random(1);
+        std::normal_distribution<float> noise(0.0f, 0.1f);
+        for (int i = 0; i < 100; ++i) {
+            float t = float(M_PI) * float(i % 50) / 49;
+            bool outer = i < 50;
+            x.push_back({(outer ? std::cos(t) : 1 - std::cos(t)) + noise(random),
+                         (outer ? std::sin(t) : 0.5f - std::sin(t)) + noise(random)});
+            y.push_back(outer ? -1.0f : 1.0f);
+        }
+    }
+};
+
+constexpr float alpha = 1e-4f;
+
+template<typename Model, typename Parameters>
+Value<float> moons_loss(const Moons& data, const Model& model, const Parameters& parameters) {
+    Value<float> loss(0.0f);
+    for (std::size_t i = 0; i < data.y.size(); ++i) loss = loss + (1.0f - data.y[i] * model(data.x[i])).relu();
+    Value<float> reg(0.0f);
+    for (std::size_t i = 0; i < parameters.size(); ++i) reg = reg + parameters[i].square();
+    return loss / float(data.y.size()) + alpha * reg;
+}
+
+// The same MLP the way micrograd builds it: every parameter is a Value of its own on the heap
+struct HeapMLP {
+    std::vector<std::size_t> sizes{2, 16, 16, 1};
+    std::vector<Value<float>> params;
+
+    HeapMLP() {
+        nn::MLP<float> init(2, {16, 16, 1});  // same weights
+        for (std::size_t i = 0; i < init.parameters().size(); ++i) params.emplace_back(init.parameters()[i].get_data());
+    }
+
+    Value<float> operator()(const std::vector<float>& x) const {
+        std::vector<Value<float>> in;
+        for (float xi : x) in.emplace_back(xi, false);
+        std::size_t p = 0;
+        for (std::size_t l = 1; l < sizes.size(); ++l) {
+            std::vector<Value<float>> out;
+            for (std::size_t n = 0; n < sizes[l]; ++n) {
+                Value<float> act = params[p + sizes[l - 1]];
+                for (std::size_t i = 0; i < sizes[l - 1]; ++i) act = act + params[p + i] * in[i];
+                out.push_back(l + 1 < sizes.size() ? act.relu() : act);
+                p += sizes[l - 1] + 1;
+            }
+            in = std::move(out);
+        }
+        return in[0];
+    }
+};
+
+void report(benchmark::State& state, std::size_t allocated) {
+    state.SetItemsProcessed(state.iterations() * 100);  // samples
+    state.counters["allocs_per_step"] = double(allocated) / double(state.iterations());
+}
+
+} // namespace
+
+// One training step (forward, backward, update) per iteration
+static void BM_MoonsHeapValues(benchmark::State& state) {
+    Moons data;
+    HeapMLP model;
+    float lr = 0.05f;
+    auto begin = bench_memory::allocations();
+    for (auto _ : state) {
+        auto loss = moons_loss(data, model, model.params);
+        loss.backward();
+        for (auto& p : model.params) {
+            p.set_data(p.get_data() - lr * p.get_grad());
+            p.set_grad(0);
+        }
+        benchmark::DoNotOptimize(loss.get_data());
+    }
+    report(state, bench_memory::allocations() - begin);
+}
+BENCHMARK(BM_MoonsHeapValues)->Unit(benchmark::kMillisecond);
+
+static void BM_MoonsMLP(benchmark::State& state) {
+    Moons data;
+    nn::MLP<float> model(2, {16, 16, 1});
+    optim::SGD<float> optimizer(model.parameter_set(), 0.05f);
+    auto output = [&](const std::vector<float>& x) { return model(x)[0]; };
+    auto begin = bench_memory::allocations();
+    for (auto _ : state) {
+        auto loss = moons_loss(data, output, model.parameters());
+        loss.backward();
+        optimizer.step();
+        benchmark::DoNotOptimize(loss.get_data());
+    }
+    report(state, bench_memory::allocations() - begin);
+}
+BENCHMARK(BM_MoonsMLP)->Unit(benchmark::kMillisecond);
+
+static void BM_MoonsMLPTape(benchmark::State& state) {
+    Moons data;
+    nn::MLP<float> model(2, {16, 16, 1});
+    optim::SGD<float> optimizer(model.parameter_set(), 0.05f);
+    auto output = [&](const std::vector<float>& x) { return model(x)[0]; };
+    Tape<float> tape(1 << 16);
+    auto begin = bench_memory::allocations();
+    for (auto _ : state) {
+        auto loss = moons_loss(data, output, model.parameters());
+        loss.backward();
+        optimizer.step();
+        benchmark::DoNotOptimize(loss.get_data());
+        tape.reset();
+    }
+    report(state, bench_memory::allocations() - begin);
+}
+BENCHMARK(BM_MoonsMLPTape)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,67 @@
+#include <benchmark/benchmark.h>
+
+#include <optional>
+#include <vector>
+
+#include "picograd/no_grad.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+// 4 -> 32 -> 32 -> 1 tanh network evaluated on one sample
+struct Model {
+    std::vector<Value<float>> params;
+    std::vector<Value<float>> input;
+
+    Model() {
+        for (int i = 0; i < 4 * 32 + 32 + 32 * 32 + 32 + 32 + 1; ++i) params.emplace_back(float(i % 11) * 0.02f - 0.1f);
+        for (int i = 0; i < 4; ++i) input.emplace_back(float(i) * 0.25f);
+    }
+
+    Value<float> operator()() const {
+        std::size_t p = 0;
+        auto layer = [&](const std::vector<Value<float>>& in, std::size_t width) {
+            std::vector<Value<float>> out;
+            for (std::size_t o = 0; o < width; ++o) {
+                Value<float> sum = params[p++];
+                for (auto& x : in) sum = sum + params[p++] * x;
+                out.push_back(width > 1 ? sum.tanh() : sum);
+            }
+            return out;
+        };
+        return layer(layer(layer(input, 32), 32), 1)[0];
+    }
+};
+
+// Forward pass only, with or without graph construction, with nodes on the heap or on a Tape.
+// Also counts the nodes that the result keeps alive.
+void inference(benchmark::State& state, bool no_grad, bool use_tape) {
+    Model model;
+    std::optional<NoGradGuard> guard;
+    if (no_grad) guard.emplace();
+    std::optional<Tape<float>> tape;
+    if (use_tape) tape.emplace();
+    for (auto _ : state) {
+        auto y = model();
+        benchmark::DoNotOptimize(y.get_data());
+        if (tape) {
+            y = Value<float>(0.0f);
+            tape->reset();
+        }
+    }
+    state.counters["retained_nodes"] = model().topological_order().size();
+    state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+static void BM_InferenceGraph(benchmark::State& state) { inference(state, false, false); }
+BENCHMARK(BM_InferenceGraph);
+static void BM_InferenceNoGrad(benchmark::State& state) { inference(state, true, false); }
+BENCHMARK(BM_InferenceNoGrad);
+static void BM_InferenceGraphTape(benchmark::State& state) { inference(state, false, true); }
+BENCHMARK(BM_InferenceGraphTape);
+static void BM_InferenceNoGradTape(benchmark::State& state) { inference(state, true, true); }
+BENCHMARK(BM_InferenceNoGradTape);
@@ -0,0 +1,72 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "picograd/optim.h"
+#include "picograd/thread_pool.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+constexpr float lr = 1e-3f;
+constexpr float beta1 = 0.9f;
+constexpr float beta2 = 0.999f;
+constexpr float eps = 1e-8f;
+
+// Adam over heap Values the way user code does it: one scalar at a time through the Values
+void BM_AdamPerValue(benchmark::State& state) {
+    auto n = std::size_t(state.range(0));
+    std::vector<Value<float>> params;
+    for (std::size_t i = 0; i < n; ++i) params.emplace_back(float(i % 13) * 0.01f);
+    std::vector<float> m(n, 0.0f);
+    std::vector<float> v(n, 0.0f);
+    int t = 0;
+    for (auto _ : state) {
+        ++t;
+        float c1 = 1 - std::pow(beta1, float(t));
+        float c2 = 1 - std::pow(beta2, float(t));
+        state.PauseTiming();
+        for (std::size_t i = 0; i < n; ++i) params[i].set_grad(float(i % 7) * 0.1f);  // stands in for backward()
+        state.ResumeTiming();
+        for (std::size_t i = 0; i < n; ++i) {
+            float g = params[i].get_grad();
+            m[i] = beta1 * m[i] + (1 - beta1) * g;
+            v[i] = beta2 * v[i] + (1 - beta2) * g * g;
+            params[i].set_data(params[i].get_data() - lr * (m[i] / c1) / (std::sqrt(v[i] / c2) + eps));
+        }
+        for (auto& p : params) p.set_grad(0);
+    }
+    state.SetItemsProcessed(state.iterations() * std::int64_t(n));
+}
+BENCHMARK(BM_AdamPerValue)->Arg(1 << 16)->Arg(1 << 20);
+
+void adam_fused(benchmark::State& state, ThreadPool* pool) {
+    auto n = std::size_t(state.range(0));
+    ParameterSet<float> params(n);
+    for (std::size_t i = 0; i < n; ++i) params.add(float(i % 13) * 0.01f);
+    optim::Adam<float> optimizer(params, lr, beta1, beta2, eps);
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (std::size_t i = 0; i < n; ++i) params[i].set_grad(float(i % 7) * 0.1f);
+        state.ResumeTiming();
+        if (pool) optimizer.step(*pool);
+        else optimizer.step();  // also zeroes the gradients
+    }
+    state.SetItemsProcessed(state.iterations() * std::int64_t(n));
+}
+
+} // namespace
+
+// The same with the parameters in a ParameterSet and one fused step (which zeroes the gradients too)
+static void BM_AdamFused(benchmark::State& state) { adam_fused(state, nullptr); }
+BENCHMARK(BM_AdamFused)->Arg(1 << 16)->Arg(1 << 20);
+
+static void BM_AdamFusedPool(benchmark::State& state) {
+    static ThreadPool pool;
+    adam_fused(state, &pool);
+}
+BENCHMARK(BM_AdamFusedPool)->Arg(1 << 20);
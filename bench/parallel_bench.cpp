@@ -0,0 +1,68 @@
+#include <benchmark/benchmark.h>
+
+#include <thread>
+#include <vector>
+
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+// Per-sample loss of a 16-wide tanh layer with shared weights, summed over a batch: the samples
+// are independent subgraphs below the final sum (about 100 nodes each)
+Value<float> batch_loss(const std::vector<Value<float>>& weights, std::size_t batch) {
+    Value<float> loss(0.0f);
+    for (std::size_t s = 0; s < batch; ++s) {
+        Value<float> x(float(s % 17) * 0.05f);
+        Value<float> out(0.0f);
+        for (std::size_t h = 0; h < 16; ++h) {
+            out = out + (x * weights[2 * h] + weights[2 * h + 1]).tanh();
+        }
+        loss = loss + out * out;
+    }
+    return loss;
+}
+
+std::vector<Value<float>> make_weights() {
+    std::vector<Value<float>> weights;
+    for (int i = 0; i < 32; ++i) weights.emplace_back(float(i % 7) * 0.1f - 0.3f);
+    return weights;
+}
+
+} // namespace
+
+static void BM_BackwardSerial(benchmark::State& state) {
+    Tape<float> tape;
+    auto weights = make_weights();
+    auto loss = batch_loss(weights, state.range(0));
+    auto order = loss.topological_order();
+    for (auto _ : state) {
+        order.backward();
+    }
+    state.SetItemsProcessed(state.iterations() * order.size());
+}
+BENCHMARK(BM_BackwardSerial)->RangeMultiplier(16)->Range(256, 65536)->Unit(benchmark::kMillisecond);
+
+// Args: batch size, threads, deterministic (a single thread would take the serial path)
+static void BM_BackwardParallel(benchmark::State& state) {
+    Tape<float> tape;
+    auto weights = make_weights();
+    auto loss = batch_loss(weights, state.range(0));
+    auto order = loss.topological_order();
+    ThreadPool pool(state.range(1));
+    bool deterministic = state.range(2) != 0;
+    for (auto _ : state) {
+        order.backward(pool, deterministic);
+    }
+    state.SetLabel(deterministic ? "deterministic" : "atomic");
+    state.SetItemsProcessed(state.iterations() * order.size());
+}
+
+static void parallel_args(benchmark::internal::Benchmark* b) {
+    std::vector<int64_t> threads{2, 4};
+    int64_t cores = std::thread::hardware_concurrency();
+    if (cores > 4) threads.push_back(cores);
+    b->ArgsProduct({{256, 4096, 65536}, threads, {0, 1}});
+}
+BENCHMARK(BM_BackwardParallel)->Apply(parallel_args)->Unit(benchmark::kMillisecond)->UseRealTime();
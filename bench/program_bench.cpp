@@ -0,0 +1,80 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+// 2 -> 16 -> 1 tanh network with squared error for one sample (about 100 nodes)
+struct Net {
+    std::vector<Value<float>> params;
+    Value<float> x1{0.0f};
+    Value<float> x2{0.0f};
+    Value<float> target{0.0f};
+
+    Net() {
+        for (int i = 0; i < 16 * 4 + 1; ++i) params.emplace_back(float(i % 11) * 0.05f - 0.25f);
+    }
+
+    Value<float> loss() const {
+        Value<float> out = params[64];
+        for (std::size_t h = 0; h < 16; ++h) {
+            out = out + (params[4 * h] * x1 + params[4 * h + 1] * x2 + params[4 * h + 2]).tanh() * params[4 * h + 3];
+        }
+        return (out - target).pow(2);
+    }
+
+    void set_sample(std::size_t i) {
+        x1.set_data(float(i % 17) * 0.1f - 0.8f);
+        x2.set_data(float(i % 13) * 0.1f - 0.6f);
+        target.set_data(x1.get_data() > x2.get_data() ? 1.0f : -1.0f);
+    }
+};
+
+} // namespace
+
+// Forward and backward for one sample per item: rebuilding the graph every time (on a Tape),
+// re-running a cached topological order, and replaying a compiled Program
+static void BM_PerSampleRebuild(benchmark::State& state) {
+    Net net;
+    Tape<float> tape;
+    std::size_t i = 0;
+    for (auto _ : state) {
+        net.set_sample(i++);
+        auto loss = net.loss();
+        loss.backward();
+        tape.reset();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PerSampleRebuild);
+
+static void BM_PerSampleOrder(benchmark::State& state) {
+    Net net;
+    auto loss = net.loss();
+    auto order = loss.topological_order();
+    std::size_t i = 0;
+    for (auto _ : state) {
+        net.set_sample(i++);
+        order.forward();
+        order.backward();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PerSampleOrder);
+
+static void BM_PerSampleProgram(benchmark::State& state) {
+    Net net;
+    Program<float> program(net.loss());
+    std::size_t i = 0;
+    for (auto _ : state) {
+        net.set_sample(i++);
+        program.forward();
+        program.backward();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PerSampleProgram);
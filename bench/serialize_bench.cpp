@@ -0,0 +1,53 @@
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "picograd/serialize.h"
+
+using namespace ajs;
+
+namespace {
+
+constexpr std::size_t weights = std::size_t(1) << 24;  // 64 MB of floats
+
+// A model file with one large weight array, written once
+const std::string& model_file() {
+    static std::string path = [] {
+        auto path = (std::filesystem::temp_directory_path() / "picograd_bench_model.bin").string();
+        std::vector<float> data(weights);
+        for (std::size_t i = 0; i < weights; ++i) data[i] = float(i % 101) * 0.01f;
+        serialize::Writer writer;
+        writer.add("w", data, {4096, weights / 4096});
+        writer.save(path);
+        return path;
+    }();
+    return path;
+}
+
+} // namespace
+
+// Time until the weights can be used: mapping the file in place, against reading it into memory
+static void BM_OpenMapped(benchmark::State& state) {
+    auto& path = model_file();
+    for (auto _ : state) {
+        serialize::MappedFile file(path);
+        auto w = file.get<float>("w");
+        benchmark::DoNotOptimize(w[w.size() / 2]);
+    }
+}
+BENCHMARK(BM_OpenMapped)->Unit(benchmark::kMicrosecond);
+
+static void BM_OpenRead(benchmark::State& state) {
+    auto& path = model_file();
+    for (auto _ : state) {
+        std::ifstream in(path, std::ios::binary);
+        std::vector<float> w(std::filesystem::file_size(path) / sizeof(float));
+        in.read(reinterpret_cast<char*>(w.data()), std::streamsize(w.size() * sizeof(float)));
+        benchmark::DoNotOptimize(w[w.size() / 2]);
+    }
+}
+BENCHMARK(BM_OpenRead)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,63 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "picograd/simd.h"
+
+using namespace ajs;
+
+template<typename T>
+static void BM_SimdForward(benchmark::State& state) {
+    auto op = static_cast<Op>(state.range(0));
+    auto isa = static_cast<simd::Isa>(state.range(1));
+    if (!simd::set_isa(isa)) {
+        state.SkipWithError("instruction set not supported");
+        return;
+    }
+    std::vector<T> in(4096);
+    std::vector<T> out(in.size());
+    for (std::size_t i = 0; i < in.size(); ++i) in[i] = T(i % 100) * T(0.05) + T(0.01);
+    for (auto _ : state) {
+        simd::forward(op, in.data(), out.data(), in.size());
+        benchmark::DoNotOptimize(out.data());
+    }
+    simd::set_isa(simd::detected_isa());
+    state.SetLabel(std::string(op_str(op)) + "/" + simd::isa_str(isa));
+    state.SetItemsProcessed(state.iterations() * in.size());
+}
+
+template<typename T>
+static void BM_SimdBackward(benchmark::State& state) {
+    auto op = static_cast<Op>(state.range(0));
+    auto isa = static_cast<simd::Isa>(state.range(1));
+    if (!simd::set_isa(isa)) {
+        state.SkipWithError("instruction set not supported");
+        return;
+    }
+    std::vector<T> in(4096);
+    std::vector<T> out(in.size());
+    std::vector<T> grad_out(in.size(), T(1));
+    std::vector<T> grad_in(in.size(), T(0));
+    for (std::size_t i = 0; i < in.size(); ++i) in[i] = T(i % 100) * T(0.05) + T(0.01);
+    simd::forward(op, in.data(), out.data(), in.size());
+    for (auto _ : state) {
+        simd::backward(op, in.data(), out.data(), grad_out.data(), grad_in.data(), in.size());
+        benchmark::DoNotOptimize(grad_in.data());
+    }
+    simd::set_isa(simd::detected_isa());
+    state.SetLabel(std::string(op_str(op)) + "/" + simd::isa_str(isa));
+    state.SetItemsProcessed(state.iterations() * in.size());
+}
+
+static void simd_args(benchmark::internal::Benchmark* b) {
+    for (auto op : {Op::exp, Op::log, Op::tanh, Op::sigmoid, Op::relu}) {
+        for (auto isa : {simd::Isa::scalar, simd::Isa::neon, simd::Isa::avx2, simd::Isa::avx512}) {
+            if (simd::supported(isa)) b->Args({static_cast<int64_t>(op), static_cast<int64_t>(isa)});
+        }
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_SimdForward, float)->Apply(simd_args);
+BENCHMARK_TEMPLATE(BM_SimdForward, double)->Apply(simd_args);
+BENCHMARK_TEMPLATE(BM_SimdBackward, float)->Apply(simd_args);
+BENCHMARK_TEMPLATE(BM_SimdBackward, double)->Apply(simd_args);
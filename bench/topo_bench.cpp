@@ -0,0 +1,79 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+// Sum of `size` products of two leaves each (about 3 nodes per term), like a big dense layer
+Value<float> wide_graph(std::vector<Value<float>>& leaves, std::size_t size) {
+    auto n = std::max<std::size_t>(size / 3, 1);
+    leaves.clear();
+    for (std::size_t i = 0; i < n; ++i) {
+        leaves.emplace_back(float(i % 7) * 0.1f);
+    }
+    Value<float> y = leaves[0] * leaves[n - 1];
+    for (std::size_t i = 1; i < n; ++i) {
+        y = y + leaves[i] * leaves[n - 1 - i];
+    }
+    return y;
+}
+
+} // namespace
+
+static void BM_TopologicalOrder(benchmark::State& state) {
+    Tape<float> tape;  // keeps teardown of deep graphs iterative
+    std::vector<Value<float>> leaves;
+    auto y = wide_graph(leaves, state.range(0));
+    std::size_t nodes = 0;
+    for (auto _ : state) {
+        auto order = y.topological_order();
+        nodes = order.size();
+        benchmark::DoNotOptimize(order);
+    }
+    state.counters["nodes"] = double(nodes);
+    state.SetItemsProcessed(state.iterations() * nodes);
+}
+BENCHMARK(BM_TopologicalOrder)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMillisecond);
+
+static void BM_Backward(benchmark::State& state) {
+    Tape<float> tape;
+    std::vector<Value<float>> leaves;
+    auto y = wide_graph(leaves, state.range(0));
+    for (auto _ : state) {
+        y.backward();
+    }
+    state.SetItemsProcessed(state.iterations() * y.topological_order().size());
+}
+BENCHMARK(BM_Backward)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMillisecond);
+
+static void BM_BackwardCachedOrder(benchmark::State& state) {
+    Tape<float> tape;
+    std::vector<Value<float>> leaves;
+    auto y = wide_graph(leaves, state.range(0));
+    auto order = y.topological_order();
+    for (auto _ : state) {
+        order.forward();
+        order.backward();
+    }
+    state.SetItemsProcessed(state.iterations() * order.size());
+}
+BENCHMARK(BM_BackwardCachedOrder)->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMillisecond);
+
+static void BM_BackwardDeepChain(benchmark::State& state) {
+    auto x = Value(0.5f);
+    Tape<float> tape;
+    auto y = x;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        y = y.tanh();
+    }
+    for (auto _ : state) {
+        y.backward();
+    }
+    state.counters["depth"] = double(state.range(0));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BackwardDeepChain)->Arg(1 << 20)->Arg(1 << 22)->Unit(benchmark::kMillisecond);
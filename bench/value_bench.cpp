@@ -0,0 +1,192 @@
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "picograd/ops.h"
+#include "picograd/tape.h"
+#include "picograd/value.h"
+
+#include "memory.h"
+
+using namespace ajs;
+
+// The core of Value: the cost of recording every op, of backward() over graphs of different
+// shapes and sizes, and of building and tearing down deep graphs, with their heap use. Run with
+// --benchmark_out=<file> --benchmark_out_format=json (or the bench_json target) to compare commits.
+
+namespace {
+
+template<Op op>
+Value<float> apply(const Value<float>& a, const Value<float>& b) {
+    if constexpr (op == Op::add) return a + b;
+    else if constexpr (op == Op::sub) return a - b;
+    else if constexpr (op == Op::mult) return a * b;
+    else if constexpr (op == Op::div) return a / b;
+    else if constexpr (op == Op::rsub) return 2.0f - a;
+    else if constexpr (op == Op::rdiv) return 2.0f / a;
+    else if constexpr (op == Op::neg) return -a;
+    else if constexpr (op == Op::pow) return a.pow(3);
+    else if constexpr (op == Op::square) return a.square();
+    else if constexpr (op == Op::exp) return a.exp();
+    else if constexpr (op == Op::log) return a.log();
+    else if constexpr (op == Op::tanh) return a.tanh();
+    else if constexpr (op == Op::relu) return a.relu();
+    else if constexpr (op == Op::sigmoid) return a.sigmoid();
+    else static_assert(op == Op::add, "not a Value op");
+}
+
+// Chain: every node uses the one before (depth n)
+Value<float> chain(const Value<float>& x, std::size_t n) {
+    Value<float> y = x;
+    for (std::size_t i = 0; i < n; ++i) y = y * 0.999f;
+    return y;
+}
+
+// Tree: pairwise sum of n leaves (depth log2(n))
+Value<float> tree(std::vector<Value<float>>& leaves, std::size_t n) {
+    leaves.clear();
+    for (std::size_t i = 0; i < n; ++i) leaves.emplace_back(float(i % 7) * 0.1f);
+    auto level = leaves;
+    while (level.size() > 1) {
+        std::vector<Value<float>> next;
+        for (std::size_t i = 0; i + 1 < level.size(); i += 2) next.push_back(level[i] + level[i + 1]);
+        if (level.size() % 2) next.push_back(level.back());
+        level = std::move(next);
+    }
+    return level[0];
+}
+
+// Wide DAG: layers of 64 nodes, each using two nodes of the layer before, so that every node has
+// two users (n / 64 layers)
+Value<float> wide(std::vector<Value<float>>& leaves, std::size_t n) {
+    constexpr std::size_t width = 64;
+    leaves.clear();
+    for (std::size_t i = 0; i < width; ++i) leaves.emplace_back(float(i % 7) * 0.1f);
+    auto layer = leaves;
+    for (std::size_t depth = 0; depth < n / width; ++depth) {
+        std::vector<Value<float>> next;
+        for (std::size_t i = 0; i < width; ++i) next.push_back(layer[i] * layer[(i + 1) % width]);
+        layer = std::move(next);
+    }
+    Value<float> y = layer[0];
+    for (std::size_t i = 1; i < width; ++i) y = y + layer[i];
+    return y;
+}
+
+} // namespace
+
+// Recording one op (forward computation and node) on a Tape, per op
+template<Op op>
+static void BM_OpForward(benchmark::State& state) {
+    Value<float> a(0.7f);
+    Value<float> b(1.3f);
+    Tape<float> tape(1024);
+    for (auto _ : state) {
+        for (int i = 0; i < 1024; ++i) benchmark::DoNotOptimize(apply<op>(a, b));
+        tape.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * 1024);
+}
+BENCHMARK_TEMPLATE(BM_OpForward, Op::add);
+BENCHMARK_TEMPLATE(BM_OpForward, Op::sub);
+BENCHMARK_TEMPLATE(BM_OpForward, Op::mult);
+BENCHMARK_TEMPLATE(BM_OpForward, Op::div);
+BENCHMARK_TEMPLATE(BM_OpForward, Op::rsub);
+BENCHMARK_TEMPLATE(BM_OpForward, Op::rdiv);
+BENCHMARK_TEMPLATE(BM_OpForward, Op::neg);
+BENCHMARK_TEMPLATE(BM_OpForward, Op::pow);
+BENCHMARK_TEMPLATE(BM_OpForward, Op::square);
+BENCHMARK_TEMPLATE(BM_OpForward, Op::exp);
+BENCHMARK_TEMPLATE(BM_OpForward, Op::log);
+BENCHMARK_TEMPLATE(BM_OpForward, Op::tanh);
+BENCHMARK_TEMPLATE(BM_OpForward, Op::relu);
+BENCHMARK_TEMPLATE(BM_OpForward, Op::sigmoid);
+
+// backward() over n-node graphs of each shape (built on a Tape, outside of the timing)
+static void BM_BackwardChain(benchmark::State& state) {
+    Tape<float> tape;
+    Value<float> x(0.5f);
+    auto y = chain(x, std::size_t(state.range(0)));
+    for (auto _ : state) y.backward();
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BackwardChain)->RangeMultiplier(8)->Range(1 << 10, 1 << 19)->Unit(benchmark::kMicrosecond);
+
+static void BM_BackwardTree(benchmark::State& state) {
+    Tape<float> tape;
+    std::vector<Value<float>> leaves;
+    auto y = tree(leaves, std::size_t(state.range(0)));
+    for (auto _ : state) y.backward();
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BackwardTree)->RangeMultiplier(8)->Range(1 << 10, 1 << 19)->Unit(benchmark::kMicrosecond);
+
+static void BM_BackwardWide(benchmark::State& state) {
+    Tape<float> tape;
+    std::vector<Value<float>> leaves;
+    auto y = wide(leaves, std::size_t(state.range(0)));
+    for (auto _ : state) y.backward();
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BackwardWide)->RangeMultiplier(8)->Range(1 << 10, 1 << 19)->Unit(benchmark::kMicrosecond);
+
+// Building a chain of n heap nodes, and tearing it down, timed separately. Also reports the heap
+// use per node: allocations and peak bytes while the graph is alive.
+static void BM_ChainBuild(benchmark::State& state) {
+    auto n = std::size_t(state.range(0));
+    Value<float> x(0.5f);
+    std::size_t allocations = 0;
+    std::size_t peak = 0;
+    for (auto _ : state) {
+        auto begin = bench_memory::allocations();
+        auto before = bench_memory::current_bytes();
+        bench_memory::reset_peak();
+        auto y = chain(x, n);
+        allocations = bench_memory::allocations() - begin;
+        peak = bench_memory::peak_bytes() - before;
+        state.PauseTiming();
+        y = Value<float>(0.0f);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["allocs_per_node"] = double(allocations) / double(n);
+    state.counters["peak_bytes_per_node"] = double(peak) / double(n);
+}
+BENCHMARK(BM_ChainBuild)->RangeMultiplier(8)->Range(1 << 10, 1 << 16)->Unit(benchmark::kMicrosecond);
+
+static void BM_ChainTeardown(benchmark::State& state) {
+    Value<float> x(0.5f);
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto y = chain(x, std::size_t(state.range(0)));
+        state.ResumeTiming();
+        y = Value<float>(0.0f);  // frees the chain
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ChainTeardown)->RangeMultiplier(8)->Range(1 << 10, 1 << 21)->Unit(benchmark::kMicrosecond);
+
+// The same chain on a Tape: bump allocation, and freeing is one reset()
+static void BM_ChainBuildTape(benchmark::State& state) {
+    auto n = std::size_t(state.range(0));
+    Value<float> x(0.5f);
+    Tape<float> tape(n);
+    std::size_t allocations = 0;
+    std::size_t peak = 0;
+    for (auto _ : state) {
+        auto begin = bench_memory::allocations();
+        auto before = bench_memory::current_bytes();
+        bench_memory::reset_peak();
+        {
+            auto y = chain(x, n);
+            allocations = bench_memory::allocations() - begin;
+            peak = bench_memory::peak_bytes() - before;
+        }
+        tape.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["allocs_per_node"] = double(allocations) / double(n);
+    state.counters["peak_bytes_per_node"] = double(peak) / double(n);
+}
+BENCHMARK(BM_ChainBuildTape)->RangeMultiplier(8)->Range(1 << 10, 1 << 16)->Unit(benchmark::kMicrosecond);
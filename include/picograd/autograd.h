@@ -0,0 +1,338 @@
+#pragma once
+
+#include <cmath>            // std::pow
+#include <cstddef>          // std::size_t
+#include <cstdint>
+#include <memory>           // smart pointers
+#include <optional>
+#include <span>
+#include <stdexcept>        // std::invalid_argument
+#include <string>
+#include <vector>
+
+#include "value.h"
+
+namespace ajs {
+
+// Gradients as Values, and derivative products, without touching the gradients stored in nodes.
+//
+// grad(y, xs) returns dy/dxs[i] for each i (0 for Values that y does not depend on). With
+// create_graph=true, the gradients are computed with Value operations, so they are Values with a
+// graph of their own, which can be differentiated again (e.g. gradient penalties or Newton steps):
+//
+//     auto g = grad(loss, params, true);
+//     Value<float> penalty = g[0].square() + g[1].square();
+//     penalty.backward();  // accumulates d(penalty)/dparams into the params' gradients
+//
+// jvp(ys, xs, v) returns the product of the Jacobian of ys with respect to xs with the vector v, in
+// one forward-mode sweep over the graph. hvp(y, xs, v) returns the product of the Hessian of y
+// with v, exactly and without building any nodes: a forward sweep for the derivatives of all nodes
+// in the direction v, then a backward pass that carries those derivatives of the gradients along.
+// Both only read the graph, using its current data.
+//
+// Linear nodes (see Value::linear()) only know their first derivatives, so graphs with linear
+// nodes cannot be differentiated with create_graph=true, nor by hvp().
+template<typename T>
+std::vector<Value<T>> grad(const Value<T>& y, const std::vector<Value<T>>& xs, bool create_graph=false);
+
+template<typename T>
+std::vector<T> hvp(const Value<T>& y, const std::vector<Value<T>>& xs, const std::vector<T>& v);
+
+template<typename T>
+std::vector<T> jvp(const std::vector<Value<T>>& ys, const std::vector<Value<T>>& xs, const std::vector<T>& v);
+
+
+template<typename T>
+class Autograd
+{
+    using Node = typename Value<T>::Node;
+
+public:
+    static std::vector<Value<T>> grad(const Value<T>& y, const std::vector<Value<T>>& xs, bool create_graph);
+    static std::vector<T> hvp(const Value<T>& y, const std::vector<Value<T>>& xs, const std::vector<T>& v);
+    static std::vector<T> jvp(const std::vector<Value<T>>& ys, const std::vector<Value<T>>& xs, const std::vector<T>& v);
+
+private:
+    // Sorts the graph of roots into topo and stores every node's position in its index
+    static void sort(std::span<Node* const> roots, std::vector<Node*>& topo);
+    // Position of x's node in topo, or topo.size() if it is not in there
+    static std::size_t find(const Value<T>& x, const std::vector<Node*>& topo);
+    static void differentiable_backward(const Value<T>& y, const std::vector<Node*>& topo,
+                                        std::vector<std::optional<Value<T>>>& adjoints);
+    // Derivatives of all nodes of topo in the direction v of xs (forward mode, children first)
+    static std::vector<T> tangents(const std::vector<Node*>& topo, const std::vector<Value<T>>& xs, const std::vector<T>& v);
+};
+
+
+template<typename T>
+void Autograd<T>::sort(std::span<Node* const> roots, std::vector<Node*>& topo) {
+    Value<T>::topological_order(roots, topo);
+    for (std::size_t i = 0; i < topo.size(); ++i) topo[i]->index = std::uint32_t(i);
+}
+
+template<typename T>
+std::size_t Autograd<T>::find(const Value<T>& x, const std::vector<Node*>& topo) {
+    auto i = x.node_->index;
+    return i < topo.size() && topo[i] == x.node_.get() ? i : topo.size();
+}
+
+template<typename T>
+std::vector<Value<T>> Autograd<T>::grad(const Value<T>& y, const std::vector<Value<T>>& xs, bool create_graph) {
+    std::vector<Node*> topo;
+    Node* root = y.node_.get();
+    sort(std::span<Node* const>(&root, 1), topo);
+
+    std::vector<Value<T>> grads;
+    grads.reserve(xs.size());
+    if (create_graph) {
+        std::vector<std::optional<Value<T>>> adjoints(topo.size());
+        differentiable_backward(y, topo, adjoints);
+        for (auto& x : xs) {
+            auto i = find(x, topo);
+            grads.push_back(i < topo.size() && adjoints[i] ? *adjoints[i] : Value<T>(T(0), false));
+        }
+    }
+    else {
+        // Like Value::backward(), but into our own buffer
+        std::vector<T> adjoints(topo.size(), T(0));
+        adjoints.back() = 1;
+        T unused{0};
+        for (auto i = topo.size(); i-- > 0;) {
+            Node* node = topo[i];
+            if (node->op == Op::none) continue;
+            kernels::backward(node->op, node->data, adjoints[i], node->operand1(), node->operand2(),
+                              adjoints[node->child1->index], node->child2 ? adjoints[node->child2->index] : unused);
+        }
+        for (auto& x : xs) {
+            auto i = find(x, topo);
+            grads.emplace_back(i < topo.size() ? adjoints[i] : T(0), false);
+        }
+    }
+    return grads;
+}
+
+// Backpropagates with Value operations: adjoints[i] becomes dy/dtopo[i] as a Value (or stays empty
+// if it is 0). The rules mirror kernels::backward(), recorded straight from the nodes.
+template<typename T>
+void Autograd<T>::differentiable_backward(const Value<T>& y, const std::vector<Node*>& topo,
+                                          std::vector<std::optional<Value<T>>>& adjoints) {
+    using Ptr = std::shared_ptr<Node>;
+    auto binary = [](Op op, const Ptr& a, const Ptr& b) {
+        return Value<T>::record(kernels::forward(op, a->data, b->data), op, a, b);
+    };
+    auto scalar = [](Op op, const Ptr& a, T param) {
+        return Value<T>::record(kernels::forward(op, a->data, param), op, a, nullptr, param);
+    };
+    // Adds the contribution (or subtracts it, so that negations take no node of their own)
+    auto accumulate = [&](const Ptr& child, Value<T> contribution, bool negate=false) {
+        auto& adjoint = adjoints[child->index];
+        if (adjoint) adjoint = negate ? *adjoint - contribution : *adjoint + contribution;
+        else adjoint = negate ? -contribution : std::move(contribution);
+    };
+
+    // The nodes' own shared_ptrs, for the rules that use the result of the op. A node's is found
+    // in its users, which come before it.
+    std::vector<Ptr> nodes(topo.size());
+    nodes.back() = y.node_;
+    adjoints.back() = Value<T>(T(1), false);
+
+    for (auto i = topo.size(); i-- > 0;) {
+        Node* node = topo[i];
+        if (node->op == Op::none || !adjoints[i]) continue;
+        if (node->op == Op::linear) throw std::invalid_argument("linear nodes cannot be differentiated twice");
+
+        const Ptr& g = adjoints[i]->node_;
+        const Ptr& out = nodes[i];
+        const Ptr& a = node->child1;
+        const Ptr& b = node->child2;
+        if (!nodes[a->index]) nodes[a->index] = a;
+        if (b && !nodes[b->index]) nodes[b->index] = b;
+        T p = node->param;
+
+        switch (node->op) {
+        case Op::add:
+            accumulate(a, *adjoints[i]);
+            if (b) accumulate(b, *adjoints[i]);
+            break;
+        case Op::sub:
+            accumulate(a, *adjoints[i]);
+            if (b) accumulate(b, *adjoints[i], true);
+            break;
+        case Op::mult:
+            accumulate(a, b ? binary(Op::mult, g, b) : scalar(Op::mult, g, p));
+            if (b) accumulate(b, binary(Op::mult, g, a));
+            break;
+        case Op::div:
+            accumulate(a, b ? binary(Op::div, g, b) : scalar(Op::div, g, p));
+            if (b) accumulate(b, binary(Op::div, binary(Op::mult, g, out).node_, b), true);
+            break;
+        case Op::rsub:
+        case Op::neg:
+            accumulate(a, *adjoints[i], true);
+            break;
+        case Op::rdiv:
+            accumulate(a, binary(Op::div, binary(Op::mult, g, out).node_, a), true);
+            break;
+        case Op::pow:
+            accumulate(a, binary(Op::mult, g, scalar(Op::mult, scalar(Op::pow, a, p - 1).node_, p).node_));
+            break;
+        case Op::square:
+            accumulate(a, binary(Op::mult, g, scalar(Op::mult, a, T(2)).node_));
+            break;
+        case Op::exp:
+            accumulate(a, binary(Op::mult, g, out));
+            break;
+        case Op::log:  // 1 / a, clamped like kernels::safe_log_arg() (a constant where a is 0)
+            accumulate(a, a->data != 0 ? binary(Op::div, g, a) : scalar(Op::div, g, kernels::safe_log_arg(a->data)));
+            break;
+        case Op::tanh:  // 1 - out^2
+            accumulate(a, binary(Op::mult, g, scalar(Op::rsub, scalar(Op::square, out, 0).node_, T(1)).node_));
+            break;
+        case Op::relu:
+            if (node->data > 0) accumulate(a, *adjoints[i]);
+            break;
+        case Op::sigmoid:  // out * (1 - out)
+            accumulate(a, binary(Op::mult, g, binary(Op::mult, out, scalar(Op::rsub, out, T(1)).node_).node_));
+            break;
+        default:
+            throw std::invalid_argument(std::string("cannot differentiate ") + op_str(node->op) + " twice");
+        }
+    }
+}
+
+template<typename T>
+std::vector<T> Autograd<T>::tangents(const std::vector<Node*>& topo, const std::vector<Value<T>>& xs, const std::vector<T>& v) {
+    if (v.size() != xs.size()) throw std::invalid_argument("need one vector entry per input");
+    std::vector<T> tangents(topo.size(), T(0));
+    std::vector<bool> seeded(topo.size(), false);
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+        auto j = find(xs[i], topo);
+        if (j == topo.size()) continue;
+        tangents[j] += v[i];
+        seeded[j] = true;
+    }
+    for (std::size_t i = 0; i < topo.size(); ++i) {
+        Node* node = topo[i];
+        if (node->op == Op::none || seeded[i]) continue;
+        T a_derivative{0};
+        T b_derivative{0};
+        kernels::backward(node->op, node->data, T(1), node->operand1(), node->operand2(), a_derivative, b_derivative);
+        tangents[i] = a_derivative * tangents[node->child1->index];
+        if (node->child2) tangents[i] += b_derivative * tangents[node->child2->index];
+    }
+    return tangents;
+}
+
+template<typename T>
+std::vector<T> Autograd<T>::jvp(const std::vector<Value<T>>& ys, const std::vector<Value<T>>& xs, const std::vector<T>& v) {
+    std::vector<Node*> roots;
+    for (auto& y : ys) roots.push_back(y.node_.get());
+    std::vector<Node*> topo;
+    sort(roots, topo);
+    auto t = tangents(topo, xs, v);
+    std::vector<T> out;
+    out.reserve(ys.size());
+    for (auto& y : ys) out.push_back(t[y.node_->index]);
+    return out;
+}
+
+// Forward over reverse: the backward pass, with every gradient carrying its derivative in the
+// direction v along. For out = op(a, b), a_grad gets grad * da, so its tangent gets
+// grad_tangent * da + grad * (the tangent of da), and the same for b.
+template<typename T>
+std::vector<T> Autograd<T>::hvp(const Value<T>& y, const std::vector<Value<T>>& xs, const std::vector<T>& v) {
+    std::vector<Node*> topo;
+    Node* root = y.node_.get();
+    sort(std::span<Node* const>(&root, 1), topo);
+    auto t = tangents(topo, xs, v);
+
+    std::vector<T> adjoints(topo.size(), T(0));
+    std::vector<T> adjoint_tangents(topo.size(), T(0));
+    adjoints.back() = 1;
+    for (auto i = topo.size(); i-- > 0;) {
+        Node* node = topo[i];
+        if (node->op == Op::none) continue;
+        if (node->op == Op::linear) throw std::invalid_argument("linear nodes cannot be differentiated twice");
+
+        T da{0};
+        T db{0};
+        T a = node->operand1();
+        T b = node->operand2();
+        T out = node->data;
+        kernels::backward(node->op, out, T(1), a, b, da, db);
+        T a_t = t[node->child1->index];
+        T b_t = node->child2 ? t[node->child2->index] : T(0);  // constant operands do not move
+        T out_t = t[i];
+        T da_t{0};
+        T db_t{0};
+        switch (node->op) {
+        case Op::mult:
+            da_t = b_t;
+            db_t = a_t;
+            break;
+        case Op::div:  // da = 1 / b, db = -out / b
+            da_t = -b_t / (b * b);
+            db_t = -(out_t - out * b_t / b) / b;
+            break;
+        case Op::rdiv:  // da = -out / a
+            da_t = -(out_t - out * a_t / a) / a;
+            break;
+        case Op::pow:
+            da_t = b * (b - 1) * std::pow(a, b - 2) * a_t;
+            break;
+        case Op::square:
+            da_t = 2 * a_t;
+            break;
+        case Op::exp:
+            da_t = out_t;
+            break;
+        case Op::log:  // da = 1 / a, clamped like kernels::safe_log_arg(), which is constant where a is 0
+            da_t = a != 0 ? -a_t / (a * a) : T(0);
+            break;
+        case Op::tanh:
+            da_t = -2 * out * out_t;
+            break;
+        case Op::sigmoid:
+            da_t = out_t * (1 - 2 * out);
+            break;
+        default:  // constant derivatives (add, sub, rsub, neg, relu)
+            break;
+        }
+
+        T g = adjoints[i];
+        T g_t = adjoint_tangents[i];
+        auto c1 = node->child1->index;
+        adjoints[c1] += g * da;
+        adjoint_tangents[c1] += g_t * da + g * da_t;
+        if (node->child2) {
+            auto c2 = node->child2->index;
+            adjoints[c2] += g * db;
+            adjoint_tangents[c2] += g_t * db + g * db_t;
+        }
+    }
+
+    std::vector<T> out;
+    out.reserve(xs.size());
+    for (auto& x : xs) {
+        auto i = find(x, topo);
+        out.push_back(i < topo.size() ? adjoint_tangents[i] : T(0));
+    }
+    return out;
+}
+
+template<typename T>
+std::vector<Value<T>> grad(const Value<T>& y, const std::vector<Value<T>>& xs, bool create_graph) {
+    return Autograd<T>::grad(y, xs, create_graph);
+}
+
+template<typename T>
+std::vector<T> hvp(const Value<T>& y, const std::vector<Value<T>>& xs, const std::vector<T>& v) {
+    return Autograd<T>::hvp(y, xs, v);
+}
+
+template<typename T>
+std::vector<T> jvp(const std::vector<Value<T>>& ys, const std::vector<Value<T>>& xs, const std::vector<T>& v) {
+    return Autograd<T>::jvp(ys, xs, v);
+}
+
+} // namespace ajs
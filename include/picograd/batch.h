@@ -0,0 +1,158 @@
+#pragma once
+
+#include <array>
+#include <cstddef>          // std::size_t
+#include <ostream>
+
+#include "ops.h"
+#include "simd.h"
+
+namespace ajs {
+
+// A pack of N numbers (lanes) that behaves like one number. As the element type of Value, it runs
+// one graph over N samples at once: every node holds N lanes of data and grad, and every op,
+// forward and backward, runs lane-wise. The graph overhead (a node, its recording and its place in
+// the backward pass) is paid once per N samples, and the lane loops vectorize; exp, log, tanh,
+// sigmoid and relu use the kernels of simd.h.
+//
+//     using B = Batch<float, 8>;
+//     Value<B> w(0.5f);  // a parameter, broadcast to all lanes
+//     Value<B> x(B{{0, 1, 2, 3, 4, 5, 6, 7}});  // 8 samples
+//     auto loss = (w * x - 1.0f).square();  // 8 losses
+//     loss.backward();  // w.get_grad()[i]: gradient of loss i; sum() for the whole batch
+//
+// Lanes never mix: reductions over the batch (e.g. a mean loss) are up to the caller, through
+// get_data() and get_grad().
+template<typename T, std::size_t N>
+class Batch
+{
+public:
+    using value_type = T;
+    static constexpr std::size_t lanes = N;
+
+    Batch(T x=0) { lanes_.fill(x); }  // all lanes x (implicit, so that scalars work like with Value<T>)
+    Batch(const std::array<T, N>& lanes) : lanes_{lanes} {}
+
+    T& operator[](std::size_t i) { return lanes_[i]; }
+    const T& operator[](std::size_t i) const { return lanes_[i]; }
+    T* data() { return lanes_.data(); }
+    const T* data() const { return lanes_.data(); }
+    const std::array<T, N>& array() const { return lanes_; }
+    T sum() const {
+        T out{0};
+        for (auto x : lanes_) out += x;
+        return out;
+    }
+
+    friend Batch operator+(const Batch& a, const Batch& b) { return lanewise(a, b, [](T x, T y) { return x + y; }); }
+    friend Batch operator-(const Batch& a, const Batch& b) { return lanewise(a, b, [](T x, T y) { return x - y; }); }
+    friend Batch operator*(const Batch& a, const Batch& b) { return lanewise(a, b, [](T x, T y) { return x * y; }); }
+    friend Batch operator/(const Batch& a, const Batch& b) { return lanewise(a, b, [](T x, T y) { return x / y; }); }
+    Batch operator-() const { return lanewise(*this, *this, [](T x, T) { return -x; }); }
+    Batch& operator+=(const Batch& other) { return *this = *this + other; }
+    Batch& operator-=(const Batch& other) { return *this = *this - other; }
+    Batch& operator*=(const Batch& other) { return *this = *this * other; }
+    Batch& operator/=(const Batch& other) { return *this = *this / other; }
+    friend bool operator==(const Batch& a, const Batch& b) { return a.lanes_ == b.lanes_; }
+
+    // f(a[i], b[i]) for every lane
+    template<typename F>
+    static Batch lanewise(const Batch& a, const Batch& b, F&& f) {
+        Batch out;
+        for (std::size_t i = 0; i < N; ++i) out.lanes_[i] = f(a.lanes_[i], b.lanes_[i]);
+        return out;
+    }
+
+private:
+    std::array<T, N> lanes_;
+};
+
+template<typename T, std::size_t N>
+std::ostream& operator<<(std::ostream& os, const Batch<T, N>& b) {
+    os << "[";
+    for (std::size_t i = 0; i < N; ++i) os << (i ? ", " : "") << b[i];
+    return os << "]";
+}
+
+namespace kernels {
+
+namespace detail {
+
+// The scalar kernels with the op known at compile time, so that their switch folds away and the
+// lane loops vectorize
+template<Op op, typename T, std::size_t N>
+Batch<T, N> forward_lanes(const Batch<T, N>& a, const Batch<T, N>& b) {
+    return Batch<T, N>::lanewise(a, b, [](T x, T y) { return forward(op, x, y); });
+}
+
+template<Op op, typename T, std::size_t N>
+void backward_lanes(const Batch<T, N>& out, const Batch<T, N>& grad, const Batch<T, N>& a, const Batch<T, N>& b,
+                    Batch<T, N>& a_grad, Batch<T, N>& b_grad) {
+    for (std::size_t i = 0; i < N; ++i) backward(op, out[i], grad[i], a[i], b[i], a_grad[i], b_grad[i]);
+}
+
+} // namespace detail
+
+template<typename T, std::size_t N>
+Batch<T, N> forward(Op op, const Batch<T, N>& a, const Batch<T, N>& b) {
+    Batch<T, N> out;
+    if (simd::forward(op, a.data(), out.data(), N)) return out;  // activations
+    switch (op) {
+    case Op::add:
+        return detail::forward_lanes<Op::add>(a, b);
+    case Op::sub:
+        return detail::forward_lanes<Op::sub>(a, b);
+    case Op::mult:
+        return detail::forward_lanes<Op::mult>(a, b);
+    case Op::div:
+        return detail::forward_lanes<Op::div>(a, b);
+    case Op::rsub:
+        return detail::forward_lanes<Op::rsub>(a, b);
+    case Op::rdiv:
+        return detail::forward_lanes<Op::rdiv>(a, b);
+    case Op::neg:
+        return detail::forward_lanes<Op::neg>(a, b);
+    case Op::pow:
+        return detail::forward_lanes<Op::pow>(a, b);
+    case Op::square:
+        return detail::forward_lanes<Op::square>(a, b);
+    case Op::none:
+    default:
+        return a;
+    }
+}
+
+template<typename T, std::size_t N>
+void backward(Op op, const Batch<T, N>& out, const Batch<T, N>& grad, const Batch<T, N>& a, const Batch<T, N>& b,
+              Batch<T, N>& a_grad, Batch<T, N>& b_grad) {
+    if (simd::backward(op, a.data(), out.data(), grad.data(), a_grad.data(), N)) return;  // activations
+    switch (op) {
+    case Op::add:
+        return detail::backward_lanes<Op::add>(out, grad, a, b, a_grad, b_grad);
+    case Op::sub:
+        return detail::backward_lanes<Op::sub>(out, grad, a, b, a_grad, b_grad);
+    case Op::mult:
+        return detail::backward_lanes<Op::mult>(out, grad, a, b, a_grad, b_grad);
+    case Op::div:
+        return detail::backward_lanes<Op::div>(out, grad, a, b, a_grad, b_grad);
+    case Op::rsub:
+        return detail::backward_lanes<Op::rsub>(out, grad, a, b, a_grad, b_grad);
+    case Op::rdiv:
+        return detail::backward_lanes<Op::rdiv>(out, grad, a, b, a_grad, b_grad);
+    case Op::neg:
+        return detail::backward_lanes<Op::neg>(out, grad, a, b, a_grad, b_grad);
+    case Op::pow:
+        return detail::backward_lanes<Op::pow>(out, grad, a, b, a_grad, b_grad);
+    case Op::square:
+        return detail::backward_lanes<Op::square>(out, grad, a, b, a_grad, b_grad);
+    case Op::linear:
+        return detail::backward_lanes<Op::linear>(out, grad, a, b, a_grad, b_grad);
+    case Op::none:
+    default:
+        return;
+    }
+}
+
+} // namespace kernels
+
+} // namespace ajs
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>        // std::max
+#include <cstddef>          // std::size_t
+#include <functional>       // std::function
+#include <memory>           // smart pointers
+#include <optional>
+#include <stdexcept>        // std::invalid_argument, std::logic_error
+#include <utility>          // std::move
+#include <vector>
+
+#include "no_grad.h"
+#include "value.h"
+
+namespace ajs {
+
+// Gradient checkpointing: trades compute for memory in deep graphs (e.g. unrolled recurrences).
+// The forward pass is split into segments, functions from Values to Values. A segment's outputs
+// are returned as new leaves (its boundary), so the rest of the graph does not keep the segment's
+// inner nodes alive. Segments are kept with their graph as long as the kept graphs fit into the
+// memory budget; the others are run without a graph (under a NoGradGuard) and run again, with a
+// graph on a scratch Tape, when backward() gets to them. So at most the kept segments plus one
+// recomputed segment are alive at any time. Whether a segment fits is predicted from the size of
+// the last segment graph built (segments usually have the same size), so that a segment that would
+// not fit is not built in the first place. The prediction is not a guarantee: the first segment
+// and any segment bigger than predicted are built in full before they are found not to fit, so the
+// graphs alive (and peak_bytes()) exceed the budget by that segment once. Such a segment is then
+// recomputed, and its size becomes the prediction for the next one.
+//
+//     Checkpoint<float> checkpoint(1 << 20);  // keep up to 1 MiB of segment graphs
+//     std::vector<Value<float>> state = initial;
+//     for (int block = 0; block < blocks; ++block) {
+//         state = checkpoint.segment([&](const std::vector<Value<float>>& in) {
+//             return model.steps(in, 16);
+//         }, state);
+//     }
+//     auto loss = model.loss(state);
+//     checkpoint.backward(loss);  // instead of loss.backward()
+//
+// The inputs of a segment must be leaves: parameters, data, or outputs of earlier segments. A
+// segment may read other leaves directly (e.g. parameters captured by the function), but not inner
+// nodes of a graph. The function must compute the same outputs when it is run again, so the leaves
+// it uses must not change before backward(). Do not record segments while a Tape is active: kept
+// graphs would live on it.
+template<typename T>
+class Checkpoint
+{
+    using Node = typename Value<T>::Node;
+
+public:
+    using Function = std::function<std::vector<Value<T>>(const std::vector<Value<T>>&)>;
+
+    static constexpr std::size_t node_size = sizeof(Node);
+
+    explicit Checkpoint(std::size_t budget=0);  // in bytes of kept graphs; 0 recomputes every segment
+    Checkpoint(const Checkpoint&) = delete;
+    Checkpoint& operator=(const Checkpoint&) = delete;
+
+    // Runs function(inputs) as the next segment and returns its outputs as new leaves
+    std::vector<Value<T>> segment(Function function, std::vector<Value<T>> inputs);
+
+    // Backpropagates from loss through the rest of the graph and then through the segments, last to
+    // first, accumulating into the leaves' gradients like Value::backward(). Releases the segments,
+    // also if a segment function throws (then some gradients have been accumulated, and others not).
+    void backward(Value<T> loss);
+
+    std::size_t segments() const;  // recorded since the last backward()
+    std::size_t kept_bytes() const;  // size of the kept segment graphs
+    // Largest size of the segment graphs alive at the same time, since the first segment after the
+    // last backward() (not counting boundary leaves and the graph outside of the segments)
+    std::size_t peak_bytes() const;
+
+private:
+    struct Segment {
+        Function function;
+        std::vector<Value<T>> inputs;
+        std::vector<Value<T>> outputs;  // the boundary leaves
+        std::vector<Value<T>> results;  // outputs of the kept graph, empty if recomputed
+        std::size_t nodes{0};  // of the kept graph
+    };
+
+    // Sorts the graph of results into topo and returns the number of op nodes in it
+    static std::size_t sort(const std::vector<Value<T>>& results, std::vector<Node*>& topo);
+    void track(std::size_t nodes);
+
+    std::size_t budget_;  // in nodes
+    std::vector<Segment> segments_{};
+    std::size_t kept_{0};  // nodes of the kept graphs
+    std::size_t peak_{0};  // nodes
+    std::size_t expected_{0};  // nodes of the last segment graph built, the prediction for the next one
+};
+
+
+template<typename T>
+Checkpoint<T>::Checkpoint(std::size_t budget) : budget_{budget / node_size} {}
+
+template<typename T>
+std::vector<Value<T>> Checkpoint<T>::segment(Function function, std::vector<Value<T>> inputs) {
+    for (auto& input : inputs) {
+        if (input.node_->op != Op::none) throw std::invalid_argument("checkpoint segment inputs must be leaves");
+    }
+    if (segments_.empty()) peak_ = 0;
+
+    Segment segment{std::move(function), std::move(inputs), {}, {}, 0};
+    std::vector<Value<T>> results;
+    if (kept_ < budget_ && kept_ + expected_ <= budget_) {
+        results = segment.function(segment.inputs);
+        thread_local std::vector<Node*> topo{};
+        auto nodes = sort(results, topo);
+        track(kept_ + nodes);
+        expected_ = nodes;
+        if (kept_ + nodes <= budget_) {
+            segment.results = results;
+            segment.nodes = nodes;
+            kept_ += nodes;
+        }
+    }
+    else {
+        NoGradGuard no_grad;
+        results = segment.function(segment.inputs);
+    }
+
+    segment.outputs.reserve(results.size());
+    for (auto& result : results) segment.outputs.emplace_back(result.get_data());
+    segments_.push_back(std::move(segment));
+    return segments_.back().outputs;
+}
+
+template<typename T>
+void Checkpoint<T>::backward(Value<T> loss) {
+    for (auto& segment : segments_) {
+        for (auto& output : segment.outputs) output.set_grad(0);
+    }
+    // Releases the segments on every exit, also when a segment function throws
+    struct Release {
+        Checkpoint& self;
+        bool finished{false};
+        ~Release() {
+            self.segments_.clear();
+            self.kept_ = 0;
+            if (!finished) self.expected_ = 0;
+        }
+    } release{*this};
+    loss.backward();
+
+    std::vector<Node*> topo;
+    for (auto segment = segments_.rbegin(); segment != segments_.rend(); ++segment) {
+        // Keeps a recomputed graph on the scratch tape until this segment is done (recomputed goes
+        // first, before the tape, also when this throws)
+        std::optional<Tape<T>> tape;
+        std::vector<Value<T>> recomputed;
+        if (segment->results.empty() && !segment->outputs.empty()) {
+            tape.emplace();
+            recomputed = segment->function(segment->inputs);
+            if (recomputed.size() != segment->outputs.size()) {
+                throw std::logic_error("checkpoint segment returned a different number of outputs");
+            }
+        }
+        auto& results = tape ? recomputed : segment->results;
+        auto nodes = sort(results, topo);
+        if (tape) {
+            track(kept_ + nodes);
+            expected_ = nodes;
+        }
+
+        // Like Value::backward(), but seeded with the boundary leaves' gradients
+        for (auto node : topo) {
+            if (node->op != Op::none) node->grad = 0;
+        }
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            if (results[i].requires_grad()) results[i].node_->grad += segment->outputs[i].get_grad();
+        }
+        for (auto node = topo.rbegin(); node != topo.rend(); ++node) {
+            (*node)->backward();
+        }
+
+        results.clear();
+        kept_ -= segment->nodes;
+    }
+    release.finished = true;
+}
+
+template<typename T>
+std::size_t Checkpoint<T>::sort(const std::vector<Value<T>>& results, std::vector<Node*>& topo) {
+    thread_local std::vector<Node*> roots{};
+    roots.clear();
+    for (auto& result : results) roots.push_back(result.node_.get());
+    Value<T>::topological_order(roots, topo);
+    std::size_t nodes = 0;
+    for (auto node : topo) nodes += node->op != Op::none;
+    return nodes;
+}
+
+template<typename T>
+void Checkpoint<T>::track(std::size_t nodes) {
+    peak_ = std::max(peak_, nodes);
+}
+
+template<typename T>
+std::size_t Checkpoint<T>::segments() const {
+    return segments_.size();
+}
+
+template<typename T>
+std::size_t Checkpoint<T>::kept_bytes() const {
+    return kept_ * node_size;
+}
+
+template<typename T>
+std::size_t Checkpoint<T>::peak_bytes() const {
+    return peak_ * node_size;
+}
+
+} // namespace ajs
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>        // std::min
+#include <cstddef>          // std::size_t
+#include <limits>
+#include <memory>           // smart pointers
+#include <stdexcept>        // std::invalid_argument
+#include <type_traits>
+#include <unordered_map>
+#include <utility>          // std::move, std::exchange
+#include <vector>
+
+#include "tape.h"
+#include "thread_pool.h"
+
+namespace ajs {
+
+template<typename T>
+class Value;
+
+// Data-parallel training over the threads of a ThreadPool. The batch is split into one shard per
+// thread, and each shard builds its own graph (on its own Tape) and backpropagates it on its
+// thread. The parameters are shared between the graphs, but their gradients must not be: while a
+// shard's graph is built, every operation that uses a registered parameter gets the shard's own
+// copy of it (a leaf with the same data) as its operand instead. After all shards are done, the
+// copies' gradients are summed into the parameters' gradients (in parallel, over chunks of
+// parameters, and always in shard order, so the result does not depend on the scheduling).
+//
+//     DataParallel<float> trainer(model.parameters(), pool);
+//     for (...) {
+//         auto loss = trainer.step(batch_size, [&](std::size_t begin, std::size_t end) {
+//             Value<float> loss = 0.0f;
+//             for (auto i = begin; i < end; ++i) loss = loss + model.loss(x[i], y[i]);
+//             return loss;
+//         });
+//         ...  // update the parameters from their gradients
+//     }
+//
+// The graphs of different shards must not share any nodes except for the registered parameters.
+// A parameter can be registered with several trainers at once (e.g. a shared embedding).
+template<typename T>
+class DataParallel
+{
+    using Node = typename Value<T>::Node;
+
+public:
+    DataParallel(std::vector<Value<T>> parameters, ThreadPool& pool);
+    DataParallel(const DataParallel&) = delete;
+    DataParallel& operator=(const DataParallel&) = delete;
+    ~DataParallel();
+
+    // Calls loss(begin, end) for a shard [begin, end) of [0, size) on each thread, backpropagates
+    // the returned Values and accumulates the gradients into the parameters (like backward() does).
+    // Returns the sum of the losses.
+    template<typename F>
+    T step(std::size_t size, F&& loss);
+
+    std::size_t shards() const;
+
+private:
+    struct Shard {
+        const DataParallel* owner;
+        std::vector<Node> replicas;  // in the order of parameters_
+        T loss{0};
+    };
+
+    template<typename F>
+    struct Job {
+        DataParallel* self;
+        F* loss;
+        std::size_t size;
+        std::size_t shards;
+    };
+
+    // Makes a shard active on this thread for its lifetime, so that a throwing loss function does
+    // not leave the thread building graphs on the shard's replicas
+    struct ActiveShard {
+        explicit ActiveShard(Shard* shard) : previous{std::exchange(active_, shard)} {}
+        ActiveShard(const ActiveShard&) = delete;
+        ActiveShard& operator=(const ActiveShard&) = delete;
+        ~ActiveShard() { active_ = previous; }
+        Shard* previous;
+    };
+
+    template<typename F>
+    static void run_shard(void* context, std::size_t index);
+    static void reduce_chunk(void* context, std::size_t chunk);
+    static constexpr std::size_t reduce_chunk_size = 1024;  // parameters per reduction task
+
+    friend class Value<T>;
+    static std::shared_ptr<Node> replica(std::shared_ptr<Node> parameter);
+
+    ThreadPool& pool_;
+    std::vector<std::shared_ptr<Node>> parameters_;
+    std::unordered_map<const Node*, std::size_t> position_;  // of each parameter in parameters_
+    std::vector<Shard> shards_;
+    std::size_t active_shards_{0};
+
+    static thread_local Shard* active_;  // shard whose graph is being built on this thread
+};
+
+
+template<typename T>
+thread_local typename DataParallel<T>::Shard* DataParallel<T>::active_{nullptr};
+
+template<typename T>
+DataParallel<T>::DataParallel(std::vector<Value<T>> parameters, ThreadPool& pool): pool_{pool} {
+    for (auto& p : parameters) {
+        auto node = p.node_;
+        if (node->op != Op::none) {
+            throw std::invalid_argument("DataParallel parameters must be leaf Values");
+        }
+        if (node->data_parallel == std::numeric_limits<decltype(node->data_parallel)>::max()) {
+            throw std::invalid_argument("too many DataParallel trainers share a parameter");
+        }
+        if (position_.emplace(node.get(), parameters_.size()).second) parameters_.push_back(std::move(node));
+    }
+    for (auto& p : parameters_) ++p->data_parallel;  // only now that nothing throws any more
+    shards_.resize(pool_.size());
+    for (auto& shard : shards_) {
+        shard.owner = this;
+        shard.replicas.reserve(parameters_.size());
+        for (auto& p : parameters_) shard.replicas.emplace_back(p->data);
+    }
+}
+
+template<typename T>
+DataParallel<T>::~DataParallel() {
+    for (auto& p : parameters_) --p->data_parallel;  // other trainers may still use it
+}
+
+template<typename T>
+std::size_t DataParallel<T>::shards() const {
+    return shards_.size();
+}
+
+template<typename T>
+std::shared_ptr<typename DataParallel<T>::Node> DataParallel<T>::replica(std::shared_ptr<Node> parameter) {
+    if (!active_) return parameter;  // not inside a shard (e.g. evaluating the model on the main thread)
+    const auto& position = active_->owner->position_;
+    auto found = position.find(parameter.get());
+    if (found == position.end()) return parameter;  // registered with another trainer
+    // Non-owning like the Tape's pointers; the replicas live as long as the DataParallel
+    return std::shared_ptr<Node>(std::shared_ptr<Node>{}, &active_->replicas[found->second]);
+}
+
+template<typename T>
+template<typename F>
+void DataParallel<T>::run_shard(void* context, std::size_t index) {
+    auto& job = *static_cast<Job<F>*>(context);
+    auto& shard = job.self->shards_[index];
+    auto& parameters = job.self->parameters_;
+    for (std::size_t i = 0; i < parameters.size(); ++i) {
+        shard.replicas[i].data = parameters[i]->data;
+        shard.replicas[i].grad = 0;
+    }
+    auto begin = job.size * index / job.shards;
+    auto end = job.size * (index + 1) / job.shards;
+    Tape<T> tape;
+    Value<T> loss = [&] {
+        ActiveShard active(&shard);
+        return (*job.loss)(begin, end);
+    }();
+    loss.backward();
+    shard.loss = loss.get_data();
+}
+
+template<typename T>
+void DataParallel<T>::reduce_chunk(void* context, std::size_t chunk) {
+    auto& self = *static_cast<DataParallel*>(context);
+    auto end = std::min(self.parameters_.size(), (chunk + 1) * reduce_chunk_size);
+    for (auto i = chunk * reduce_chunk_size; i < end; ++i) {
+        if (!self.parameters_[i]->requires_grad) continue;  // frozen
+        T grad = self.parameters_[i]->grad;
+        for (std::size_t s = 0; s < self.active_shards_; ++s) grad += self.shards_[s].replicas[i].grad;
+        self.parameters_[i]->grad = grad;
+    }
+}
+
+template<typename T>
+template<typename F>
+T DataParallel<T>::step(std::size_t size, F&& loss) {
+    using Function = std::remove_reference_t<F>;
+    Job<Function> job{this, &loss, size, std::max<std::size_t>(1, std::min(size, shards_.size()))};
+    active_shards_ = job.shards;
+    pool_.run([&] {
+        for (std::size_t s = 1; s < job.shards; ++s) pool_.spawn({&run_shard<Function>, &job, s});
+        run_shard<Function>(&job, 0);
+    });
+    auto chunks = (parameters_.size() + reduce_chunk_size - 1) / reduce_chunk_size;
+    pool_.run([&] {
+        for (std::size_t c = 1; c < chunks; ++c) pool_.spawn({&reduce_chunk, this, c});
+        if (chunks > 0) reduce_chunk(this, 0);
+    });
+    T total{0};
+    for (std::size_t s = 0; s < job.shards; ++s) total += shards_[s].loss;
+    return total;
+}
+
+} // namespace ajs
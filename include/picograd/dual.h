@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>        // std::min
+#include <array>
+#include <cstddef>          // std::size_t
+#include <ostream>
+#include <stdexcept>        // std::invalid_argument
+#include <string>
+#include <vector>
+
+#include "autograd.h"
+#include "ops.h"
+#include "value.h"
+
+namespace ajs {
+
+// Forward-mode automatic differentiation with dual numbers. A Dual<T, N> carries a value and its
+// derivatives with respect to up to N inputs (its tangent lanes), and every operation updates all
+// lanes right away: out.tangent[i] = d(out)/da * a.tangent[i] + d(out)/db * b.tangent[i]. There is
+// no graph and nothing on the heap, the op of every operation is known at compile time (so the
+// kernels in ops.h inline into straight-line code), and the lanes are plain arrays that the
+// compiler vectorizes. Dual supports the same operations as Value, so code written for both (e.g.
+// templated on the number type) computes derivatives either way:
+//
+//     auto f = [](const auto& x, const auto& y) { return (x * y).tanh() + y / x; };
+//     auto out = f(Dual<double, 2>::variable(0.5, 0), Dual<double, 2>::variable(2.0, 1));
+//     out.get_tangent(0);  // df/dx
+//
+// This pays off for functions with few inputs and many outputs; for many inputs and few outputs
+// (e.g. a loss), the reverse mode of Value is cheaper. jacobian() below picks between them.
+template<typename T, std::size_t N>
+class Dual
+{
+public:
+    using value_type = T;
+    static constexpr std::size_t lanes = N;
+
+    Dual(T data=0) : data_{data} {}  // a constant: all tangents 0 (implicit, like Value(T))
+    Dual(T data, const std::array<T, N>& tangent) : data_{data}, tangent_{tangent} {}
+    static Dual variable(T data, std::size_t lane);  // the input for tangent lane `lane`
+
+    Dual operator+(const Dual& other) const { return binary<Op::add>(*this, other); }
+    Dual operator-(const Dual& other) const { return binary<Op::sub>(*this, other); }
+    Dual operator*(const Dual& other) const { return binary<Op::mult>(*this, other); }
+    Dual operator/(const Dual& other) const { return binary<Op::div>(*this, other); }
+    Dual operator-() const { return unary<Op::neg>(*this); }
+    // Scalar operands, like Value's
+    Dual operator+(T other) const { return unary<Op::add>(*this, other); }
+    Dual operator-(T other) const { return unary<Op::sub>(*this, other); }
+    Dual operator*(T other) const { return unary<Op::mult>(*this, other); }
+    Dual operator/(T other) const { return unary<Op::div>(*this, other); }
+    friend Dual operator+(T a, const Dual& b) { return unary<Op::add>(b, a); }
+    friend Dual operator-(T a, const Dual& b) { return unary<Op::rsub>(b, a); }
+    friend Dual operator*(T a, const Dual& b) { return unary<Op::mult>(b, a); }
+    friend Dual operator/(T a, const Dual& b) { return unary<Op::rdiv>(b, a); }
+    Dual& operator+=(const Dual& other) { return *this = *this + other; }
+    Dual& operator-=(const Dual& other) { return *this = *this - other; }
+    Dual& operator*=(const Dual& other) { return *this = *this * other; }
+    Dual& operator/=(const Dual& other) { return *this = *this / other; }
+
+    Dual pow(int exponent) const { return unary<Op::pow>(*this, T(exponent)); }
+    Dual pow(float exponent) const { return unary<Op::pow>(*this, T(exponent)); }
+    Dual square() const { return unary<Op::square>(*this); }
+    Dual exp() const { return unary<Op::exp>(*this); }
+    Dual log() const { return unary<Op::log>(*this); }
+    Dual tanh() const { return unary<Op::tanh>(*this); }
+    Dual relu() const { return unary<Op::relu>(*this); }
+    Dual sigmoid() const { return unary<Op::sigmoid>(*this); }
+
+    T get_data() const { return data_; }
+    T get_tangent(std::size_t lane) const { return tangent_[lane]; }
+    const std::array<T, N>& tangent() const { return tangent_; }
+
+private:
+    template<Op op>
+    static Dual binary(const Dual& a, const Dual& b);
+    template<Op op>
+    static Dual unary(const Dual& a, T param=0);  // param: see Value::Node::param
+
+    T data_;
+    std::array<T, N> tangent_{};
+};
+
+template<typename T, std::size_t N>
+std::ostream& operator<<(std::ostream& os, const Dual<T, N>& d) {
+    os << "Dual(" << d.get_data() << ", tangent=[";
+    for (std::size_t i = 0; i < N; ++i) os << (i ? ", " : "") << d.get_tangent(i);
+    return os << "])";
+}
+
+// Jacobian of a function from n to m numbers, as m rows of n derivatives. The function must be
+// generic over the number type (e.g. a lambda taking `const auto& x` and returning a std::vector
+// of the same type as x's elements), so that it can be run on Duals and on Values:
+//
+// - forward mode runs it on Dual<T, N>, once for every N inputs
+// - reverse mode runs it once on Values, and backpropagates once from every output
+//
+// Mode::automatic first runs forward mode on the first N inputs; that is all it takes if n <= N,
+// which also tells the number of outputs. Otherwise it goes on in forward mode if n <= m, and
+// switches to reverse mode if there are fewer outputs than inputs.
+enum class JacobianMode { automatic, forward, reverse };
+
+template<std::size_t N=8, typename T, typename F>
+std::vector<std::vector<T>> jacobian(F&& f, const std::vector<T>& x, JacobianMode mode=JacobianMode::automatic);
+
+
+template<typename T, std::size_t N>
+Dual<T, N> Dual<T, N>::variable(T data, std::size_t lane) {
+    if (lane >= N) {
+        throw std::invalid_argument("tangent lane " + std::to_string(lane) + " of a Dual with " + std::to_string(N) + " lanes");
+    }
+    Dual out{data};
+    out.tangent_[lane] = 1;
+    return out;
+}
+
+template<typename T, std::size_t N>
+template<Op op>
+Dual<T, N> Dual<T, N>::binary(const Dual& a, const Dual& b) {
+    Dual out{kernels::forward(op, a.data_, b.data_)};
+    T a_derivative{0};
+    T b_derivative{0};
+    kernels::backward(op, out.data_, T(1), a.data_, b.data_, a_derivative, b_derivative);
+    for (std::size_t i = 0; i < N; ++i) {
+        out.tangent_[i] = a_derivative * a.tangent_[i] + b_derivative * b.tangent_[i];
+    }
+    return out;
+}
+
+template<typename T, std::size_t N>
+template<Op op>
+Dual<T, N> Dual<T, N>::unary(const Dual& a, T param) {
+    Dual out{kernels::forward(op, a.data_, param)};
+    T a_derivative{0};
+    T unused{0};
+    kernels::backward(op, out.data_, T(1), a.data_, param, a_derivative, unused);
+    for (std::size_t i = 0; i < N; ++i) out.tangent_[i] = a_derivative * a.tangent_[i];
+    return out;
+}
+
+namespace detail {
+
+// Columns [begin, begin + N) of the Jacobian, by one forward-mode run
+template<std::size_t N, typename T, typename F>
+void jacobian_columns(F& f, const std::vector<T>& x, std::size_t begin, std::vector<std::vector<T>>& out) {
+    std::vector<Dual<T, N>> inputs;
+    inputs.reserve(x.size());
+    for (std::size_t j = 0; j < x.size(); ++j) {
+        inputs.push_back(j >= begin && j < begin + N ? Dual<T, N>::variable(x[j], j - begin) : Dual<T, N>(x[j]));
+    }
+    auto outputs = f(inputs);
+    out.resize(outputs.size(), std::vector<T>(x.size(), T(0)));
+    for (std::size_t i = 0; i < outputs.size(); ++i) {
+        for (std::size_t j = begin; j < std::min(begin + N, x.size()); ++j) out[i][j] = outputs[i].get_tangent(j - begin);
+    }
+}
+
+} // namespace detail
+
+template<std::size_t N, typename T, typename F>
+std::vector<std::vector<T>> jacobian(F&& f, const std::vector<T>& x, JacobianMode mode) {
+    std::vector<std::vector<T>> out;
+    if (mode != JacobianMode::reverse) {
+        detail::jacobian_columns<N>(f, x, 0, out);
+        if (x.size() <= N) return out;
+        if (mode == JacobianMode::forward || x.size() <= out.size()) {
+            for (std::size_t begin = N; begin < x.size(); begin += N) detail::jacobian_columns<N>(f, x, begin, out);
+            return out;
+        }
+    }
+
+    std::vector<Value<T>> inputs(x.begin(), x.end());
+    auto outputs = f(inputs);
+    out.assign(outputs.size(), {});
+    for (std::size_t i = 0; i < outputs.size(); ++i) {
+        for (auto& g : grad(outputs[i], inputs)) out[i].push_back(g.get_data());
+    }
+    return out;
+}
+
+} // namespace ajs
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <cstddef>          // std::size_t
+#include <type_traits>
+
+#include "value.h"
+
+namespace ajs::expr {
+
+// Lazy scalar expressions, fused into as few nodes as possible.
+//
+// Arithmetic on Values builds a node for every operation. Arithmetic on a Value wrapped in lazy()
+// builds an expression object instead, whose type spells out the whole expression tree, and which
+// is only evaluated when it is converted to a Value. At that point the expression is computed
+// together with its derivatives with respect to all Values it uses (in forward mode, with the ops
+// known at compile time, so the kernels inline into straight-line code), and recorded as linear
+// nodes (see Value::linear()): an expression over n distinct Values takes max(1, n - 1) nodes,
+// however many operations it has.
+//
+//     Value<float> loss = (lazy(prediction) - target).pow(2);  // one node instead of two
+//     Value<float> out = (lazy(w1) * x1 + lazy(w2) * x2 + b).tanh();  // four nodes instead of five
+//
+// Operations between two plain Values still build their node right away, so every term needs a
+// lazy operand (lazy(a) * b + lazy(c) * d, not lazy(a) * b + c * d).
+//
+// Expressions refer to their Value operands (copying Values would cost reference counting), so
+// like any expression template they must not outlive them: convert them within the statement, or
+// keep them in auto variables only while the Values they use are alive. They read the Values'
+// data when they are converted. Linear nodes only know
+// their derivatives, not how they were computed: graphs using them cannot be re-run by
+// Value::Order::forward() or compiled into a Program.
+template<typename D>
+struct Expression;
+
+template<typename X>
+concept expression = std::derived_from<X, Expression<X>>;
+
+// What can be combined with an expression over T: other expressions over T, Values and numbers
+template<typename X, typename T>
+concept operand = (expression<X> && std::same_as<typename X::value_type, T>)
+                  || std::same_as<X, Value<T>> || std::is_arithmetic_v<X>;
+
+template<typename T>
+struct Leaf;
+template<typename T>
+struct Constant;
+template<Op op, typename A, typename B>
+struct Binary;
+template<Op op, typename A>
+struct Unary;
+
+template<typename D>
+struct Expression
+{
+    // Evaluates the expression and turns it into linear nodes (also done by converting to a Value)
+    template<typename T=D>
+    Value<typename T::value_type> materialize() const;
+
+    template<typename T> requires std::same_as<T, typename D::value_type>
+    operator Value<T>() const { return materialize(); }
+
+    template<typename T=D>
+    auto pow(typename T::value_type exponent) const { return Unary<Op::pow, D>{derived(), exponent}; }
+    auto square() const { return Unary<Op::square, D>{derived()}; }
+    auto exp() const { return Unary<Op::exp, D>{derived()}; }
+    auto log() const { return Unary<Op::log, D>{derived()}; }
+    auto tanh() const { return Unary<Op::tanh, D>{derived()}; }
+    auto relu() const { return Unary<Op::relu, D>{derived()}; }
+    auto sigmoid() const { return Unary<Op::sigmoid, D>{derived()}; }
+    auto operator-() const { return Unary<Op::neg, D>{derived()}; }
+
+    const D& derived() const { return static_cast<const D&>(*this); }
+};
+
+// The expression types. `leaves` is the number of Value operands (counting repeated ones), and
+// evaluate<Offset>() returns the expression's value and sets derivatives[Offset + i] to its
+// derivative with respect to its i-th Value operand (whose address goes to operands[Offset + i]).
+template<typename T>
+struct Leaf : Expression<Leaf<T>>
+{
+    using value_type = T;
+    static constexpr std::size_t leaves = 1;
+
+    explicit Leaf(const Value<T>& v) : value{&v} {}
+
+    template<std::size_t Offset, std::size_t N>
+    T evaluate(std::array<T, N>& derivatives, std::array<const Value<T>*, N>& operands) const {
+        derivatives[Offset] = 1;
+        operands[Offset] = value;
+        return value->get_data();
+    }
+
+    const Value<T>* value;
+};
+
+template<typename T>
+struct Constant : Expression<Constant<T>>
+{
+    using value_type = T;
+    static constexpr std::size_t leaves = 0;
+
+    explicit Constant(T v) : value{v} {}
+
+    template<std::size_t Offset, std::size_t N>
+    T evaluate(std::array<T, N>&, std::array<const Value<T>*, N>&) const {
+        return value;
+    }
+
+    T value;
+};
+
+template<Op op, typename A, typename B>
+struct Binary : Expression<Binary<op, A, B>>
+{
+    using value_type = typename A::value_type;
+    static constexpr std::size_t leaves = A::leaves + B::leaves;
+
+    Binary(const A& a, const B& b) : a{a}, b{b} {}
+
+    template<std::size_t Offset, std::size_t N>
+    value_type evaluate(std::array<value_type, N>& derivatives,
+                        std::array<const Value<value_type>*, N>& operands) const {
+        auto a_value = a.template evaluate<Offset>(derivatives, operands);
+        auto b_value = b.template evaluate<Offset + A::leaves>(derivatives, operands);
+        auto out = kernels::forward(op, a_value, b_value);
+        value_type a_derivative{0};
+        value_type b_derivative{0};
+        kernels::backward(op, out, value_type(1), a_value, b_value, a_derivative, b_derivative);
+        for (auto i = Offset; i < Offset + A::leaves; ++i) derivatives[i] *= a_derivative;
+        for (auto i = Offset + A::leaves; i < Offset + leaves; ++i) derivatives[i] *= b_derivative;
+        return out;
+    }
+
+    A a;
+    B b;
+};
+
+template<Op op, typename A>
+struct Unary : Expression<Unary<op, A>>
+{
+    using value_type = typename A::value_type;
+    static constexpr std::size_t leaves = A::leaves;
+
+    explicit Unary(const A& a, value_type param=0) : a{a}, param{param} {}
+
+    template<std::size_t Offset, std::size_t N>
+    value_type evaluate(std::array<value_type, N>& derivatives,
+                        std::array<const Value<value_type>*, N>& operands) const {
+        auto a_value = a.template evaluate<Offset>(derivatives, operands);
+        auto out = kernels::forward(op, a_value, param);
+        value_type a_derivative{0};
+        value_type unused{0};
+        kernels::backward(op, out, value_type(1), a_value, param, a_derivative, unused);
+        for (auto i = Offset; i < Offset + leaves; ++i) derivatives[i] *= a_derivative;
+        return out;
+    }
+
+    A a;
+    value_type param;  // see Value::Node::param
+};
+
+template<typename T>
+Leaf<T> lazy(const Value<T>& value) {
+    return Leaf<T>{value};
+}
+
+template<typename D>
+template<typename T>
+Value<typename T::value_type> Expression<D>::materialize() const {
+    using V = typename T::value_type;
+    if constexpr (std::same_as<D, Leaf<V>>) {
+        return *derived().value;
+    }
+    else {
+        std::array<V, D::leaves> derivatives{};
+        std::array<const Value<V>*, D::leaves> operands{};
+        V data = derived().template evaluate<0>(derivatives, operands);
+        return Value<V>::linear(data, operands, derivatives);
+    }
+}
+
+namespace detail {
+
+template<typename T, typename X>
+auto wrap(const X& x) {
+    if constexpr (expression<X>) return x;
+    else if constexpr (std::same_as<X, Value<T>>) return Leaf<T>{x};
+    else return Constant<T>{T(x)};
+}
+
+template<Op op, typename T, typename A, typename B>
+auto binary(const A& a, const B& b) {
+    auto wrapped_a = wrap<T>(a);
+    auto wrapped_b = wrap<T>(b);
+    return Binary<op, decltype(wrapped_a), decltype(wrapped_b)>{wrapped_a, wrapped_b};
+}
+
+} // namespace detail
+
+// Binary operators: an expression on the left, or a Value or number on the left and an expression
+// on the right
+template<expression A, operand<typename A::value_type> B>
+auto operator+(const A& a, const B& b) { return detail::binary<Op::add, typename A::value_type>(a, b); }
+template<expression B, operand<typename B::value_type> A> requires (!expression<A>)
+auto operator+(const A& a, const B& b) { return detail::binary<Op::add, typename B::value_type>(a, b); }
+
+template<expression A, operand<typename A::value_type> B>
+auto operator-(const A& a, const B& b) { return detail::binary<Op::sub, typename A::value_type>(a, b); }
+template<expression B, operand<typename B::value_type> A> requires (!expression<A>)
+auto operator-(const A& a, const B& b) { return detail::binary<Op::sub, typename B::value_type>(a, b); }
+
+template<expression A, operand<typename A::value_type> B>
+auto operator*(const A& a, const B& b) { return detail::binary<Op::mult, typename A::value_type>(a, b); }
+template<expression B, operand<typename B::value_type> A> requires (!expression<A>)
+auto operator*(const A& a, const B& b) { return detail::binary<Op::mult, typename B::value_type>(a, b); }
+
+template<expression A, operand<typename A::value_type> B>
+auto operator/(const A& a, const B& b) { return detail::binary<Op::div, typename A::value_type>(a, b); }
+template<expression B, operand<typename B::value_type> A> requires (!expression<A>)
+auto operator/(const A& a, const B& b) { return detail::binary<Op::div, typename B::value_type>(a, b); }
+
+} // namespace ajs::expr
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>        // std::max
+#include <cmath>            // std::exp, std::log
+#include <cstddef>          // std::size_t
+#include <stdexcept>        // std::invalid_argument
+#include <vector>
+
+#include "value.h"
+
+namespace ajs::functional {
+
+// Losses and normalizations over vectors of Values. The reductions (mse, logsumexp and
+// cross_entropy) are computed directly, with their derivatives, and recorded as linear nodes (see
+// Value::linear()): a reduction over n Values takes n - 1 nodes, instead of several per element
+// when it is built from elementary operations. Like all linear nodes, they cannot be recomputed by
+// Value::Order::forward() or compiled into a Program.
+
+// Mean over i of (prediction[i] - target[i])^2
+template<typename T>
+Value<T> mse(const std::vector<Value<T>>& prediction, const std::vector<Value<T>>& target);
+
+// log(sum over i of exp(x[i])), computed relative to the largest x[i] so that it does not overflow
+template<typename T>
+Value<T> logsumexp(const std::vector<Value<T>>& x);
+
+template<typename T>
+std::vector<Value<T>> softmax(const std::vector<Value<T>>& x);
+
+template<typename T>
+std::vector<Value<T>> log_softmax(const std::vector<Value<T>>& x);
+
+// -log(softmax(logits)[target]), the loss of a classifier for an example of class `target`
+template<typename T>
+Value<T> cross_entropy(const std::vector<Value<T>>& logits, std::size_t target);
+
+
+namespace detail {
+
+// Operands and derivatives for Value::linear(), reused so that we only allocate when inputs grow
+template<typename T>
+struct Linear {
+    std::vector<const Value<T>*> operands;
+    std::vector<T> derivatives;
+
+    static Linear& scratch(std::size_t size) {
+        thread_local Linear linear;
+        linear.operands.resize(size);
+        linear.derivatives.resize(size);
+        return linear;
+    }
+};
+
+// Sets exps[i] = exp(x[i] - max) / sum, i.e. the softmax, and returns the log-sum-exp
+template<typename T>
+T softmax(const std::vector<Value<T>>& x, std::vector<T>& exps) {
+    if (x.empty()) throw std::invalid_argument("softmax of an empty vector");
+    T max = x[0].get_data();
+    for (auto& v : x) max = std::max(max, v.get_data());
+    T sum{0};
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        exps[i] = std::exp(x[i].get_data() - max);
+        sum += exps[i];
+    }
+    for (std::size_t i = 0; i < x.size(); ++i) exps[i] /= sum;
+    return max + std::log(sum);
+}
+
+} // namespace detail
+
+template<typename T>
+Value<T> mse(const std::vector<Value<T>>& prediction, const std::vector<Value<T>>& target) {
+    auto n = prediction.size();
+    if (n == 0 || target.size() != n) {
+        throw std::invalid_argument("mse needs two non-empty vectors of the same size");
+    }
+    auto& linear = detail::Linear<T>::scratch(2 * n);
+    T sum{0};
+    for (std::size_t i = 0; i < n; ++i) {
+        T diff = prediction[i].get_data() - target[i].get_data();
+        sum += diff * diff;
+        linear.operands[2 * i] = &prediction[i];
+        linear.operands[2 * i + 1] = &target[i];
+        linear.derivatives[2 * i] = 2 * diff / T(n);
+        linear.derivatives[2 * i + 1] = -2 * diff / T(n);
+    }
+    return Value<T>::linear(sum / T(n), linear.operands, linear.derivatives);
+}
+
+template<typename T>
+Value<T> logsumexp(const std::vector<Value<T>>& x) {
+    auto& linear = detail::Linear<T>::scratch(x.size());
+    T lse = detail::softmax(x, linear.derivatives);  // the derivatives of log-sum-exp
+    for (std::size_t i = 0; i < x.size(); ++i) linear.operands[i] = &x[i];
+    return Value<T>::linear(lse, linear.operands, linear.derivatives);
+}
+
+template<typename T>
+std::vector<Value<T>> softmax(const std::vector<Value<T>>& x) {
+    auto lse = logsumexp(x);
+    std::vector<Value<T>> out;
+    out.reserve(x.size());
+    for (auto& v : x) out.push_back((v - lse).exp());
+    return out;
+}
+
+template<typename T>
+std::vector<Value<T>> log_softmax(const std::vector<Value<T>>& x) {
+    auto lse = logsumexp(x);
+    std::vector<Value<T>> out;
+    out.reserve(x.size());
+    for (auto& v : x) out.push_back(v - lse);
+    return out;
+}
+
+template<typename T>
+Value<T> cross_entropy(const std::vector<Value<T>>& logits, std::size_t target) {
+    if (target >= logits.size()) throw std::invalid_argument("cross_entropy target out of range");
+    auto& linear = detail::Linear<T>::scratch(logits.size());
+    T lse = detail::softmax(logits, linear.derivatives);
+    linear.derivatives[target] -= 1;
+    for (std::size_t i = 0; i < logits.size(); ++i) linear.operands[i] = &logits[i];
+    return Value<T>::linear(lse - logits[target].get_data(), linear.operands, linear.derivatives);
+}
+
+} // namespace ajs::functional
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>        // std::min
+#include <cstddef>          // std::size_t
+#include <cstring>          // std::memcpy
+#include <vector>
+
+#include "simd.h"           // vector types and instruction set selection
+
+// Row-major matrix products that accumulate into C (m x n), with A and/or B read transposed:
+//   nn: C += A * B,   A stored as (m x k), B as (k x n)
+//   nt: C += A * B^T, A stored as (m x k), B as (n x k)
+//   tn: C += A^T * B, A stored as (k x m), B as (k x n)
+// These are the forward product of a dense layer and the two products of its backward pass.
+//
+// The vector implementation follows the usual BLIS/GotoBLAS structure: panels of B (kc x nc) and
+// blocks of A (mc x kc) are copied ("packed") into contiguous buffers sized for the L3 and L2
+// cache, in the order the micro-kernel reads them, which also takes care of the transposes. The
+// micro-kernel keeps an mr x nr tile of C in vector registers while it runs over the kc common
+// dimension. It uses the instruction set selected in simd.h; the scalar path is a plain loop nest.
+namespace ajs {
+namespace gemm {
+
+namespace detail {
+
+// C += op(A) * op(B), where element (i, p) of op(A) is A[i * a_row + p * a_col], and likewise for B
+template<typename T>
+struct Operands {
+    std::size_t m, n, k;
+    const T* A;
+    std::size_t a_row, a_col;
+    const T* B;
+    std::size_t b_row, b_col;
+    T* C;
+};
+
+template<typename T>
+void reference(const Operands<T>& o) {
+    for (std::size_t i = 0; i < o.m; ++i) {
+        for (std::size_t p = 0; p < o.k; ++p) {
+            T a = o.A[i * o.a_row + p * o.a_col];
+            for (std::size_t j = 0; j < o.n; ++j) {
+                o.C[i * o.n + j] += a * o.B[p * o.b_row + j * o.b_col];
+            }
+        }
+    }
+}
+
+#if defined(PICOGRAD_SIMD_X86) || defined(PICOGRAD_SIMD_NEON)
+
+#define PICOGRAD_GEMM_INLINE [[gnu::always_inline]] inline
+
+// Cache blocking in elements (kc x nc panel of B in L3, mc x kc block of A in L2)
+constexpr std::size_t kc_block = 256;
+constexpr std::size_t mc_block = 96;
+constexpr std::size_t nc_block = 4096;
+
+// Copy rows [i0, i0 + mc) x columns [p0, p0 + kc) of op(A) into strips of mr rows, each stored
+// column by column (mr values per p), zero-padding the last strip
+template<std::size_t mr, typename T>
+PICOGRAD_GEMM_INLINE void pack_a(const Operands<T>& o, std::size_t i0, std::size_t mc, std::size_t p0, std::size_t kc, T* out) {
+    for (std::size_t ir = 0; ir < mc; ir += mr) {
+        auto rows = std::min(mr, mc - ir);
+        for (std::size_t p = 0; p < kc; ++p) {
+            const T* a = o.A + (i0 + ir) * o.a_row + (p0 + p) * o.a_col;
+            for (std::size_t i = 0; i < mr; ++i) *out++ = i < rows ? a[i * o.a_row] : T(0);
+        }
+    }
+}
+
+// Copy rows [p0, p0 + kc) x columns [j0, j0 + nc) of op(B) into strips of nr columns, each stored
+// row by row (nr values per p), zero-padding the last strip
+template<std::size_t nr, typename T>
+PICOGRAD_GEMM_INLINE void pack_b(const Operands<T>& o, std::size_t p0, std::size_t kc, std::size_t j0, std::size_t nc, T* out) {
+    for (std::size_t jr = 0; jr < nc; jr += nr) {
+        auto cols = std::min(nr, nc - jr);
+        for (std::size_t p = 0; p < kc; ++p) {
+            const T* b = o.B + (p0 + p) * o.b_row + (j0 + jr) * o.b_col;
+            if (o.b_col == 1 && cols == nr) {
+                std::memcpy(out, b, nr * sizeof(T));
+                out += nr;
+            }
+            else {
+                for (std::size_t j = 0; j < nr; ++j) *out++ = j < cols ? b[j * o.b_col] : T(0);
+            }
+        }
+    }
+}
+
+// C[0:rows, 0:cols] += a_strip * b_strip, with the mr x (2 vectors) tile of C held in registers
+template<typename V, std::size_t mr, typename T>
+PICOGRAD_GEMM_INLINE void micro_kernel(std::size_t kc, const T* a, const T* b, T* C, std::size_t ldc, std::size_t rows, std::size_t cols) {
+    constexpr std::size_t lanes = sizeof(V) / sizeof(T);
+    constexpr std::size_t nr = 2 * lanes;
+    V acc0[mr] = {};
+    V acc1[mr] = {};
+    for (std::size_t p = 0; p < kc; ++p) {
+        V b0, b1;
+        std::memcpy(&b0, b + p * nr, sizeof(V));
+        std::memcpy(&b1, b + p * nr + lanes, sizeof(V));
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < mr; ++i) {
+            V ai = V{} + a[p * mr + i];
+            acc0[i] += ai * b0;
+            acc1[i] += ai * b1;
+        }
+    }
+    if (rows == mr && cols == nr) {
+#pragma GCC unroll 16
+        for (std::size_t i = 0; i < mr; ++i) {
+            V c0, c1;
+            std::memcpy(&c0, C + i * ldc, sizeof(V));
+            std::memcpy(&c1, C + i * ldc + lanes, sizeof(V));
+            c0 += acc0[i];
+            c1 += acc1[i];
+            std::memcpy(C + i * ldc, &c0, sizeof(V));
+            std::memcpy(C + i * ldc + lanes, &c1, sizeof(V));
+        }
+    }
+    else {  // edge tile
+        T tile[mr][nr];
+        for (std::size_t i = 0; i < mr; ++i) {
+            std::memcpy(&tile[i][0], &acc0[i], sizeof(V));
+            std::memcpy(&tile[i][lanes], &acc1[i], sizeof(V));
+        }
+        for (std::size_t i = 0; i < rows; ++i) {
+            for (std::size_t j = 0; j < cols; ++j) C[i * ldc + j] += tile[i][j];
+        }
+    }
+}
+
+template<typename V, std::size_t mr, typename T>
+PICOGRAD_GEMM_INLINE void blocked(const Operands<T>& o) {
+    constexpr std::size_t nr = 2 * sizeof(V) / sizeof(T);
+    constexpr std::size_t mc_max = (mc_block + mr - 1) / mr * mr;
+    constexpr std::size_t nc_max = (nc_block + nr - 1) / nr * nr;
+    thread_local std::vector<T> packed_a;
+    thread_local std::vector<T> packed_b;
+    packed_a.resize(mc_max * kc_block);
+    packed_b.resize(kc_block * std::min(nc_max, (o.n + nr - 1) / nr * nr));
+
+    for (std::size_t j0 = 0; j0 < o.n; j0 += nc_block) {
+        auto nc = std::min(nc_block, o.n - j0);
+        for (std::size_t p0 = 0; p0 < o.k; p0 += kc_block) {
+            auto kc = std::min(kc_block, o.k - p0);
+            pack_b<nr>(o, p0, kc, j0, nc, packed_b.data());
+            for (std::size_t i0 = 0; i0 < o.m; i0 += mc_block) {
+                auto mc = std::min(mc_block, o.m - i0);
+                pack_a<mr>(o, i0, mc, p0, kc, packed_a.data());
+                for (std::size_t jr = 0; jr < nc; jr += nr) {
+                    for (std::size_t ir = 0; ir < mc; ir += mr) {
+                        micro_kernel<V, mr>(kc, packed_a.data() + ir * kc, packed_b.data() + jr * kc,
+                                            o.C + (i0 + ir) * o.n + j0 + jr, o.n,
+                                            std::min(mr, mc - ir), std::min(nr, nc - jr));
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Tile heights are chosen so that the 2 * mr accumulators plus the operands fit the register file
+// (16 vector registers for AVX2, 32 for AVX-512 and NEON)
+#if defined(PICOGRAD_SIMD_X86)
+template<typename T>
+__attribute__((target("avx2,fma"))) void blocked_avx2(const Operands<T>& o) {
+    blocked<typename simd::detail::vec<T, 32>::type, 6>(o);
+}
+
+template<typename T>
+__attribute__((target("avx512f,avx512dq"))) void blocked_avx512(const Operands<T>& o) {
+    blocked<typename simd::detail::vec<T, 64>::type, 12>(o);
+}
+#endif
+
+#undef PICOGRAD_GEMM_INLINE
+
+#endif // PICOGRAD_SIMD_X86 || PICOGRAD_SIMD_NEON
+
+template<typename T>
+void gemm(const Operands<T>& o) {
+    if (o.m == 0 || o.n == 0 || o.k == 0) return;
+    if constexpr (simd::detail::vectorizable<T>) {
+        switch (simd::active_isa()) {
+#if defined(PICOGRAD_SIMD_X86)
+        case simd::Isa::avx512:
+            return blocked_avx512(o);
+        case simd::Isa::avx2:
+            return blocked_avx2(o);
+#elif defined(PICOGRAD_SIMD_NEON)
+        case simd::Isa::neon:
+            return blocked<typename simd::detail::vec<T, 16>::type, 12>(o);
+#endif
+        default:
+            break;
+        }
+    }
+    reference(o);
+}
+
+} // namespace detail
+
+
+template<typename T>
+void nn(std::size_t m, std::size_t n, std::size_t k, const T* A, const T* B, T* C) {
+    detail::gemm(detail::Operands<T>{m, n, k, A, k, 1, B, n, 1, C});
+}
+
+template<typename T>
+void nt(std::size_t m, std::size_t n, std::size_t k, const T* A, const T* B, T* C) {
+    detail::gemm(detail::Operands<T>{m, n, k, A, k, 1, B, 1, k, C});
+}
+
+template<typename T>
+void tn(std::size_t m, std::size_t n, std::size_t k, const T* A, const T* B, T* C) {
+    detail::gemm(detail::Operands<T>{m, n, k, A, 1, m, B, n, 1, C});
+}
+
+} // namespace gemm
+} // namespace ajs
@@ -0,0 +1,436 @@
+#pragma once
+
+#include <cstddef>          // std::size_t
+#include <cstdint>
+#include <limits>
+#include <stdexcept>        // std::invalid_argument
+#include <type_traits>
+#include <vector>
+
+#include "ops.h"
+
+namespace ajs {
+
+template<typename T, typename Storage=T>
+class Graph;
+
+template<typename T, typename Storage=T>
+class GraphParameters;
+
+// Handle to a node of a Graph: the graph and the node's index in it. Supports the same operations
+// as Value (recording them in the operands' graph); both operands of a binary op must belong to the
+// same graph. Vars are plain values (no reference counting), valid as long as their graph is alive
+// and not rewound below them; using them after such a rewind() throws std::invalid_argument.
+template<typename T, typename Storage=T>
+class Var
+{
+    using Graph = ajs::Graph<T, Storage>;
+
+public:
+    Var operator+(const Var& other) const { return binary(Op::add, other); }
+    Var operator-(const Var& other) const { return binary(Op::sub, other); }
+    Var operator*(const Var& other) const { return binary(Op::mult, other); }
+    Var operator/(const Var& other) const { return binary(Op::div, other); }
+    Var operator-() const { return graph_->record(Op::neg, index_); }
+    Var operator+(T other) const { return graph_->record(Op::add, index_, Graph::no_operand, other); }
+    Var operator-(T other) const { return graph_->record(Op::sub, index_, Graph::no_operand, other); }
+    Var operator*(T other) const { return graph_->record(Op::mult, index_, Graph::no_operand, other); }
+    Var operator/(T other) const { return graph_->record(Op::div, index_, Graph::no_operand, other); }
+    friend Var operator+(T a, const Var& b) { return b + a; }
+    friend Var operator-(T a, const Var& b) { return b.reversed(Op::rsub, a); }
+    friend Var operator*(T a, const Var& b) { return b * a; }
+    friend Var operator/(T a, const Var& b) { return b.reversed(Op::rdiv, a); }
+    Var& operator+=(const Var& other) { return *this = *this + other; }
+    Var& operator-=(const Var& other) { return *this = *this - other; }
+    Var& operator*=(const Var& other) { return *this = *this * other; }
+    Var& operator/=(const Var& other) { return *this = *this / other; }
+
+    Var pow(int exponent) const { return graph_->record(Op::pow, index_, Graph::no_operand, T(exponent)); }
+    Var pow(float exponent) const { return graph_->record(Op::pow, index_, Graph::no_operand, T(exponent)); }
+    Var square() const { return graph_->record(Op::square, index_); }
+    Var exp() const { return graph_->record(Op::exp, index_); }
+    Var log() const { return graph_->record(Op::log, index_); }
+    Var tanh() const { return graph_->record(Op::tanh, index_); }
+    Var relu() const { return graph_->record(Op::relu, index_); }
+    Var sigmoid() const { return graph_->record(Op::sigmoid, index_); }
+
+    void backward() { graph_->backward(*this); }
+
+    T get_data() const { return T(checked().data_[index_]); }
+    T get_grad() const { return checked().grad(index_); }
+    void set_data(T data) { checked().data_[index_] = Storage(data); }  // meant for leaves; recorded ops do not follow
+    void set_grad(T grad) { checked().set_grad(index_, grad); }
+    std::uint32_t index() const { return index_; }
+
+private:
+    friend Graph;
+    friend class GraphParameters<T, Storage>;
+    Var(Graph* graph, std::uint32_t index) : graph_{graph}, index_{index} {}
+    Var reversed(Op op, T other) const { return graph_->record(op, index_, Graph::no_operand, other); }  // other op *this
+    Graph& checked() const {
+        if (index_ >= graph_->size()) throw std::invalid_argument("Var is not a node of its Graph any more (rewound?)");
+        return *graph_;
+    }
+    Var binary(Op op, const Var& other) const {
+        if (other.graph_ != graph_) throw std::invalid_argument("operands belong to different Graphs");
+        return graph_->record(op, index_, other.index_);
+    }
+
+    Graph* graph_;
+    std::uint32_t index_;
+};
+
+// A compact graph: nodes live in one pool per field (structure of arrays) instead of one heap
+// object each, and refer to their operands by 32-bit index. A node takes 2 * sizeof(T) + 9 bytes
+// (17 for float) instead of a Value node's 64 bytes plus its shared_ptr control block and
+// allocation overhead, and nothing is reference counted. Constant operands (e.g. the 2 of x * 2 or
+// the exponent of pow) take another sizeof(T) in an array of their own, which the node refers to
+// through its second operand index; ops without one (exp, tanh, ...) store nothing.
+//
+// Nodes are appended in the order the operations run, so every node comes after its operands and
+// the indices are already a topological order: backward() is a sweep down the arrays, without any
+// sorting. For training loops, create the parameters first and rewind() to them after every step:
+//
+//     Graph<float> graph;
+//     auto w = graph.variable(0.5f);
+//     auto parameters = graph.size();
+//     for (...) {
+//         auto loss = (w * x - y).square();  // x, y: Vars or numbers
+//         loss.backward();  // accumulates into w's gradient
+//         ...
+//         graph.rewind(parameters);
+//     }
+//
+// Graphs are not thread safe, and cannot hold more than 2^31 nodes.
+//
+// For mixed precision, Storage is the type that the data and gradients of the nodes are stored in,
+// e.g. Graph<float, bfloat16> (see half.h). Every op computes in T and rounds its result (and the
+// gradients it passes back) to Storage. Constants and exponents stay exact in T, and so do the
+// gradients of the leaves, which accumulate over many backward passes: they take another sizeof(T)
+// per leaf, in an array that the leaf refers to through its first operand index. An operation then
+// takes 13 bytes instead of 17. To train the leaves, use GraphParameters (below), which keeps
+// master copies of their data in T.
+template<typename T, typename Storage>
+class Graph
+{
+    using Var = ajs::Var<T, Storage>;
+    static constexpr bool mixed = !std::is_same_v<T, Storage>;
+
+public:
+    static constexpr std::uint32_t no_operand = std::numeric_limits<std::uint32_t>::max();
+    static constexpr std::size_t bytes_per_node = sizeof(Op) + 2 * sizeof(std::uint32_t) + 2 * sizeof(Storage);
+
+    explicit Graph(std::size_t capacity=0);  // in nodes
+    Graph(const Graph&) = delete;
+    Graph& operator=(const Graph&) = delete;
+
+    Var variable(T data);  // a leaf
+
+    // Backpropagates from root: recomputes the gradients of all operations up to root, and
+    // accumulates into the leaves' gradients (like Value::backward()). Sweeps every node recorded
+    // before root, whether root uses it or not, so rewind() what is not needed any more.
+    void backward(const Var& root);
+    void zero_grad();  // of all leaves
+    template<typename F>
+    void for_each_leaf(F&& f);  // f(index, grad&) on every leaf, e.g. to clip or rescale gradients
+
+    std::size_t size() const;  // number of nodes
+    void rewind(std::size_t size);  // drops all nodes from index size on (e.g. all but the parameters)
+    void reserve(std::size_t capacity);
+
+    // The nodes (operands are no_operand for leaves, operand2(i) is no_operand for unary ops, which
+    // use param(i))
+    Op op(std::size_t i) const;
+    std::uint32_t operand1(std::size_t i) const;
+    std::uint32_t operand2(std::size_t i) const;
+    T param(std::size_t i) const;
+
+private:
+    friend Var;
+    friend class GraphParameters<T, Storage>;
+
+    // operand2_ of a node with a constant operand: the constant's index in params_, with this bit set
+    static constexpr std::uint32_t param_operand = std::uint32_t(1) << 31;
+
+    Var record(Op op, std::uint32_t a, std::uint32_t b=no_operand, T param=0);
+    T second(std::uint32_t operand2) const;  // value of a second operand: a node's data, a param or 0
+    T grad(std::uint32_t i) const;
+    void set_grad(std::uint32_t i, T grad);
+    T& leaf_grad(std::uint32_t i);
+
+    std::vector<Op> op_;
+    std::vector<std::uint32_t> operand1_;  // of leaves: their index in leaf_grad_ (mixed precision only)
+    std::vector<std::uint32_t> operand2_;
+    std::vector<Storage> data_;
+    std::vector<Storage> grad_;  // of leaves only without mixed precision
+    std::vector<T> params_;
+    std::vector<T> leaf_grad_;  // mixed precision only
+};
+
+
+template<typename T, typename Storage>
+Graph<T, Storage>::Graph(std::size_t capacity) {
+    reserve(capacity);
+}
+
+template<typename T, typename Storage>
+Var<T, Storage> Graph<T, Storage>::variable(T data) {
+    if (op_.size() >= param_operand) throw std::length_error("Graph is full");
+    op_.push_back(Op::none);
+    operand1_.push_back(mixed ? std::uint32_t(leaf_grad_.size()) : no_operand);
+    operand2_.push_back(no_operand);
+    data_.push_back(Storage(data));
+    grad_.push_back(Storage(0));
+    if constexpr (mixed) leaf_grad_.push_back(0);
+    return Var(this, std::uint32_t(op_.size() - 1));
+}
+
+template<typename T, typename Storage>
+Var<T, Storage> Graph<T, Storage>::record(Op op, std::uint32_t a, std::uint32_t b, T param) {
+    if (op_.size() >= param_operand) throw std::length_error("Graph is full");
+    if (a >= op_.size() || (b != no_operand && b >= op_.size())) {
+        throw std::invalid_argument("operand is not a node of this Graph (rewound?)");
+    }
+    T result = kernels::forward(op, T(data_[a]), b != no_operand ? T(data_[b]) : param);
+    if (b == no_operand && param != 0) {
+        b = param_operand | std::uint32_t(params_.size());
+        params_.push_back(param);
+    }
+    op_.push_back(op);
+    operand1_.push_back(a);
+    operand2_.push_back(b);
+    data_.push_back(Storage(result));
+    grad_.push_back(Storage(0));
+    return Var(this, std::uint32_t(op_.size() - 1));
+}
+
+template<typename T, typename Storage>
+T Graph<T, Storage>::second(std::uint32_t operand2) const {
+    if (operand2 < param_operand) return T(data_[operand2]);
+    return operand2 == no_operand ? T(0) : params_[operand2 & ~param_operand];
+}
+
+template<typename T, typename Storage>
+T Graph<T, Storage>::grad(std::uint32_t i) const {
+    if (mixed && op_[i] == Op::none) return leaf_grad_[operand1_[i]];
+    return T(grad_[i]);
+}
+
+template<typename T, typename Storage>
+void Graph<T, Storage>::set_grad(std::uint32_t i, T grad) {
+    if (mixed && op_[i] == Op::none) leaf_grad_[operand1_[i]] = grad;
+    else grad_[i] = Storage(grad);
+}
+
+template<typename T, typename Storage>
+T& Graph<T, Storage>::leaf_grad(std::uint32_t i) {
+    if constexpr (mixed) return leaf_grad_[operand1_[i]];
+    else return grad_[i];
+}
+
+template<typename T, typename Storage>
+void Graph<T, Storage>::backward(const Var& root) {
+    if (root.graph_ != this || root.index_ >= op_.size()) {
+        throw std::invalid_argument("root is not a node of this Graph (rewound?)");
+    }
+    std::size_t end = root.index_ + 1;
+    // Gradients of operations are derived from scratch on every pass (only leaves accumulate)
+    for (std::size_t i = 0; i < end; ++i) {
+        if (op_[i] != Op::none) grad_[i] = Storage(0);
+    }
+    set_grad(root.index_, 1);
+    for (auto i = end; i-- > 0; ) {
+        if (op_[i] == Op::none) continue;
+        auto a = operand1_[i];
+        auto b = operand2_[i];
+        bool binary = b < param_operand;
+        if constexpr (!mixed) {
+            T unused_grad{0};
+            kernels::backward(op_[i], data_[i], grad_[i], data_[a], second(b),
+                              grad_[a], binary ? grad_[b] : unused_grad);
+        }
+        else {
+            // Through temporaries in T, so that an operand used twice (x * x) gets both contributions
+            T a_grad = grad(a);
+            T b_grad = binary && b != a ? grad(b) : T(0);
+            kernels::backward(op_[i], T(data_[i]), T(grad_[i]), T(data_[a]), second(b),
+                              a_grad, binary && b == a ? a_grad : b_grad);
+            set_grad(a, a_grad);
+            if (binary && b != a) set_grad(b, b_grad);
+        }
+    }
+}
+
+template<typename T, typename Storage>
+void Graph<T, Storage>::zero_grad() {
+    if constexpr (mixed) {
+        leaf_grad_.assign(leaf_grad_.size(), T(0));
+        return;
+    }
+    for (std::size_t i = 0; i < op_.size(); ++i) {
+        if (op_[i] == Op::none) grad_[i] = Storage(0);
+    }
+}
+
+template<typename T, typename Storage>
+template<typename F>
+void Graph<T, Storage>::for_each_leaf(F&& f) {
+    for (std::size_t i = 0; i < op_.size(); ++i) {
+        if (op_[i] == Op::none) f(i, leaf_grad(std::uint32_t(i)));
+    }
+}
+
+template<typename T, typename Storage>
+std::size_t Graph<T, Storage>::size() const {
+    return op_.size();
+}
+
+template<typename T, typename Storage>
+void Graph<T, Storage>::rewind(std::size_t size) {
+    if (size > op_.size()) throw std::invalid_argument("cannot rewind a Graph forward");
+    // The params and leaf gradients of the dropped nodes are the ones from the first dropped node's on
+    std::size_t params = params_.size();
+    std::size_t leaves = leaf_grad_.size();
+    for (auto i = op_.size(); i-- > size; ) {
+        if (op_[i] == Op::none) {
+            if constexpr (mixed) leaves = operand1_[i];
+        }
+        else if (operand2_[i] != no_operand && operand2_[i] >= param_operand) {
+            params = operand2_[i] & ~param_operand;
+        }
+    }
+    op_.resize(size);
+    operand1_.resize(size);
+    operand2_.resize(size);
+    data_.resize(size);
+    grad_.resize(size);
+    params_.resize(params);
+    leaf_grad_.resize(leaves);
+}
+
+template<typename T, typename Storage>
+void Graph<T, Storage>::reserve(std::size_t capacity) {
+    op_.reserve(capacity);
+    operand1_.reserve(capacity);
+    operand2_.reserve(capacity);
+    data_.reserve(capacity);
+    grad_.reserve(capacity);
+}
+
+template<typename T, typename Storage>
+Op Graph<T, Storage>::op(std::size_t i) const {
+    return op_[i];
+}
+
+template<typename T, typename Storage>
+std::uint32_t Graph<T, Storage>::operand1(std::size_t i) const {
+    return op_[i] == Op::none ? no_operand : operand1_[i];
+}
+
+template<typename T, typename Storage>
+std::uint32_t Graph<T, Storage>::operand2(std::size_t i) const {
+    return operand2_[i] < param_operand ? operand2_[i] : no_operand;
+}
+
+template<typename T, typename Storage>
+T Graph<T, Storage>::param(std::size_t i) const {
+    return operand2_[i] < param_operand ? T(0) : second(operand2_[i]);
+}
+
+// The leaves of a Graph that are the parameters of a model, for the optimizers of optim.h: the
+// leaves among the nodes [begin, end) (e.g. all nodes before the first rewind()). With mixed
+// precision, the set keeps master copies of their data in T. The optimizers update those, and the
+// leaves get them rounded to Storage, so that steps smaller than half a unit in the last place of
+// the leaves (about 0.4% of a bfloat16 weight) add up instead of being rounded away:
+//
+//     Graph<float, bfloat16> graph;
+//     ...  // create the parameters
+//     GraphParameters<float, bfloat16> parameters(graph, 0, graph.size());
+//     optim::Adam<float, GraphParameters<float, bfloat16>> optimizer(parameters, 1e-3f);
+//
+// While the set is in use, change the leaves' data through set_data() (the optimizers would
+// overwrite what is set through their Vars), and do not rewind the graph below end.
+template<typename T, typename Storage>
+class GraphParameters
+{
+    using Graph = ajs::Graph<T, Storage>;
+    using Var = ajs::Var<T, Storage>;
+    static constexpr bool mixed = !std::is_same_v<T, Storage>;
+
+public:
+    GraphParameters(Graph& graph, std::size_t begin, std::size_t end);
+    GraphParameters(const GraphParameters&) = delete;
+    GraphParameters& operator=(const GraphParameters&) = delete;
+
+    Var operator[](std::size_t i) const;  // the i-th leaf
+    T get_data(std::size_t i) const;  // the master copy
+    void set_data(std::size_t i, T data);
+
+    std::size_t size() const;
+    void zero_grad();
+
+    // Calls f(i, data, grad) with references to the master data and the gradient of every parameter
+    // i in [begin, end), and then rounds the data into the leaf, for optimizers
+    template<typename F>
+    void for_each(std::size_t begin, std::size_t end, F&& f);
+
+private:
+    Graph* graph_;
+    std::vector<std::uint32_t> leaves_;
+    std::vector<T> master_;  // mixed precision only
+};
+
+
+template<typename T, typename Storage>
+GraphParameters<T, Storage>::GraphParameters(Graph& graph, std::size_t begin, std::size_t end) : graph_{&graph} {
+    if (begin > end || end > graph.size()) throw std::invalid_argument("GraphParameters beyond the end of the Graph");
+    for (auto i = begin; i < end; ++i) {
+        if (graph.op_[i] != Op::none) continue;
+        leaves_.push_back(std::uint32_t(i));
+        if constexpr (mixed) master_.push_back(T(graph.data_[i]));
+    }
+}
+
+template<typename T, typename Storage>
+Var<T, Storage> GraphParameters<T, Storage>::operator[](std::size_t i) const {
+    return Var(graph_, leaves_[i]);
+}
+
+template<typename T, typename Storage>
+T GraphParameters<T, Storage>::get_data(std::size_t i) const {
+    if constexpr (mixed) return master_[i];
+    else return graph_->data_[leaves_[i]];
+}
+
+template<typename T, typename Storage>
+void GraphParameters<T, Storage>::set_data(std::size_t i, T data) {
+    if constexpr (mixed) master_[i] = data;
+    graph_->data_[leaves_[i]] = Storage(data);
+}
+
+template<typename T, typename Storage>
+std::size_t GraphParameters<T, Storage>::size() const {
+    return leaves_.size();
+}
+
+template<typename T, typename Storage>
+void GraphParameters<T, Storage>::zero_grad() {
+    for (auto leaf : leaves_) graph_->leaf_grad(leaf) = 0;
+}
+
+template<typename T, typename Storage>
+template<typename F>
+void GraphParameters<T, Storage>::for_each(std::size_t begin, std::size_t end, F&& f) {
+    for (auto i = begin; i < end; ++i) {
+        auto leaf = leaves_[i];
+        if constexpr (mixed) {
+            f(i, master_[i], graph_->leaf_grad(leaf));
+            graph_->data_[leaf] = Storage(master_[i]);
+        }
+        else {
+            f(i, graph_->data_[leaf], graph_->leaf_grad(leaf));
+        }
+    }
+}
+
+} // namespace ajs
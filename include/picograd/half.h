@@ -0,0 +1,103 @@
+#pragma once
+
+#include <bit>              // std::bit_cast
+#include <cstddef>          // std::size_t
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <stdexcept>        // std::invalid_argument
+
+namespace ajs {
+
+// 16-bit floating point storage types, emulated in software: bfloat16 (8 exponent bits, like
+// float, and 7 mantissa bits) and IEEE 754 half precision float16 (5 exponent bits, 10 mantissa
+// bits, largest finite value 65504). They only store numbers: conversion from float rounds to
+// nearest even (NaN stays NaN, float16 overflows to infinity and has subnormals), and conversion to
+// float is exact and implicit, so arithmetic on them happens in float.
+//
+// They halve the memory (and bandwidth) of the arrays they are used for: the data and gradients of
+// a Graph<T, Storage> (see graph.h, which keeps its indices, constants and the leaves' gradients
+// in T, so that a node takes 13 bytes instead of 17) and the bf16 and f16 types of serialize.h.
+// Accumulated gradients and optimizer state stay in float.
+class bfloat16
+{
+public:
+    bfloat16() = default;
+    explicit bfloat16(float x) : bits_{from_float(x)} {}
+    operator float() const { return std::bit_cast<float>(std::uint32_t(bits_) << 16); }
+
+    static bfloat16 from_bits(std::uint16_t bits) {
+        bfloat16 out;
+        out.bits_ = bits;
+        return out;
+    }
+    std::uint16_t bits() const { return bits_; }
+
+private:
+    static std::uint16_t from_float(float x) {
+        auto bits = std::bit_cast<std::uint32_t>(x);
+        if ((bits & 0x7fffffffu) > 0x7f800000u) return std::uint16_t((bits >> 16) | 0x40u);  // quiet NaN
+        bits += 0x7fffu + ((bits >> 16) & 1);  // round to nearest even
+        return std::uint16_t(bits >> 16);
+    }
+
+    std::uint16_t bits_{0};
+};
+
+class float16
+{
+public:
+    float16() = default;
+    explicit float16(float x) : bits_{from_float(x)} {}
+    operator float() const { return to_float(bits_); }
+
+    static float16 from_bits(std::uint16_t bits) {
+        float16 out;
+        out.bits_ = bits;
+        return out;
+    }
+    std::uint16_t bits() const { return bits_; }
+
+private:
+    static std::uint16_t from_float(float x) {
+        auto bits = std::bit_cast<std::uint32_t>(x);
+        auto sign = std::uint16_t((bits >> 16) & 0x8000u);
+        bits &= 0x7fffffffu;
+        if (bits > 0x7f800000u) return sign | 0x7e00u;  // NaN
+        if (bits >= 0x477ff000u) return sign | 0x7c00u;  // 65520 and up round to infinity
+        if (bits < 0x38800000u) {
+            // Below 2^-14: subnormal. Adding 0.5 makes the float's last bit 2^-24, float16's smallest
+            // step, so that the float addition rounds (to nearest even) for us.
+            auto rounded = std::bit_cast<std::uint32_t>(std::bit_cast<float>(bits) + 0.5f);
+            return sign | std::uint16_t(rounded - 0x3f000000u);
+        }
+        bits += (std::uint32_t(15 - 127) << 23) + 0xfffu + ((bits >> 13) & 1);  // rebias, round to nearest even
+        return sign | std::uint16_t(bits >> 13);
+    }
+
+    static float to_float(std::uint16_t h) {
+        std::uint32_t sign = std::uint32_t(h & 0x8000u) << 16;
+        std::uint32_t exponent = (h >> 10) & 0x1fu;
+        std::uint32_t mantissa = h & 0x3ffu;
+        if (exponent == 0x1f) return std::bit_cast<float>(sign | 0x7f800000u | (mantissa << 13));  // inf, NaN
+        if (exponent == 0) {  // zero, subnormal
+            float magnitude = float(mantissa) * 0x1p-24f;
+            return sign ? -magnitude : magnitude;
+        }
+        return std::bit_cast<float>(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+    }
+
+    std::uint16_t bits_{0};
+};
+
+inline std::ostream& operator<<(std::ostream& os, bfloat16 x) { return os << float(x); }
+inline std::ostream& operator<<(std::ostream& os, float16 x) { return os << float(x); }
+
+// out[i] = To(in[i]), e.g. from a float array to a bfloat16 one (rounding) or back (exact)
+template<typename To, typename From>
+void convert(std::span<const From> in, std::span<To> out) {
+    if (in.size() != out.size()) throw std::invalid_argument("convert needs arrays of the same size");
+    for (std::size_t i = 0; i < in.size(); ++i) out[i] = To(in[i]);
+}
+
+} // namespace ajs
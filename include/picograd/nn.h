@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstddef>          // std::size_t
+#include <cstdint>
+#include <memory>           // smart pointers
+#include <random>
+#include <vector>
+
+#include "parameters.h"
+#include "value.h"
+
+namespace ajs::nn {
+
+// Micrograd's neural network modules. All parameters of a model live in one ParameterSet, which
+// the top-level module creates with exactly the capacity it needs; the modules inside it refer to
+// consecutive ranges of that set. parameters() is therefore a view (no vector of Values is built),
+// zero_grad() is one sweep over an array, and the optimizers of optim.h work on parameter_set():
+//
+//     nn::MLP<float> model(2, {16, 16, 1});
+//     optim::SGD<float> optimizer(model.parameter_set(), 0.05f);
+//     for (...) {
+//         auto score = model(x)[0];  // x: std::vector<float> or std::vector<Value<float>>
+//         loss(score).backward();
+//         optimizer.step();
+//     }
+//
+// Copies of a module share its parameters, like copies of a Value share its node. Weights are
+// drawn uniformly from [-1, 1] and biases start at 0, as in micrograd.
+template<typename T>
+class Module
+{
+public:
+    ParameterView<T> parameters() const { return ParameterView<T>(*set_, begin_, end_); }
+    ParameterSet<T>& parameter_set() const { return *set_; }  // of the whole model
+    void zero_grad() { parameters().zero_grad(); }
+
+protected:
+    Module(std::shared_ptr<ParameterSet<T>> set, std::size_t begin, std::size_t end)
+        : set_{std::move(set)}, begin_{begin}, end_{end} {}
+
+    std::shared_ptr<ParameterSet<T>> set_;
+    std::size_t begin_;
+    std::size_t end_;
+};
+
+template<typename T>
+class Layer;
+
+template<typename T>
+class MLP;
+
+// w . x + b, followed by a ReLU if nonlinear
+template<typename T>
+class Neuron : public Module<T>
+{
+public:
+    Neuron(std::size_t nin, bool nonlinear=true, std::uint32_t seed=0);
+
+    Value<T> operator()(const std::vector<Value<T>>& x) const;
+    Value<T> operator()(const std::vector<T>& x) const;  // inputs as constants (no nodes of their own)
+
+    std::size_t inputs() const { return this->end_ - this->begin_ - 1; }
+    bool nonlinear() const { return nonlinear_; }
+
+    static std::size_t parameter_count(std::size_t nin) { return nin + 1; }
+
+private:
+    friend class Layer<T>;
+    template<typename Random>  // a std::mt19937, shared with the other modules of the model
+    Neuron(std::shared_ptr<ParameterSet<T>> set, std::size_t nin, bool nonlinear, Random&& random);
+
+    template<typename X>
+    Value<T> forward(const std::vector<X>& x) const;
+
+    bool nonlinear_;
+};
+
+// nout neurons over the same inputs
+template<typename T>
+class Layer : public Module<T>
+{
+public:
+    Layer(std::size_t nin, std::size_t nout, bool nonlinear=true, std::uint32_t seed=0);
+
+    std::vector<Value<T>> operator()(const std::vector<Value<T>>& x) const;
+    std::vector<Value<T>> operator()(const std::vector<T>& x) const;
+
+    const std::vector<Neuron<T>>& neurons() const { return neurons_; }
+
+    static std::size_t parameter_count(std::size_t nin, std::size_t nout) { return nout * Neuron<T>::parameter_count(nin); }
+
+private:
+    friend class MLP<T>;
+    template<typename Random>
+    Layer(std::shared_ptr<ParameterSet<T>> set, std::size_t nin, std::size_t nout, bool nonlinear, Random&& random);
+
+    std::vector<Neuron<T>> neurons_;
+};
+
+// Layers of sizes nouts over nin inputs; all but the last one are nonlinear
+template<typename T>
+class MLP : public Module<T>
+{
+public:
+    MLP(std::size_t nin, const std::vector<std::size_t>& nouts, std::uint32_t seed=0);
+
+    std::vector<Value<T>> operator()(const std::vector<Value<T>>& x) const;
+    std::vector<Value<T>> operator()(const std::vector<T>& x) const;
+
+    const std::vector<Layer<T>>& layers() const { return layers_; }
+
+    static std::size_t parameter_count(std::size_t nin, const std::vector<std::size_t>& nouts);
+
+private:
+    std::vector<Layer<T>> layers_;
+};
+
+
+template<typename T>
+Neuron<T>::Neuron(std::size_t nin, bool nonlinear, std::uint32_t seed)
+    : Neuron(std::make_shared<ParameterSet<T>>(parameter_count(nin)), nin, nonlinear, std::mt19937(seed)) {}
+
+template<typename T>
+template<typename Random>
+Neuron<T>::Neuron(std::shared_ptr<ParameterSet<T>> set, std::size_t nin, bool nonlinear, Random&& random)
+    : Module<T>(set, set->size(), set->size() + parameter_count(nin)), nonlinear_{nonlinear} {
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    for (std::size_t i = 0; i < nin; ++i) set->add(T(uniform(random)));
+    set->add(T(0));
+}
+
+template<typename T>
+template<typename X>
+Value<T> Neuron<T>::forward(const std::vector<X>& x) const {
+    auto& set = *this->set_;
+    auto bias = this->begin_ + inputs();
+    Value<T> act = set[bias];
+    for (std::size_t i = 0; i < inputs(); ++i) act = act + set[this->begin_ + i] * x[i];
+    return nonlinear_ ? act.relu() : act;
+}
+
+template<typename T>
+Value<T> Neuron<T>::operator()(const std::vector<Value<T>>& x) const {
+    return forward(x);
+}
+
+template<typename T>
+Value<T> Neuron<T>::operator()(const std::vector<T>& x) const {
+    return forward(x);
+}
+
+template<typename T>
+Layer<T>::Layer(std::size_t nin, std::size_t nout, bool nonlinear, std::uint32_t seed)
+    : Layer(std::make_shared<ParameterSet<T>>(parameter_count(nin, nout)), nin, nout, nonlinear, std::mt19937(seed)) {}
+
+template<typename T>
+template<typename Random>
+Layer<T>::Layer(std::shared_ptr<ParameterSet<T>> set, std::size_t nin, std::size_t nout, bool nonlinear, Random&& random)
+    : Module<T>(set, set->size(), set->size() + parameter_count(nin, nout)) {
+    neurons_.reserve(nout);
+    for (std::size_t i = 0; i < nout; ++i) neurons_.push_back(Neuron<T>(set, nin, nonlinear, random));
+}
+
+template<typename T>
+std::vector<Value<T>> Layer<T>::operator()(const std::vector<Value<T>>& x) const {
+    std::vector<Value<T>> out;
+    out.reserve(neurons_.size());
+    for (auto& neuron : neurons_) out.push_back(neuron(x));
+    return out;
+}
+
+template<typename T>
+std::vector<Value<T>> Layer<T>::operator()(const std::vector<T>& x) const {
+    std::vector<Value<T>> out;
+    out.reserve(neurons_.size());
+    for (auto& neuron : neurons_) out.push_back(neuron(x));
+    return out;
+}
+
+template<typename T>
+std::size_t MLP<T>::parameter_count(std::size_t nin, const std::vector<std::size_t>& nouts) {
+    std::size_t count = 0;
+    for (auto nout : nouts) {
+        count += Layer<T>::parameter_count(nin, nout);
+        nin = nout;
+    }
+    return count;
+}
+
+template<typename T>
+MLP<T>::MLP(std::size_t nin, const std::vector<std::size_t>& nouts, std::uint32_t seed)
+    : Module<T>(std::make_shared<ParameterSet<T>>(parameter_count(nin, nouts)), 0, parameter_count(nin, nouts)) {
+    std::mt19937 random(seed);
+    layers_.reserve(nouts.size());
+    for (std::size_t i = 0; i < nouts.size(); ++i) {
+        layers_.push_back(Layer<T>(this->set_, nin, nouts[i], i + 1 < nouts.size(), random));
+        nin = nouts[i];
+    }
+}
+
+template<typename T>
+std::vector<Value<T>> MLP<T>::operator()(const std::vector<Value<T>>& x) const {
+    if (layers_.empty()) return x;
+    auto out = layers_[0](x);
+    for (std::size_t i = 1; i < layers_.size(); ++i) out = layers_[i](out);
+    return out;
+}
+
+template<typename T>
+std::vector<Value<T>> MLP<T>::operator()(const std::vector<T>& x) const {
+    if (layers_.empty()) return std::vector<Value<T>>(x.begin(), x.end());
+    auto out = layers_[0](x);
+    for (std::size_t i = 1; i < layers_.size(); ++i) out = layers_[i](out);
+    return out;
+}
+
+} // namespace ajs::nn
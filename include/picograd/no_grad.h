@@ -0,0 +1,42 @@
+#pragma once
+
+namespace ajs {
+
+// Inference mode for the current thread (meant for being used as a scoped stack object, like a
+// lock guard). While a NoGradGuard is alive, Value operations only compute their data: every
+// result is a constant (see Value::requires_grad()), a single node without operands, so no graph
+// is linked up and every intermediate result is freed as soon as its last Value goes away.
+// Combined with a Tape, an inference does not touch the heap at all.
+// Guards can be nested; Values created under a guard can be used normally afterwards.
+class NoGradGuard
+{
+public:
+    NoGradGuard();
+    NoGradGuard(const NoGradGuard&) = delete;
+    NoGradGuard& operator=(const NoGradGuard&) = delete;
+    ~NoGradGuard();
+
+    static bool active();
+
+private:
+    bool previous_;
+
+    static thread_local bool active_;
+};
+
+
+inline thread_local bool NoGradGuard::active_{false};
+
+inline NoGradGuard::NoGradGuard(): previous_{active_} {
+    active_ = true;
+}
+
+inline NoGradGuard::~NoGradGuard() {
+    active_ = previous_;
+}
+
+inline bool NoGradGuard::active() {
+    return active_;
+}
+
+} // namespace ajs
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cmath>            // std::log, std::pow, std::exp
+#include <cstddef>          // std::size_t
+#include <cstdint>
+
+namespace ajs {
+
+// Operation that produced a graph node. Together with the node's operands, this is all that is
+// needed to run the node forward or backward (see the kernels below).
+enum class Op : std::uint8_t {
+    none, add, sub, mult, div, rsub, rdiv, neg, pow, square, exp, log, tanh, relu, sigmoid,
+    linear,  // fused expression that recorded its derivatives instead of its formula (see expr.h)
+    matmul, sum, mean  // only produced by Tensor
+};
+
+inline const char* op_str(Op op) {
+    switch (op) {
+    case Op::none:
+        return "none";
+    case Op::add:
+        return "+";
+    case Op::sub:
+        return "-";
+    case Op::mult:
+        return "*";
+    case Op::div:
+        return "/";
+    case Op::rsub:
+        return "r-";
+    case Op::rdiv:
+        return "r/";
+    case Op::neg:
+        return "neg";
+    case Op::pow:
+        return "pow";
+    case Op::square:
+        return "square";
+    case Op::exp:
+        return "exp";
+    case Op::log:
+        return "log";
+    case Op::tanh:
+        return "tanh";
+    case Op::relu:
+        return "relu";
+    case Op::sigmoid:
+        return "sigmoid";
+    case Op::linear:
+        return "linear";
+    case Op::matmul:
+        return "matmul";
+    case Op::sum:
+        return "sum";
+    case Op::mean:
+        return "mean";
+    default:
+        return "unknown";
+    }
+}
+
+template<typename T, std::size_t N>
+class Batch;
+
+namespace kernels {
+
+// log() is clamped so that log(0) does not blow up
+template<typename T>
+inline T safe_log_arg(T a) {
+    return a != 0 ? a : T(1.0E-15f);  // TODO: necessary? is there a better way?
+}
+
+// Result of applying op to operand a (and b for binary ops; for pow, b is the exponent; rsub and
+// rdiv are sub and div with the operands swapped, for a constant on the left).
+// Linear nodes cannot be recomputed, their result is only known from when they were built.
+template<typename T>
+inline T forward(Op op, T a, T b=0) {
+    switch (op) {
+    case Op::add:
+        return a + b;
+    case Op::sub:
+        return a - b;
+    case Op::mult:
+        return a * b;
+    case Op::div:
+        return a / b;
+    case Op::rsub:
+        return b - a;
+    case Op::rdiv:
+        return b / a;
+    case Op::neg:
+        return -a;
+    case Op::pow:
+        return std::pow(a, b);
+    case Op::square:
+        return a * a;
+    case Op::exp:
+        return std::exp(a);
+    case Op::log:
+        return std::log(safe_log_arg(a));
+    case Op::tanh: {
+        T exp_val = std::exp(a * 2);
+        return (exp_val - 1) / (exp_val + 1);
+    }
+    case Op::relu:
+        return a > 0 ? a : 0;
+    case Op::sigmoid:
+        return T(1) / (T(1) + std::exp(-a));
+    case Op::none:
+    default:
+        return a;
+    }
+}
+
+// Accumulate the gradient of out = op(a, b) into the gradients of its operands.
+// `out` is the forward result, `grad` is the gradient that has arrived at out.
+// For linear nodes, a and b are the recorded derivatives of out with respect to the operands.
+template<typename T>
+inline void backward(Op op, T out, T grad, T a, T b, T& a_grad, T& b_grad) {
+    switch (op) {
+    case Op::add:
+        a_grad += grad;
+        b_grad += grad;
+        break;
+    case Op::sub:
+        a_grad += grad;
+        b_grad -= grad;
+        break;
+    case Op::mult:
+        a_grad += grad * b;
+        b_grad += grad * a;
+        break;
+    case Op::div:
+        a_grad += grad / b;
+        b_grad -= grad * out / b;
+        break;
+    case Op::rsub:
+        a_grad -= grad;
+        break;
+    case Op::rdiv:
+        a_grad -= grad * out / a;
+        break;
+    case Op::neg:
+        a_grad -= grad;
+        break;
+    case Op::pow:
+        a_grad += grad * b * std::pow(a, b - 1);
+        break;
+    case Op::square:
+        a_grad += grad * 2 * a;
+        break;
+    case Op::exp:
+        a_grad += grad * out;
+        break;
+    case Op::log:
+        a_grad += grad * (1 / safe_log_arg(a));
+        break;
+    case Op::tanh:
+        a_grad += grad * (1 - out * out);
+        break;
+    case Op::relu:
+        a_grad += grad * (out > 0 ? 1 : 0);
+        break;
+    case Op::sigmoid:
+        a_grad += grad * out * (1 - out);
+        break;
+    case Op::linear:
+        a_grad += grad * a;
+        b_grad += grad * b;
+        break;
+    case Op::none:
+    default:
+        break;
+    }
+}
+
+// Lane-wise versions of both for Batch (defined in batch.h; declared here, so that Value<Batch>
+// finds them)
+template<typename T, std::size_t N>
+Batch<T, N> forward(Op op, const Batch<T, N>& a, const Batch<T, N>& b=Batch<T, N>());
+template<typename T, std::size_t N>
+void backward(Op op, const Batch<T, N>& out, const Batch<T, N>& grad, const Batch<T, N>& a, const Batch<T, N>& b,
+              Batch<T, N>& a_grad, Batch<T, N>& b_grad);
+
+} // namespace kernels
+
+} // namespace ajs
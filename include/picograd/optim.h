@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>        // std::min
+#include <cmath>            // std::sqrt, std::pow, std::isfinite
+#include <cstddef>          // std::size_t
+#include <vector>
+
+#include "graph.h"
+#include "parameters.h"
+#include "thread_pool.h"
+
+namespace ajs::optim {
+
+// Optimizers over a ParameterSet. A step is one fused pass over the parameters: every parameter's
+// update (including weight decay and the optimizer's state, which is kept in contiguous arrays) is
+// done while it is in cache, without going through Values, and its gradient is reset to 0 in the
+// same pass, ready for the next backward pass. step(pool) splits the pass into chunks that run on
+// the threads of a ThreadPool. zero_grad() zeroes all gradients in one sweep without a step.
+//
+//     ParameterSet<float> parameters(count);
+//     ...  // build the model with parameters.add()
+//     optim::Adam<float> optimizer(parameters, 1e-3f);
+//     for (...) {
+//         loss().backward();
+//         optimizer.step();  // consumes the gradients
+//     }
+//
+// Parameters added to the set after the optimizer was created start with zero state.
+//
+// The leaves of a Graph are trained the same way through a GraphParameters set (see graph.h),
+// e.g. optim::SGD<float, GraphParameters<float, bfloat16>>. Its optimizer state is kept in T, and
+// so are the master copies of the leaves' data that the steps update.
+
+namespace detail {
+
+// Step and zero_grad for Derived, which provides prepare() (once per step) and update(begin, end).
+// Parameters is a ParameterSet or a GraphParameters set.
+template<typename Parameters, typename Derived>
+class Optimizer
+{
+public:
+    Optimizer(const Optimizer&) = delete;
+    Optimizer& operator=(const Optimizer&) = delete;
+
+    void step();
+    void step(ThreadPool& pool);
+    void zero_grad() { parameters_.zero_grad(); }
+
+protected:
+    explicit Optimizer(Parameters& parameters) : parameters_{parameters} {}
+
+    Parameters& parameters_;
+
+private:
+    static constexpr std::size_t chunk_size = 4096;  // parameters per task of a parallel step
+    static void update_chunk(void* context, std::size_t chunk);
+};
+
+} // namespace detail
+
+// Stochastic gradient descent, with momentum (velocity = momentum * velocity + grad) and L2 weight
+// decay (added to the gradient) if they are not 0
+template<typename T, typename Parameters=ParameterSet<T>>
+class SGD : public detail::Optimizer<Parameters, SGD<T, Parameters>>
+{
+public:
+    SGD(Parameters& parameters, T lr, T momentum=0, T weight_decay=0);
+
+    T lr;
+    T momentum;
+    T weight_decay;
+
+private:
+    friend class detail::Optimizer<Parameters, SGD>;
+    void prepare();
+    void update(std::size_t begin, std::size_t end);
+
+    std::vector<T> velocity_;
+};
+
+// Adam (Kingma & Ba), with L2 weight decay added to the gradient if it is not 0
+template<typename T, typename Parameters=ParameterSet<T>>
+class Adam : public detail::Optimizer<Parameters, Adam<T, Parameters>>
+{
+public:
+    Adam(Parameters& parameters, T lr=T(1e-3), T beta1=T(0.9), T beta2=T(0.999), T eps=T(1e-8),
+         T weight_decay=0);
+
+    T lr;
+    T beta1;
+    T beta2;
+    T eps;
+    T weight_decay;
+
+protected:
+    bool decoupled_{false};  // see AdamW
+
+private:
+    friend class detail::Optimizer<Parameters, Adam>;
+    void prepare();
+    void update(std::size_t begin, std::size_t end);
+
+    std::vector<T> m_;  // first moment
+    std::vector<T> v_;  // second moment
+    std::size_t t_{0};  // number of steps
+    T correction1_{1};  // bias corrections of the current step
+    T correction2_{1};
+};
+
+// Adam with decoupled weight decay (Loshchilov & Hutter): the parameters are decayed by
+// lr * weight_decay directly, instead of adding the decay to the gradient
+template<typename T, typename Parameters=ParameterSet<T>>
+class AdamW : public Adam<T, Parameters>
+{
+public:
+    AdamW(Parameters& parameters, T lr=T(1e-3), T beta1=T(0.9), T beta2=T(0.999), T eps=T(1e-8),
+          T weight_decay=T(1e-2))
+        : Adam<T, Parameters>(parameters, lr, beta1, beta2, eps, weight_decay) {
+        this->decoupled_ = true;
+    }
+};
+
+// Dynamic loss scaling, for training with reduced precision (see half.h): backpropagating from
+// loss * scale() lifts small gradients out of the range where 16-bit floats flush them to zero, and
+// unscale() divides them back before the step. If a gradient overflowed (inf or NaN), unscale()
+// zeroes all gradients, halves the scale and returns false, and the step is skipped; after
+// growth_interval steps without overflow, the scale doubles.
+//
+//     optim::LossScaler<float> scaler;
+//     for (...) {
+//         scaler.scaled(loss()).backward();
+//         if (scaler.unscale(parameters)) optimizer.step();
+//     }
+//
+// unscale(graph) does the same for the leaves of a Graph, e.g. a Graph<float, bfloat16>. With
+// gradients accumulated in float, as everywhere in picograd, underflow only threatens where
+// gradients pass through 16 bits, and the scaler mostly keeps overflowed gradients out of the step.
+template<typename T>
+class LossScaler
+{
+public:
+    explicit LossScaler(T scale=T(65536), std::size_t growth_interval=2000)
+        : scale_{scale}, growth_interval_{growth_interval} {}
+
+    template<typename V>
+    V scaled(const V& loss) const { return loss * scale_; }  // a Value, Var or number
+    bool unscale(const ParameterView<T>& parameters);
+    bool unscale(ParameterSet<T>& parameters) { return unscale(ParameterView<T>(parameters, 0, parameters.size())); }
+    template<typename Storage>
+    bool unscale(Graph<T, Storage>& graph);
+
+    T scale() const { return scale_; }
+    std::size_t skipped() const { return skipped_; }  // steps with overflowed gradients
+
+private:
+    bool update(bool finite);  // adjusts the scale after a step; returns finite
+
+    T scale_;
+    std::size_t growth_interval_;
+    std::size_t good_steps_{0};
+    std::size_t skipped_{0};
+};
+
+
+namespace detail {
+
+template<typename Parameters, typename Derived>
+void Optimizer<Parameters, Derived>::step() {
+    auto& self = static_cast<Derived&>(*this);
+    self.prepare();
+    self.update(0, parameters_.size());
+}
+
+template<typename Parameters, typename Derived>
+void Optimizer<Parameters, Derived>::step(ThreadPool& pool) {
+    auto& self = static_cast<Derived&>(*this);
+    self.prepare();
+    auto chunks = (parameters_.size() + chunk_size - 1) / chunk_size;
+    pool.run([&] {
+        for (std::size_t c = 1; c < chunks; ++c) pool.spawn({&update_chunk, this, c});
+        if (chunks > 0) update_chunk(this, 0);
+    });
+}
+
+template<typename Parameters, typename Derived>
+void Optimizer<Parameters, Derived>::update_chunk(void* context, std::size_t chunk) {
+    auto& self = *static_cast<Derived*>(static_cast<Optimizer*>(context));
+    auto end = std::min(self.parameters_.size(), (chunk + 1) * chunk_size);
+    self.update(chunk * chunk_size, end);
+}
+
+} // namespace detail
+
+template<typename T, typename Parameters>
+SGD<T, Parameters>::SGD(Parameters& parameters, T lr, T momentum, T weight_decay)
+    : detail::Optimizer<Parameters, SGD>(parameters), lr{lr}, momentum{momentum}, weight_decay{weight_decay} {}
+
+template<typename T, typename Parameters>
+void SGD<T, Parameters>::prepare() {
+    if (momentum != 0) velocity_.resize(this->parameters_.size(), T(0));
+}
+
+template<typename T, typename Parameters>
+void SGD<T, Parameters>::update(std::size_t begin, std::size_t end) {
+    // Copies of the members, so that the compiler knows that the loop does not change them
+    T rate = lr;
+    T mu = momentum;
+    T decay = weight_decay;
+    if (mu == 0) {
+        this->parameters_.for_each(begin, end, [=](std::size_t, T& data, T& grad) {
+            data -= rate * (grad + decay * data);
+            grad = 0;
+        });
+        return;
+    }
+    T* velocity = velocity_.data();
+    this->parameters_.for_each(begin, end, [=](std::size_t i, T& data, T& grad) {
+        velocity[i] = mu * velocity[i] + grad + decay * data;
+        data -= rate * velocity[i];
+        grad = 0;
+    });
+}
+
+template<typename T, typename Parameters>
+Adam<T, Parameters>::Adam(Parameters& parameters, T lr, T beta1, T beta2, T eps, T weight_decay)
+    : detail::Optimizer<Parameters, Adam>(parameters), lr{lr}, beta1{beta1}, beta2{beta2}, eps{eps},
+      weight_decay{weight_decay} {}
+
+template<typename T, typename Parameters>
+void Adam<T, Parameters>::prepare() {
+    m_.resize(this->parameters_.size(), T(0));
+    v_.resize(this->parameters_.size(), T(0));
+    ++t_;
+    correction1_ = 1 - std::pow(beta1, T(t_));
+    correction2_ = 1 - std::pow(beta2, T(t_));
+}
+
+template<typename T, typename Parameters>
+void Adam<T, Parameters>::update(std::size_t begin, std::size_t end) {
+    T* m = m_.data();
+    T* v = v_.data();
+    T b1 = beta1;
+    T b2 = beta2;
+    T epsilon = eps;
+    // lr / correction1 * m / (sqrt(v) / sqrt(correction2) + eps)
+    T step_size = lr / correction1_;
+    T inverse_sqrt2 = 1 / std::sqrt(correction2_);
+    T l2 = decoupled_ ? T(0) : weight_decay;
+    T decay = decoupled_ ? 1 - lr * weight_decay : T(1);
+    this->parameters_.for_each(begin, end, [=](std::size_t i, T& data, T& grad) {
+        T g = grad + l2 * data;
+        m[i] = b1 * m[i] + (1 - b1) * g;
+        v[i] = b2 * v[i] + (1 - b2) * g * g;
+        data = decay * data - step_size * m[i] / (std::sqrt(v[i]) * inverse_sqrt2 + epsilon);
+        grad = 0;
+    });
+}
+
+template<typename T>
+bool LossScaler<T>::unscale(const ParameterView<T>& parameters) {
+    auto begin = parameters.offset();
+    auto end = begin + parameters.size();
+    T inverse = 1 / scale_;
+    bool finite = true;
+    parameters.set().for_each(begin, end, [&](std::size_t, T&, T& grad) {
+        grad *= inverse;
+        finite &= std::isfinite(grad);
+    });
+    if (!finite) parameters.set().for_each(begin, end, [](std::size_t, T&, T& grad) { grad = 0; });
+    return update(finite);
+}
+
+template<typename T>
+template<typename Storage>
+bool LossScaler<T>::unscale(Graph<T, Storage>& graph) {
+    T inverse = 1 / scale_;
+    bool finite = true;
+    graph.for_each_leaf([&](std::size_t, T& grad) {
+        grad *= inverse;
+        finite &= std::isfinite(grad);
+    });
+    if (!finite) graph.zero_grad();
+    return update(finite);
+}
+
+template<typename T>
+bool LossScaler<T>::update(bool finite) {
+    if (finite) {
+        if (++good_steps_ == growth_interval_) {
+            scale_ *= 2;
+            good_steps_ = 0;
+        }
+        return true;
+    }
+    scale_ /= 2;
+    good_steps_ = 0;
+    ++skipped_;
+    return false;
+}
+
+} // namespace ajs::optim
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>          // std::size_t
+#include <memory>           // smart pointers
+#include <stdexcept>        // std::length_error
+#include <vector>
+
+#include "value.h"
+
+namespace ajs {
+
+// The parameters of a model, stored contiguously: the set owns one array of nodes, and hands out
+// Values referring to them (non-owning, like the Tape's, so copying them costs no reference
+// counting). Bulk operations over the parameters (zeroing the gradients, optimizer steps, see
+// optim.h) are then a sweep over one array instead of chasing a pointer per parameter.
+//
+// The capacity is fixed when the set is created, so that the nodes never move. The Values must not
+// be used after the set is destroyed.
+template<typename T>
+class ParameterSet
+{
+    using Node = typename Value<T>::Node;
+
+public:
+    explicit ParameterSet(std::size_t capacity);
+    ParameterSet(const ParameterSet&) = delete;
+    ParameterSet& operator=(const ParameterSet&) = delete;
+
+    Value<T> add(T data);  // a new parameter; throws std::length_error if the set is full
+    Value<T> operator[](std::size_t i) const;
+    std::vector<Value<T>> values() const;  // all of them, e.g. for a DataParallel trainer
+
+    std::size_t size() const;
+    std::size_t capacity() const;
+    void zero_grad();
+
+    // Calls f(i, data, grad) with references to the data and gradient of every parameter i in
+    // [begin, end), for optimizers
+    template<typename F>
+    void for_each(std::size_t begin, std::size_t end, F&& f);
+
+private:
+    std::vector<Node> nodes_;
+};
+
+// A contiguous range of the parameters of a set, e.g. those of one layer of a model (see nn.h).
+// Creating and copying a view costs O(1); it refers to the set, which must outlive it.
+template<typename T>
+class ParameterView
+{
+public:
+    ParameterView(ParameterSet<T>& set, std::size_t begin, std::size_t end)
+        : set_{&set}, begin_{begin}, end_{end} {}
+
+    Value<T> operator[](std::size_t i) const { return (*set_)[begin_ + i]; }
+    std::vector<Value<T>> values() const;
+    std::size_t size() const { return end_ - begin_; }
+    std::size_t offset() const { return begin_; }  // of the first parameter in the set
+    ParameterSet<T>& set() const { return *set_; }
+    void zero_grad();
+
+private:
+    ParameterSet<T>* set_;
+    std::size_t begin_;
+    std::size_t end_;
+};
+
+
+template<typename T>
+ParameterSet<T>::ParameterSet(std::size_t capacity) {
+    nodes_.reserve(capacity);
+}
+
+template<typename T>
+Value<T> ParameterSet<T>::add(T data) {
+    if (nodes_.size() == nodes_.capacity()) throw std::length_error("ParameterSet is full");
+    nodes_.emplace_back(data);
+    return (*this)[nodes_.size() - 1];
+}
+
+template<typename T>
+Value<T> ParameterSet<T>::operator[](std::size_t i) const {
+    auto node = const_cast<Node*>(&nodes_[i]);
+    return Value<T>(std::shared_ptr<Node>(std::shared_ptr<Node>{}, node));
+}
+
+template<typename T>
+std::vector<Value<T>> ParameterSet<T>::values() const {
+    std::vector<Value<T>> out;
+    out.reserve(nodes_.size());
+    for (std::size_t i = 0; i < nodes_.size(); ++i) out.push_back((*this)[i]);
+    return out;
+}
+
+template<typename T>
+std::size_t ParameterSet<T>::size() const {
+    return nodes_.size();
+}
+
+template<typename T>
+std::size_t ParameterSet<T>::capacity() const {
+    return nodes_.capacity();
+}
+
+template<typename T>
+void ParameterSet<T>::zero_grad() {
+    for (auto& node : nodes_) node.grad = 0;
+}
+
+template<typename T>
+template<typename F>
+void ParameterSet<T>::for_each(std::size_t begin, std::size_t end, F&& f) {
+    for (auto i = begin; i < end; ++i) f(i, nodes_[i].data, nodes_[i].grad);
+}
+
+template<typename T>
+std::vector<Value<T>> ParameterView<T>::values() const {
+    std::vector<Value<T>> out;
+    out.reserve(size());
+    for (auto i = begin_; i < end_; ++i) out.push_back((*set_)[i]);
+    return out;
+}
+
+template<typename T>
+void ParameterView<T>::zero_grad() {
+    set_->for_each(begin_, end_, [](std::size_t, T&, T& grad) { grad = 0; });
+}
+
+} // namespace ajs
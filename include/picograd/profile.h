@@ -0,0 +1,475 @@
+#pragma once
+
+#include <array>
+#include <cstddef>          // std::size_t
+#include <cstdint>
+#include <vector>
+
+#include "ops.h"
+
+#ifdef PICOGRAD_PROFILE
+#include <algorithm>        // std::max, std::find
+#include <atomic>
+#include <chrono>
+#include <memory>           // std::allocator
+#include <mutex>
+#include <iomanip>          // std::setw
+#include <ostream>
+#include <string>
+#endif
+
+namespace ajs::profile {
+
+// Instrumentation of Value graphs: per-op counts and forward/backward time, nodes created and
+// freed, bytes allocated for nodes, and the number, size, depth and time of topological sorts.
+// It is compiled in only if PICOGRAD_PROFILE is defined (CMake option PROFILE) for every
+// translation unit that uses picograd; otherwise the hooks in Value are empty inline functions and
+// cost nothing. Compiled in, counts are exact but op times are sampled: one op in about
+// sample_every() (by default 64, at pseudo-random intervals so that loops do not alias with it) is
+// timed, and each op's time is estimated from its samples. That keeps the overhead to a few
+// counter updates per op; sample_every(1) times every op, at two clock reads each.
+//
+// Each thread counts into its own counters, so the hooks need no atomic read-modify-writes or
+// locks; report() sums them up. Besides the counters, backward passes, sorts and user-defined
+// Scopes are recorded as spans, which write_chrome_trace() exports for chrome://tracing or
+// Perfetto:
+//
+//     {
+//         profile::Scope scope("train step");
+//         loss().backward();
+//         optimizer.step();
+//     }
+//     profile::write_counters(std::cout, profile::report());
+//     profile::write_chrome_trace(file);
+//
+// "forward" time is the time to record an op's node (allocation and construction, or folding of
+// constants), since ops compute their result before they record it. Tensor, Graph and Program do
+// not record into the profile.
+
+#ifdef PICOGRAD_PROFILE
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+constexpr std::size_t op_count = std::size_t(Op::mean) + 1;
+
+enum class Pass { forward, backward };
+
+struct OpStats {
+    std::uint64_t count{0};  // nodes recorded (leaves: Op::none)
+    std::uint64_t forward_ns{0};  // estimated from the sampled ops
+    std::uint64_t backward_count{0};
+    std::uint64_t backward_ns{0};  // estimated from the sampled ops
+};
+
+struct Report {
+    std::array<OpStats, op_count> ops{};
+    std::uint64_t nodes_created{0};
+    std::uint64_t nodes_freed{0};
+    std::uint64_t bytes_allocated{0};  // for heap nodes (with their control block) and Tape blocks
+    std::uint64_t sorts{0};  // topological sorts
+    std::uint64_t sorted_nodes{0};
+    std::uint64_t sort_ns{0};
+    std::uint64_t max_depth{0};  // longest path from a root to a leaf, in nodes, over all sorts
+    std::uint64_t dropped_spans{0};  // spans beyond the per-thread limit, not recorded
+};
+
+#ifdef PICOGRAD_PROFILE
+
+inline Report report();  // sums over all threads, including finished ones
+inline void reset();  // only while no other thread records
+inline void write_counters(std::ostream& os, const Report& report);
+inline void write_chrome_trace(std::ostream& os);  // the spans, and the counters as of now
+inline void sample_every(std::uint32_t ops);  // on average, from the next reset(); 1 times every op
+
+// Records the time from construction to destruction as a span named `name` (a string literal, or
+// a string that outlives the profile)
+class Scope
+{
+public:
+    explicit Scope(const char* name);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* name_;
+    std::uint64_t begin_;
+};
+
+namespace detail {
+
+constexpr std::size_t max_spans = std::size_t(1) << 20;  // per thread
+
+inline std::atomic<std::uint32_t> sample_period{64};
+
+struct Span {
+    const char* name;
+    std::uint64_t begin_ns;
+    std::uint64_t duration_ns;
+};
+
+// Only the owning thread writes a counter; relaxed atomics let report() read them while it does
+class Counter
+{
+public:
+    void add(std::uint64_t n) { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void raise(std::uint64_t n) {
+        if (n > value_.load(std::memory_order_relaxed)) value_.store(n, std::memory_order_relaxed);
+    }
+    std::uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+    void clear() { value_.store(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::uint64_t> value_{0};
+};
+
+struct Recorder;
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<Recorder*> live;
+    Report finished{};  // of threads that have exited
+    std::vector<std::pair<std::uint32_t, Span>> finished_spans;
+    std::uint32_t next_thread{0};
+    std::chrono::steady_clock::time_point origin{std::chrono::steady_clock::now()};
+
+    static Registry& get() {
+        static Registry registry;
+        return registry;
+    }
+};
+
+inline std::uint64_t now_ns() {
+    auto elapsed = std::chrono::steady_clock::now() - Registry::get().origin;
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+struct Recorder {
+    std::array<Counter, op_count> count;
+    std::array<Counter, op_count> forward_samples;
+    std::array<Counter, op_count> forward_ns;  // of the samples
+    std::array<Counter, op_count> backward_count;
+    std::array<Counter, op_count> backward_samples;
+    std::array<Counter, op_count> backward_ns;  // of the samples
+    Counter nodes_created;
+    Counter nodes_freed;
+    Counter bytes_allocated;
+    Counter sorts;
+    Counter sorted_nodes;
+    Counter sort_ns;
+    Counter max_depth;
+    Counter dropped_spans;
+    std::mutex spans_mutex;  // uncontended except while exporting
+    std::vector<Span> spans;
+    std::uint32_t thread{0};
+    std::uint32_t countdown{1};  // ops until the next sample
+    std::uint32_t random{0x9e3779b9u};
+
+    // Whether to time this op. The gaps between samples are uniform in [1, 2 * period - 1].
+    bool sample() {
+        if (--countdown != 0) [[likely]] return false;
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        auto period = sample_period.load(std::memory_order_relaxed);
+        countdown = period <= 1 ? 1 : 1 + random % (2 * period - 1);
+        return true;
+    }
+
+    struct Unregistered {};
+    explicit Recorder(Unregistered) {}
+
+    Recorder() {
+        auto& registry = Registry::get();
+        std::lock_guard lock(registry.mutex);
+        thread = registry.next_thread++;
+        registry.live.push_back(this);
+    }
+
+    ~Recorder() {
+        destroyed() = true;
+        auto& registry = Registry::get();
+        std::lock_guard lock(registry.mutex);
+        add_to(registry.finished);
+        for (auto& span : spans) registry.finished_spans.emplace_back(thread, span);
+        registry.live.erase(std::find(registry.live.begin(), registry.live.end(), this));
+    }
+
+    void add_to(Report& r) const {
+        auto estimate = [](std::uint64_t ns, std::uint64_t samples, std::uint64_t count) {
+            return samples ? std::uint64_t(double(ns) * double(count) / double(samples)) : 0;
+        };
+        for (std::size_t i = 0; i < op_count; ++i) {
+            r.ops[i].count += count[i].get();
+            r.ops[i].forward_ns += estimate(forward_ns[i].get(), forward_samples[i].get(), count[i].get());
+            r.ops[i].backward_count += backward_count[i].get();
+            r.ops[i].backward_ns += estimate(backward_ns[i].get(), backward_samples[i].get(), backward_count[i].get());
+        }
+        r.nodes_created += nodes_created.get();
+        r.nodes_freed += nodes_freed.get();
+        r.bytes_allocated += bytes_allocated.get();
+        r.sorts += sorts.get();
+        r.sorted_nodes += sorted_nodes.get();
+        r.sort_ns += sort_ns.get();
+        r.max_depth = std::max(r.max_depth, max_depth.get());
+        r.dropped_spans += dropped_spans.get();
+    }
+
+    void clear() {
+        for (auto* counters : {&count, &forward_samples, &forward_ns, &backward_count, &backward_samples, &backward_ns}) {
+            for (auto& c : *counters) c.clear();
+        }
+        for (auto* c : {&nodes_created, &nodes_freed, &bytes_allocated, &sorts, &sorted_nodes, &sort_ns,
+                        &max_depth, &dropped_spans}) {
+            c->clear();
+        }
+        countdown = 1;
+        std::lock_guard lock(spans_mutex);
+        spans.clear();
+    }
+
+    void span(const char* name, std::uint64_t begin, std::uint64_t end) {
+        if (spans.size() == max_spans) return dropped_spans.add(1);
+        std::lock_guard lock(spans_mutex);
+        spans.push_back({name, begin, end - begin});
+    }
+
+    static Recorder& local() {
+        // Nodes can be freed after the thread's recorder (e.g. by destructors of statics at exit);
+        // what they record then is discarded
+        if (destroyed()) [[unlikely]] {
+            static auto discarded = new Recorder(Unregistered{});
+            return *discarded;
+        }
+        thread_local Recorder recorder;
+        return recorder;
+    }
+
+    static bool& destroyed() {
+        thread_local bool destroyed = false;
+        return destroyed;
+    }
+};
+
+// Allocator for heap nodes (std::allocate_shared), which counts the bytes of node and control block
+template<typename U>
+struct CountingAllocator {
+    using value_type = U;
+    CountingAllocator() = default;
+    template<typename V>
+    CountingAllocator(const CountingAllocator<V>&) {}
+    U* allocate(std::size_t n) {
+        Recorder::local().bytes_allocated.add(n * sizeof(U));
+        return std::allocator<U>().allocate(n);
+    }
+    void deallocate(U* p, std::size_t n) { std::allocator<U>().deallocate(p, n); }
+    template<typename V>
+    bool operator==(const CountingAllocator<V>&) const { return true; }
+};
+
+} // namespace detail
+
+// Hooks for Value
+
+inline void node_created(Op op) {
+    auto& recorder = detail::Recorder::local();
+    recorder.nodes_created.add(1);
+    recorder.count[std::size_t(op)].add(1);
+}
+
+inline void node_freed() {
+    detail::Recorder::local().nodes_freed.add(1);
+}
+
+inline void allocated(std::size_t bytes) {
+    detail::Recorder::local().bytes_allocated.add(bytes);
+}
+
+// Counts a backward op, and if it is sampled, adds the time from construction to destruction to
+// the forward or backward time of its op
+class OpTimer
+{
+public:
+    OpTimer(Op op, Pass pass) : recorder_{detail::Recorder::local()}, op_{op}, pass_{pass} {
+        if (pass == Pass::backward) recorder_.backward_count[std::size_t(op)].add(1);
+        if (recorder_.sample()) [[unlikely]] begin_ = detail::now_ns();
+    }
+    ~OpTimer() {
+        if (begin_ == none) [[likely]] return;
+        auto elapsed = detail::now_ns() - begin_;
+        auto i = std::size_t(op_);
+        if (pass_ == Pass::backward) {
+            recorder_.backward_samples[i].add(1);
+            recorder_.backward_ns[i].add(elapsed);
+        } else {
+            recorder_.forward_samples[i].add(1);
+            recorder_.forward_ns[i].add(elapsed);
+        }
+    }
+    OpTimer(const OpTimer&) = delete;
+    OpTimer& operator=(const OpTimer&) = delete;
+
+private:
+    static constexpr std::uint64_t none = ~std::uint64_t(0);
+
+    detail::Recorder& recorder_;
+    Op op_;
+    Pass pass_;
+    std::uint64_t begin_{none};
+};
+
+// Times a topological sort (as a span too), and measures its size and depth when it is done
+class SortTimer
+{
+public:
+    SortTimer() : begin_{detail::now_ns()} {}
+
+    // Uses the nodes' index as scratch, which nobody relies on across a sort
+    template<typename Node>
+    void sorted(const std::vector<Node*>& order) {
+        auto end = detail::now_ns();
+        auto& recorder = detail::Recorder::local();
+        recorder.sorts.add(1);
+        recorder.sorted_nodes.add(order.size());
+        recorder.sort_ns.add(end - begin_);
+        recorder.span("topological_order", begin_, end);
+        std::uint32_t depth = 0;
+        for (auto node : order) {  // children first
+            node->index = 1 + std::max(node->child1 ? node->child1->index : 0, node->child2 ? node->child2->index : 0);
+            depth = std::max(depth, node->index);
+        }
+        recorder.max_depth.raise(depth);
+    }
+
+private:
+    std::uint64_t begin_;
+};
+
+inline Report report() {
+    auto& registry = detail::Registry::get();
+    std::lock_guard lock(registry.mutex);
+    Report out = registry.finished;
+    for (auto recorder : registry.live) recorder->add_to(out);
+    return out;
+}
+
+inline void reset() {
+    auto& registry = detail::Registry::get();
+    std::lock_guard lock(registry.mutex);
+    registry.finished = Report{};
+    registry.finished_spans.clear();
+    for (auto recorder : registry.live) recorder->clear();
+}
+
+inline void write_counters(std::ostream& os, const Report& report) {
+    os << "op          count    forward ms   backward    backward ms\n";
+    for (std::size_t i = 0; i < op_count; ++i) {
+        auto& op = report.ops[i];
+        if (op.count == 0 && op.backward_count == 0) continue;
+        auto name = std::string(op_str(Op(i)));
+        os << name << std::string(name.size() < 8 ? 8 - name.size() : 1, ' ')
+           << std::setw(9) << op.count << std::setw(14) << std::fixed << std::setprecision(3) << double(op.forward_ns) * 1e-6
+           << std::setw(11) << op.backward_count << std::setw(15) << double(op.backward_ns) * 1e-6 << "\n";
+    }
+    os << "nodes created " << report.nodes_created << ", freed " << report.nodes_freed << ", "
+       << report.bytes_allocated << " bytes allocated\n"
+       << "topological sorts " << report.sorts << " (" << report.sorted_nodes << " nodes, "
+       << double(report.sort_ns) * 1e-6 << " ms), max depth " << report.max_depth << "\n";
+    if (report.dropped_spans) os << report.dropped_spans << " spans dropped\n";
+}
+
+inline void write_chrome_trace(std::ostream& os) {
+    auto counters = report();
+    auto& registry = detail::Registry::get();
+    std::lock_guard lock(registry.mutex);
+    auto now = detail::now_ns();
+    bool first = true;
+    auto event = [&](std::uint32_t thread, const detail::Span& span) {
+        os << (first ? "\n" : ",\n") << R"({"name":")" << span.name << R"(","ph":"X","pid":1,"tid":)" << thread
+           << R"(,"ts":)" << double(span.begin_ns) * 1e-3 << R"(,"dur":)" << double(span.duration_ns) * 1e-3 << "}";
+        first = false;
+    };
+    os << std::fixed << std::setprecision(3) << R"({"traceEvents":[)";
+    for (auto& [thread, span] : registry.finished_spans) event(thread, span);
+    for (auto recorder : registry.live) {
+        std::lock_guard spans_lock(recorder->spans_mutex);
+        for (auto& span : recorder->spans) event(recorder->thread, span);
+    }
+    // The counters as counter events at the end of the trace
+    auto counter = [&](const char* name, auto&& write_args) {
+        os << (first ? "\n" : ",\n") << R"({"name":")" << name << R"(","ph":"C","pid":1,"ts":)" << double(now) * 1e-3
+           << R"(,"args":{)";
+        write_args();
+        os << "}}";
+        first = false;
+    };
+    auto per_op = [&](auto field) {
+        return [&, field] {
+            bool first_arg = true;
+            for (std::size_t i = 0; i < op_count; ++i) {
+                if (counters.ops[i].count == 0 && counters.ops[i].backward_count == 0) continue;
+                os << (first_arg ? "" : ",") << '"' << op_str(Op(i)) << R"(":)" << counters.ops[i].*field;
+                first_arg = false;
+            }
+        };
+    };
+    counter("op count", per_op(&OpStats::count));
+    counter("op forward ns", per_op(&OpStats::forward_ns));
+    counter("op backward ns", per_op(&OpStats::backward_ns));
+    counter("nodes", [&] {
+        os << R"("created":)" << counters.nodes_created << R"(,"freed":)" << counters.nodes_freed
+           << R"(,"bytes allocated":)" << counters.bytes_allocated;
+    });
+    counter("topological sorts", [&] {
+        os << R"("sorts":)" << counters.sorts << R"(,"nodes":)" << counters.sorted_nodes
+           << R"(,"ns":)" << counters.sort_ns << R"(,"max depth":)" << counters.max_depth;
+    });
+    os << "\n]}\n";
+}
+
+inline void sample_every(std::uint32_t ops) {
+    detail::sample_period.store(ops ? ops : 1, std::memory_order_relaxed);
+}
+
+inline Scope::Scope(const char* name) : name_{name}, begin_{detail::now_ns()} {}
+
+inline Scope::~Scope() {
+    detail::Recorder::local().span(name_, begin_, detail::now_ns());
+}
+
+#else
+
+// The same hooks, doing nothing
+
+inline Report report() { return {}; }
+inline void reset() {}
+inline void sample_every(std::uint32_t) {}
+
+class Scope
+{
+public:
+    explicit Scope(const char*) {}
+};
+
+inline void node_created(Op) {}
+inline void node_freed() {}
+inline void allocated(std::size_t) {}
+
+class OpTimer
+{
+public:
+    OpTimer(Op, Pass) {}
+};
+
+class SortTimer
+{
+public:
+    template<typename Node>
+    void sorted(const std::vector<Node*>&) {}
+};
+
+#endif
+
+} // namespace ajs::profile
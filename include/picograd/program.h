@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>        // std::fill
+#include <cstddef>          // std::size_t
+#include <cstdint>
+#include <limits>
+#include <memory>           // smart pointers
+#include <stdexcept>        // std::invalid_argument
+#include <vector>
+
+#include "ops.h"
+
+namespace ajs {
+
+template<typename T>
+class Value;
+
+// A Value graph compiled into a flat program, for models that evaluate the same expression over
+// and over (e.g. once per sample). Build the graph once with Value operations, compile it, and
+// then re-run forward() and backward() on new leaf data (set with set_data() on the leaf Values,
+// like for Value::Order) without building any nodes.
+//
+// The program is stored as structure of arrays: every leaf and every operation gets a slot in one
+// contiguous data and one grad buffer, and operation i is described by op(i), the slots of its
+// operands, and its constant parameter. The leaves come first, then the operations in topological
+// order, so forward() is a single pass over the arrays, and backward() a single pass in reverse.
+//
+// The program refers to the leaves of the graph (it reads their data and accumulates into their
+// gradients), but not to the rest of it. Leaves that live on a Tape must outlive the program.
+// Graphs with linear nodes (from lazy expressions) cannot be compiled, since those cannot be re-run.
+template<typename T>
+class Program
+{
+    using Node = typename Value<T>::Node;
+
+public:
+    static constexpr std::uint32_t no_operand = std::numeric_limits<std::uint32_t>::max();
+
+    explicit Program(const Value<T>& output);
+    // A program from its instruction stream (e.g. loaded from a file, see serialize.h), with new
+    // leaf Values holding leaf_data. Throws std::invalid_argument if an operation is not one that
+    // programs run, or an operand is not an earlier slot.
+    Program(const std::vector<T>& leaf_data, std::vector<Op> op, std::vector<std::uint32_t> operand1,
+            std::vector<std::uint32_t> operand2, std::vector<T> param);
+
+    T forward();  // reads the leaves' data, returns the output's new data
+    void backward();  // accumulates into the leaves' gradients, like Value::backward()
+
+    std::size_t size() const;  // number of operations
+    std::size_t leaves() const;
+    Value<T> leaf(std::size_t i) const;  // the Value read into slot i
+    T output() const;  // result of the last forward()
+
+    // The instruction stream (slots below leaves() are leaves, slot leaves() + i holds operation i)
+    Op op(std::size_t i) const;
+    std::uint32_t operand1(std::size_t i) const;
+    std::uint32_t operand2(std::size_t i) const;  // no_operand for unary ops (which use param(i))
+    T param(std::size_t i) const;
+
+private:
+    std::vector<std::shared_ptr<Node>> leaf_nodes_;
+    std::vector<Op> op_;
+    std::vector<std::uint32_t> operand1_;
+    std::vector<std::uint32_t> operand2_;
+    std::vector<T> param_;
+    std::vector<T> data_;  // leaves, then operations
+    std::vector<T> grad_;
+};
+
+
+template<typename T>
+Program<T>::Program(const Value<T>& output) {
+    std::vector<Node*> topo;
+    Value<T>::topological_order(output.node_.get(), topo);
+    // Number the leaves first and the operations after them, in topological order (in the nodes'
+    // scratch index), so that every operation comes after its operands
+    std::uint32_t slot = 0;
+    for (auto node : topo) {
+        if (node->op == Op::none) node->index = slot++;
+    }
+    leaf_nodes_.resize(slot);
+    if (output.node_->op == Op::none) leaf_nodes_[0] = output.node_;
+    op_.reserve(topo.size() - slot);
+    for (auto node : topo) {
+        if (node->op == Op::none) continue;
+        if (node->op == Op::linear) throw std::invalid_argument("Program cannot compile linear nodes");
+        // The owning pointers to the leaves are the ones held by the operations using them
+        for (auto& child : {node->child1, node->child2}) {
+            if (child && child->op == Op::none) leaf_nodes_[child->index] = child;
+        }
+        node->index = slot++;
+        op_.push_back(node->op);
+        operand1_.push_back(node->child1->index);
+        operand2_.push_back(node->child2 ? node->child2->index : no_operand);
+        param_.push_back(node->param);
+    }
+    data_.resize(slot);
+    grad_.resize(slot);
+    forward();
+}
+
+template<typename T>
+Program<T>::Program(const std::vector<T>& leaf_data, std::vector<Op> op, std::vector<std::uint32_t> operand1,
+                    std::vector<std::uint32_t> operand2, std::vector<T> param)
+    : op_{std::move(op)}, operand1_{std::move(operand1)}, operand2_{std::move(operand2)}, param_{std::move(param)} {
+    auto n = op_.size();
+    if (operand1_.size() != n || operand2_.size() != n || param_.size() != n) {
+        throw std::invalid_argument("Program instruction arrays differ in length");
+    }
+    if (leaf_data.size() + n == 0 || leaf_data.size() + n > no_operand) {
+        throw std::invalid_argument("Program must have between 1 and 2^32 - 1 slots");
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+        auto slot = leaf_data.size() + i;
+        bool binary = operand2_[i] != no_operand;
+        if (op_[i] < Op::add || op_[i] > Op::sigmoid) throw std::invalid_argument("Program cannot run this op");
+        if (operand1_[i] >= slot || (binary && operand2_[i] >= slot)) {
+            throw std::invalid_argument("Program operand is not an earlier slot");
+        }
+    }
+    for (auto data : leaf_data) leaf_nodes_.push_back(std::make_shared<Node>(data));
+    data_.resize(leaf_data.size() + n);
+    grad_.resize(leaf_data.size() + n);
+    forward();
+}
+
+template<typename T>
+T Program<T>::forward() {
+    auto n_leaves = leaf_nodes_.size();
+    for (std::size_t l = 0; l < n_leaves; ++l) {
+        data_[l] = leaf_nodes_[l]->data;
+    }
+    for (std::size_t i = 0; i < op_.size(); ++i) {
+        auto b = operand2_[i] != no_operand ? data_[operand2_[i]] : param_[i];
+        data_[n_leaves + i] = kernels::forward(op_[i], data_[operand1_[i]], b);
+    }
+    return data_.back();
+}
+
+template<typename T>
+void Program<T>::backward() {
+    auto n_leaves = leaf_nodes_.size();
+    std::fill(grad_.begin(), grad_.end(), T(0));
+    grad_.back() = 1;
+    T unused_grad{0};
+    for (auto i = op_.size(); i-- > 0; ) {
+        auto slot = n_leaves + i;
+        bool binary = operand2_[i] != no_operand;
+        kernels::backward(op_[i], data_[slot], grad_[slot],
+                          data_[operand1_[i]], binary ? data_[operand2_[i]] : param_[i],
+                          grad_[operand1_[i]], binary ? grad_[operand2_[i]] : unused_grad);
+    }
+    for (std::size_t l = 0; l < n_leaves; ++l) {
+        if (leaf_nodes_[l]->requires_grad) leaf_nodes_[l]->grad += grad_[l];  // not into frozen leaves
+    }
+}
+
+template<typename T>
+std::size_t Program<T>::size() const {
+    return op_.size();
+}
+
+template<typename T>
+std::size_t Program<T>::leaves() const {
+    return leaf_nodes_.size();
+}
+
+template<typename T>
+Value<T> Program<T>::leaf(std::size_t i) const {
+    return Value<T>(leaf_nodes_[i]);
+}
+
+template<typename T>
+T Program<T>::output() const {
+    return data_.back();
+}
+
+template<typename T>
+Op Program<T>::op(std::size_t i) const {
+    return op_[i];
+}
+
+template<typename T>
+std::uint32_t Program<T>::operand1(std::size_t i) const {
+    return operand1_[i];
+}
+
+template<typename T>
+std::uint32_t Program<T>::operand2(std::size_t i) const {
+    return operand2_[i];
+}
+
+template<typename T>
+T Program<T>::param(std::size_t i) const {
+    return param_[i];
+}
+
+} // namespace ajs
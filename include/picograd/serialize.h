@@ -0,0 +1,470 @@
+#pragma once
+
+#include <algorithm>        // std::min, std::transform
+#include <bit>              // std::endian
+#include <cstddef>          // std::size_t, std::byte
+#include <cstdint>
+#include <cstring>          // std::memcpy, std::strlen
+#include <fstream>
+#include <memory>           // smart pointers
+#include <span>
+#include <stdexcept>        // std::invalid_argument, std::runtime_error
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>          // open
+#include <sys/mman.h>       // mmap
+#include <sys/stat.h>       // fstat
+#include <unistd.h>         // close
+#define PICOGRAD_MMAP 1
+#endif
+
+#include "half.h"
+#include "parameters.h"
+#include "program.h"
+#include "tensor.h"
+#include "value.h"
+
+namespace ajs::serialize {
+
+// A binary file of named arrays: parameter tensors, the parameters of a ParameterSet or a model,
+// or the instruction stream of a compiled Program. All fields are little-endian, and every array
+// starts at a multiple of 64 bytes from the start of the file:
+//
+//     header   "PICOGRAD", u32 version, u32 number of entries, u64 file size, padding to 64 bytes
+//     entries  128 bytes each: name (NUL-padded, up to 63 characters), u32 dtype, u32 rank,
+//              u64 shape[4], u64 offset of the data, u64 size of the data in bytes, padding
+//     data     the arrays, row-major
+//
+// MappedFile maps a file into memory and checks the header and the entry table, but neither parses
+// nor copies the data: get() returns a span over the mapping, which can be used in place (e.g. as
+// the weights of a gemm::nn() call). So opening a model costs the same whatever its size, and pages
+// are only read from disk when they are first touched. Loading into Tensors, ParameterSets and
+// Programs copies, since those own their storage.
+//
+//     serialize::Writer writer;
+//     writer.add("mlp", model.parameters());
+//     writer.add("w1", w1);  // a Tensor
+//     writer.save("model.bin");
+//
+//     serialize::MappedFile file("model.bin");
+//     file.load("mlp", model.parameters());
+//     std::span<const float> w1 = file.get<float>("w1");
+//
+// Parameters can be stored in reduced precision, which halves the file (and what is read from it)
+// for inference: writer.add("mlp", model.parameters(), DType::bf16). load() converts from any
+// floating point type.
+//
+// Errors (I/O, malformed files) throw std::runtime_error; using an entry as something it is not
+// (missing name, wrong type or size) throws std::invalid_argument.
+
+static_assert(std::endian::native == std::endian::little, "serialize.h maps little-endian data in place");
+
+constexpr std::uint32_t version = 1;
+constexpr std::size_t alignment = 64;
+constexpr std::size_t max_rank = 4;
+constexpr std::size_t max_name = 63;
+
+enum class DType : std::uint32_t { f32 = 1, f64 = 2, u8 = 3, u32 = 4, bf16 = 5, f16 = 6 };  // see half.h
+
+template<typename T>
+constexpr DType dtype_of();
+
+using Shape = std::vector<std::size_t>;
+
+class Writer
+{
+public:
+    // The array is copied, so the source may change before save()
+    template<typename T>
+    void add(const std::string& name, std::span<const T> data, Shape shape={});  // shape {size} by default
+    template<typename T>
+    void add(const std::string& name, const std::vector<T>& data, Shape shape={}) {
+        add(name, std::span<const T>(data), std::move(shape));
+    }
+    template<typename T>
+    void add(const std::string& name, const Tensor<T>& tensor);
+    template<typename T>
+    void add(const std::string& name, const ParameterView<T>& parameters, DType dtype=dtype_of<T>());  // rounded to dtype
+    template<typename T>
+    void add(const std::string& name, ParameterSet<T>& parameters, DType dtype=dtype_of<T>());
+    // As the arrays name.leaves (the leaves' current data), name.op, name.operand1, name.operand2
+    // and name.param
+    template<typename T>
+    void add(const std::string& name, const Program<T>& program);
+
+    void save(const std::string& path) const;
+
+private:
+    struct Array {
+        std::string name;
+        DType dtype;
+        Shape shape;
+        std::vector<std::byte> data;
+    };
+    std::vector<Array> arrays_;
+};
+
+class MappedFile
+{
+public:
+    struct Entry {
+        std::string_view name;
+        DType dtype;
+        Shape shape;
+        const std::byte* data;
+        std::size_t bytes;
+    };
+
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    std::size_t size() const { return entries_.size(); }  // number of arrays
+    const Entry& operator[](std::size_t i) const { return entries_[i]; }
+    const Entry* find(std::string_view name) const;  // nullptr if there is no such array
+    const Entry& at(std::string_view name) const;  // throws std::invalid_argument if there is no such array
+
+    // The data in place; valid as long as the file is
+    template<typename T>
+    std::span<const T> get(std::string_view name) const;
+
+    template<typename T>
+    Tensor<T> tensor(std::string_view name) const;
+    template<typename T>
+    void load(std::string_view name, const ParameterView<T>& parameters) const;  // sizes must match; converts
+    template<typename T>
+    void load(std::string_view name, ParameterSet<T>& parameters) const;
+    template<typename T>
+    Program<T> program(std::string_view name) const;
+
+private:
+    const std::byte* base_{nullptr};
+    std::size_t file_size_{0};
+    std::vector<std::uint64_t> buffer_;  // where there is no mmap, the file is read into this (8-byte aligned)
+    std::vector<Entry> entries_;
+};
+
+
+namespace detail {
+
+struct FileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t entries;
+    std::uint64_t file_size;
+    std::uint8_t padding[alignment - 24];
+};
+
+struct FileEntry {
+    char name[max_name + 1];
+    std::uint32_t dtype;
+    std::uint32_t rank;
+    std::uint64_t shape[max_rank];
+    std::uint64_t offset;
+    std::uint64_t bytes;
+    std::uint8_t padding[8];
+};
+
+static_assert(sizeof(FileHeader) == 64 && sizeof(FileEntry) == 128);
+
+constexpr char magic[8] = {'P', 'I', 'C', 'O', 'G', 'R', 'A', 'D'};
+
+inline std::size_t dtype_size(DType dtype) {
+    switch (dtype) {
+    case DType::f32:
+    case DType::u32:
+        return 4;
+    case DType::f64:
+        return 8;
+    case DType::u8:
+        return 1;
+    case DType::bf16:
+    case DType::f16:
+        return 2;
+    }
+    return 0;
+}
+
+inline std::size_t aligned(std::size_t offset) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+} // namespace detail
+
+template<typename T>
+constexpr DType dtype_of() {
+    if constexpr (std::is_same_v<T, float>) return DType::f32;
+    else if constexpr (std::is_same_v<T, double>) return DType::f64;
+    else if constexpr (std::is_same_v<T, std::uint8_t>) return DType::u8;
+    else if constexpr (std::is_same_v<T, std::uint32_t>) return DType::u32;
+    else if constexpr (std::is_same_v<T, bfloat16>) return DType::bf16;
+    else if constexpr (std::is_same_v<T, float16>) return DType::f16;
+    else static_assert(sizeof(T) == 0, "serialize.h stores float, double, bfloat16, float16, std::uint8_t and std::uint32_t");
+}
+
+template<typename T>
+void Writer::add(const std::string& name, std::span<const T> data, Shape shape) {
+    if (name.empty() || name.size() > max_name) throw std::invalid_argument("array names must have 1 to 63 characters");
+    for (auto& array : arrays_) {
+        if (array.name == name) throw std::invalid_argument("duplicate array name " + name);
+    }
+    if (shape.empty()) shape = {data.size()};
+    std::size_t size = 1;
+    for (auto n : shape) size *= n;
+    if (shape.size() > max_rank || size != data.size()) throw std::invalid_argument("bad shape for array " + name);
+    Array array{name, dtype_of<T>(), std::move(shape), std::vector<std::byte>(data.size_bytes())};
+    if (!data.empty()) std::memcpy(array.data.data(), data.data(), data.size_bytes());
+    arrays_.push_back(std::move(array));
+}
+
+template<typename T>
+void Writer::add(const std::string& name, const Tensor<T>& tensor) {
+    auto shape = tensor.shape();
+    if (shape.empty()) shape = {1};  // 0-dimensional
+    add(name, std::span<const T>(tensor.get_data()), shape);
+}
+
+template<typename T>
+void Writer::add(const std::string& name, const ParameterView<T>& parameters, DType dtype) {
+    std::vector<T> data;
+    data.reserve(parameters.size());
+    parameters.set().for_each(parameters.offset(), parameters.offset() + parameters.size(),
+                              [&](std::size_t, T& d, T&) { data.push_back(d); });
+    auto add_as = [&]<typename S>(S) {
+        std::vector<S> stored(data.size());
+        convert(std::span<const T>(data), std::span<S>(stored));
+        add(name, stored);
+    };
+    switch (dtype) {
+    case DType::f32:
+        return add_as(float{});
+    case DType::f64:
+        return add_as(double{});
+    case DType::bf16:
+        return add_as(bfloat16{});
+    case DType::f16:
+        return add_as(float16{});
+    default:
+        throw std::invalid_argument("parameters are stored as f32, f64, bf16 or f16");
+    }
+}
+
+template<typename T>
+void Writer::add(const std::string& name, ParameterSet<T>& parameters, DType dtype) {
+    add(name, ParameterView<T>(parameters, 0, parameters.size()), dtype);
+}
+
+template<typename T>
+void Writer::add(const std::string& name, const Program<T>& program) {
+    std::vector<T> leaves;
+    for (std::size_t i = 0; i < program.leaves(); ++i) leaves.push_back(program.leaf(i).get_data());
+    std::vector<std::uint8_t> op;
+    std::vector<std::uint32_t> operand1;
+    std::vector<std::uint32_t> operand2;
+    std::vector<T> param;
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        op.push_back(std::uint8_t(program.op(i)));
+        operand1.push_back(program.operand1(i));
+        operand2.push_back(program.operand2(i));
+        param.push_back(program.param(i));
+    }
+    add(name + ".leaves", leaves);
+    add(name + ".op", op);
+    add(name + ".operand1", operand1);
+    add(name + ".operand2", operand2);
+    add(name + ".param", param);
+}
+
+inline void Writer::save(const std::string& path) const {
+    std::vector<detail::FileEntry> entries(arrays_.size());
+    std::size_t offset = detail::aligned(sizeof(detail::FileHeader) + entries.size() * sizeof(detail::FileEntry));
+    for (std::size_t i = 0; i < arrays_.size(); ++i) {
+        auto& array = arrays_[i];
+        auto& entry = entries[i];
+        std::memset(&entry, 0, sizeof(entry));
+        std::memcpy(entry.name, array.name.data(), array.name.size());
+        entry.dtype = std::uint32_t(array.dtype);
+        entry.rank = std::uint32_t(array.shape.size());
+        for (std::size_t d = 0; d < array.shape.size(); ++d) entry.shape[d] = array.shape[d];
+        entry.offset = offset;
+        entry.bytes = array.data.size();
+        offset = detail::aligned(offset + array.data.size());
+    }
+    detail::FileHeader header{};
+    std::memcpy(header.magic, detail::magic, sizeof(header.magic));
+    header.version = version;
+    header.entries = std::uint32_t(entries.size());
+    header.file_size = offset;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("cannot open " + path + " for writing");
+    const char zeros[alignment] = {};
+    std::size_t written = sizeof(header) + entries.size() * sizeof(detail::FileEntry);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(entries.data()), std::streamsize(entries.size() * sizeof(detail::FileEntry)));
+    for (std::size_t i = 0; i < arrays_.size(); ++i) {
+        out.write(zeros, std::streamsize(entries[i].offset - written));
+        out.write(reinterpret_cast<const char*>(arrays_[i].data.data()), std::streamsize(arrays_[i].data.size()));
+        written = entries[i].offset + arrays_[i].data.size();
+    }
+    out.write(zeros, std::streamsize(offset - written));
+    if (!out.flush()) throw std::runtime_error("cannot write " + path);
+}
+
+inline MappedFile::MappedFile(const std::string& path) {
+#ifdef PICOGRAD_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("cannot open " + path);
+    struct stat status;
+    if (::fstat(fd, &status) != 0) {
+        ::close(fd);
+        throw std::runtime_error("cannot stat " + path);
+    }
+    file_size_ = std::size_t(status.st_size);
+    if (file_size_ > 0) {
+        void* mapping = ::mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) throw std::runtime_error("cannot map " + path);
+        base_ = static_cast<const std::byte*>(mapping);
+    } else {
+        ::close(fd);
+    }
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) throw std::runtime_error("cannot open " + path);
+    file_size_ = std::size_t(in.tellg());
+    buffer_.resize((file_size_ + 7) / 8);
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char*>(buffer_.data()), std::streamsize(file_size_))) {
+        throw std::runtime_error("cannot read " + path);
+    }
+    base_ = reinterpret_cast<const std::byte*>(buffer_.data());
+#endif
+
+    // Check everything that get() relies on, once, so that get() needs no checks but a lookup
+    try {
+        detail::FileHeader header;
+        if (file_size_ < sizeof(header)) throw std::runtime_error(path + " is not a picograd file");
+        std::memcpy(&header, base_, sizeof(header));
+        if (std::memcmp(header.magic, detail::magic, sizeof(header.magic)) != 0) {
+            throw std::runtime_error(path + " is not a picograd file");
+        }
+        if (header.version != version) {
+            throw std::runtime_error(path + " has unsupported version " + std::to_string(header.version));
+        }
+        if (header.file_size != file_size_) throw std::runtime_error(path + " is truncated");
+        if (header.entries > (file_size_ - sizeof(header)) / sizeof(detail::FileEntry)) {
+            throw std::runtime_error(path + " has a corrupt entry table");
+        }
+        entries_.reserve(header.entries);
+        for (std::size_t i = 0; i < header.entries; ++i) {
+            detail::FileEntry entry;
+            std::memcpy(&entry, base_ + sizeof(header) + i * sizeof(entry), sizeof(entry));
+            auto dtype = DType(entry.dtype);
+            auto item = detail::dtype_size(dtype);
+            std::uint64_t count = 1;
+            for (std::size_t d = 0; d < std::min<std::size_t>(entry.rank, max_rank); ++d) {
+                // Saturates at more than fits into the file, instead of overflowing
+                if (entry.shape[d] != 0 && count > (file_size_ + 1) / entry.shape[d]) count = file_size_ + 1;
+                else count *= entry.shape[d];
+            }
+            if (entry.name[max_name] != '\0' || item == 0 || entry.rank > max_rank || entry.offset % alignment != 0
+                || entry.offset > file_size_ || entry.bytes > file_size_ - entry.offset || count * item != entry.bytes) {
+                throw std::runtime_error(path + " has a corrupt entry " + std::to_string(i));
+            }
+            auto name = reinterpret_cast<const char*>(base_ + sizeof(header) + i * sizeof(entry));
+            entries_.push_back(Entry{std::string_view(name, std::strlen(name)), dtype,
+                                     Shape(entry.shape, entry.shape + entry.rank), base_ + entry.offset,
+                                     std::size_t(entry.bytes)});
+        }
+    } catch (...) {
+#ifdef PICOGRAD_MMAP
+        if (base_) ::munmap(const_cast<std::byte*>(base_), file_size_);
+#endif
+        throw;
+    }
+}
+
+inline MappedFile::~MappedFile() {
+#ifdef PICOGRAD_MMAP
+    if (base_) ::munmap(const_cast<std::byte*>(base_), file_size_);
+#endif
+}
+
+inline const MappedFile::Entry* MappedFile::find(std::string_view name) const {
+    for (auto& entry : entries_) {
+        if (entry.name == name) return &entry;
+    }
+    return nullptr;
+}
+
+inline const MappedFile::Entry& MappedFile::at(std::string_view name) const {
+    auto entry = find(name);
+    if (!entry) throw std::invalid_argument("no array named " + std::string(name));
+    return *entry;
+}
+
+template<typename T>
+std::span<const T> MappedFile::get(std::string_view name) const {
+    auto& entry = at(name);
+    if (entry.dtype != dtype_of<T>()) throw std::invalid_argument("array " + std::string(name) + " has another type");
+    return std::span<const T>(reinterpret_cast<const T*>(entry.data), entry.bytes / sizeof(T));
+}
+
+template<typename T>
+Tensor<T> MappedFile::tensor(std::string_view name) const {
+    auto data = get<T>(name);
+    return Tensor<T>(at(name).shape, std::vector<T>(data.begin(), data.end()));
+}
+
+template<typename T>
+void MappedFile::load(std::string_view name, const ParameterView<T>& parameters) const {
+    auto load_from = [&]<typename S>(S) {
+        auto data = get<S>(name);
+        if (data.size() != parameters.size()) {
+            throw std::invalid_argument("array " + std::string(name) + " does not have one value per parameter");
+        }
+        parameters.set().for_each(parameters.offset(), parameters.offset() + parameters.size(),
+                                  [&](std::size_t i, T& d, T&) { d = T(data[i - parameters.offset()]); });
+    };
+    switch (at(name).dtype) {
+    case DType::f32:
+        return load_from(float{});
+    case DType::f64:
+        return load_from(double{});
+    case DType::bf16:
+        return load_from(bfloat16{});
+    case DType::f16:
+        return load_from(float16{});
+    default:
+        throw std::invalid_argument("array " + std::string(name) + " is not floating point");
+    }
+}
+
+template<typename T>
+void MappedFile::load(std::string_view name, ParameterSet<T>& parameters) const {
+    load(name, ParameterView<T>(parameters, 0, parameters.size()));
+}
+
+template<typename T>
+Program<T> MappedFile::program(std::string_view name) const {
+    std::string prefix(name);
+    auto leaves = get<T>(prefix + ".leaves");
+    auto op = get<std::uint8_t>(prefix + ".op");
+    std::vector<Op> ops(op.size());
+    std::transform(op.begin(), op.end(), ops.begin(), [](std::uint8_t o) { return Op(o); });
+    auto operand1 = get<std::uint32_t>(prefix + ".operand1");
+    auto operand2 = get<std::uint32_t>(prefix + ".operand2");
+    auto param = get<T>(prefix + ".param");
+    return Program<T>(std::vector<T>(leaves.begin(), leaves.end()), std::move(ops),
+                      std::vector<std::uint32_t>(operand1.begin(), operand1.end()),
+                      std::vector<std::uint32_t>(operand2.begin(), operand2.end()),
+                      std::vector<T>(param.begin(), param.end()));
+}
+
+} // namespace ajs::serialize
@@ -0,0 +1,533 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>          // std::size_t
+#include <cstdint>
+#include <cstring>          // std::memcpy
+#include <limits>
+#include <type_traits>
+#include <utility>          // std::index_sequence
+
+#include "ops.h"
+
+// Batched (array-at-a-time) versions of the activation kernels in ops.h, for float and double.
+// The vector code is written once with GCC/Clang vector extensions and instantiated for AVX2 and
+// AVX-512 (x86-64) or NEON (AArch64). Which one runs is decided at runtime from the CPU's
+// capabilities; other compilers, CPUs and element types fall back to the scalar kernels.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PICOGRAD_SIMD_X86
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define PICOGRAD_SIMD_NEON
+#endif
+
+namespace ajs {
+namespace simd {
+
+enum class Isa : std::uint8_t {
+    scalar, neon, avx2, avx512
+};
+
+inline const char* isa_str(Isa isa) {
+    switch (isa) {
+    case Isa::scalar:
+        return "scalar";
+    case Isa::neon:
+        return "neon";
+    case Isa::avx2:
+        return "avx2";
+    case Isa::avx512:
+        return "avx512";
+    default:
+        return "unknown";
+    }
+}
+
+// Best instruction set that both this CPU and the compiler support
+inline Isa detected_isa() {
+#if defined(PICOGRAD_SIMD_X86)
+    static const Isa isa = (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) ? Isa::avx512
+                         : (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) ? Isa::avx2
+                         : Isa::scalar;
+    return isa;
+#elif defined(PICOGRAD_SIMD_NEON)
+    return Isa::neon;
+#else
+    return Isa::scalar;
+#endif
+}
+
+inline bool supported(Isa isa) {
+    auto best = detected_isa();
+    return isa == Isa::scalar || isa == best || (isa == Isa::avx2 && best == Isa::avx512);
+}
+
+namespace detail {
+inline std::atomic<Isa>& active_isa_state() {
+    static std::atomic<Isa> isa{detected_isa()};
+    return isa;
+}
+} // namespace detail
+
+// Instruction set used by the kernels below (process-wide)
+inline Isa active_isa() {
+    return detail::active_isa_state().load(std::memory_order_relaxed);
+}
+
+// Force a (supported) instruction set, e.g. to compare against the scalar kernels. Returns false
+// and changes nothing if the CPU does not support it.
+inline bool set_isa(Isa isa) {
+    if (!supported(isa)) return false;
+    detail::active_isa_state().store(isa, std::memory_order_relaxed);
+    return true;
+}
+
+
+namespace detail {
+
+#if defined(PICOGRAD_SIMD_X86) || defined(PICOGRAD_SIMD_NEON)
+
+#define PICOGRAD_SIMD_INLINE [[gnu::always_inline]] inline
+
+template<typename T, std::size_t Bytes>
+struct vec {
+    typedef T type __attribute__((vector_size(Bytes)));
+};
+
+// 1/1!, 1/2!, ..., 1/N!: Taylor coefficients of (e^r - 1) / r
+template<typename T, std::size_t N>
+constexpr std::array<T, N> exp_coefficients() {
+    std::array<T, N> c{};
+    T factorial = 1;
+    for (std::size_t k = 0; k < N; ++k) {
+        factorial *= T(k + 1);
+        c[k] = T(1) / factorial;
+    }
+    return c;
+}
+
+// 1, 1/3, 1/5, ...: coefficients of atanh(s) / s in powers of s^2
+template<typename T, std::size_t N>
+constexpr std::array<T, N> atanh_coefficients() {
+    std::array<T, N> c{};
+    for (std::size_t k = 0; k < N; ++k) c[k] = T(1) / T(2 * k + 1);
+    return c;
+}
+
+template<typename T>
+struct float_traits;
+
+template<>
+struct float_traits<float> {
+    using Int = std::int32_t;
+    static constexpr int mantissa_bits = 23;
+    static constexpr Int exponent_bias = 127;
+    static constexpr float round_magic = 12582912.0f;  // 1.5 * 2^23: adding it rounds to an integer in the low bits
+    static constexpr float exp_max = 88.72284f;  // ln(FLT_MAX), rounded up: e^x overflows beyond this
+    static constexpr float exp_min = -103.97208f;  // ln(2^-150), rounded down: e^x underflows to 0 below this
+    static constexpr float ln2_hi = 0.693359375f;  // ln(2) split so that n * ln2_hi is exact
+    static constexpr float ln2_lo = -2.12194440e-4f;
+    static constexpr auto exp_coeffs = exp_coefficients<float, 7>();  // enough for |r| <= ln(2)/2
+    static constexpr auto log_coeffs = atanh_coefficients<float, 6>();  // enough for |s| <= 0.172
+    static constexpr float tanh_saturation = 9.0f;  // tanh(x) rounds to 1 beyond this
+};
+
+template<>
+struct float_traits<double> {
+    using Int = std::int64_t;
+    static constexpr int mantissa_bits = 52;
+    static constexpr Int exponent_bias = 1023;
+    static constexpr double round_magic = 6755399441055744.0;  // 1.5 * 2^52
+    static constexpr double exp_max = 709.78271289338400;
+    static constexpr double exp_min = -745.13321910194122;
+    static constexpr double ln2_hi = 6.93147180369123816490e-01;
+    static constexpr double ln2_lo = 1.90821492927058770002e-10;
+    static constexpr auto exp_coeffs = exp_coefficients<double, 13>();
+    static constexpr auto log_coeffs = atanh_coefficients<double, 11>();
+    static constexpr double tanh_saturation = 19.0;
+};
+
+template<typename V>
+using element_t = std::remove_cvref_t<decltype(std::declval<V>()[0])>;
+
+// Signed integer vector with the same lane count (also the type of lane masks from comparisons)
+template<typename V>
+using int_vec_t = typename vec<typename float_traits<element_t<V>>::Int, sizeof(V)>::type;
+
+// c[0] + c[1] x + c[2] x^2 + ... in Horner form, unrolled at compile time
+template<typename V, typename T, std::size_t N, std::size_t... I>
+PICOGRAD_SIMD_INLINE void horner(V& p, const V& x, const std::array<T, N>& c, std::index_sequence<I...>) {
+    p = V{} + c[N - 1];
+    ((p = p * x + c[N - 2 - I]), ...);
+}
+
+template<typename V, typename T, std::size_t N>
+PICOGRAD_SIMD_INLINE void horner(V& p, const V& x, const std::array<T, N>& c) {
+    horner(p, x, c, std::make_index_sequence<N - 1>{});
+}
+
+// Pass NaN lanes of x through to result (found through the bit pattern, since self-comparisons
+// do not vectorize everywhere)
+template<typename V>
+PICOGRAD_SIMD_INLINE void keep_nan(V& result, const V& x) {
+    using Int = typename float_traits<element_t<V>>::Int;
+    using IV = int_vec_t<V>;
+    const IV abs_mask = IV{} + std::numeric_limits<Int>::max();
+    const IV inf_bits = (IV)(V{} + std::numeric_limits<element_t<V>>::infinity());
+    result = ((IV)x & abs_mask) > inf_bits ? x : result;
+}
+
+// 2^n for integer lanes n whose 2^n is a normal number
+template<typename V>
+PICOGRAD_SIMD_INLINE void pow2(const int_vec_t<V>& n, V& out) {
+    using Tr = float_traits<element_t<V>>;
+    out = (V)((n + Tr::exponent_bias) << Tr::mantissa_bits);
+}
+
+// e^x = 2^n * (1 + q), with q = e^r - 1 for |r| <= ln(2)/2; n is returned both as a float and an integer
+template<typename V>
+PICOGRAD_SIMD_INLINE void exp_reduce(const V& x, V& n, int_vec_t<V>& n_int, V& q) {
+    using T = element_t<V>;
+    using Tr = float_traits<T>;
+    using IV = int_vec_t<V>;
+    const V magic = V{} + Tr::round_magic;
+    V shifted = x * T(1.44269504088896340736) + magic;  // x * log2(e), rounded
+    n = shifted - magic;
+    V r = x - n * Tr::ln2_hi - n * Tr::ln2_lo;
+    horner(q, r, Tr::exp_coeffs);
+    q = q * r;  // r + r^2/2! + ...
+    n_int = (IV)shifted - (IV)magic;
+}
+
+// e^x = scale * (1 + q), for x whose 2^n stays a normal number
+template<typename V>
+PICOGRAD_SIMD_INLINE void exp_parts(const V& x, V& scale, V& q) {
+    V n;
+    int_vec_t<V> n_int;
+    exp_reduce(x, n, n_int, q);
+    pow2(n_int, scale);
+}
+
+template<typename V>
+PICOGRAD_SIMD_INLINE void exp_v(V& x) {
+    using T = element_t<V>;
+    using Tr = float_traits<T>;
+    using IV = int_vec_t<V>;
+    V clamped = x < Tr::exp_max ? x : Tr::exp_max;
+    clamped = clamped > Tr::exp_min ? clamped : Tr::exp_min;
+    V n, q;
+    IV n_int;
+    exp_reduce(clamped, n, n_int, q);
+    // Near the ends of the range 2^n is subnormal or infinite, so scale in two halves that are both
+    // normal; the last multiplication rounds (or overflows) the result just like std::exp does
+    const V magic = V{} + Tr::round_magic;
+    IV half = (IV)(n * T(0.5) + magic) - (IV)magic;
+    V scale1, scale2;
+    pow2(half, scale1);
+    pow2(IV(n_int - half), scale2);
+    V result = (scale1 + scale1 * q) * scale2;
+    result = x > Tr::exp_max ? std::numeric_limits<element_t<V>>::infinity() : result;
+    result = x < Tr::exp_min ? 0 : result;
+    keep_nan(result, x);
+    x = result;
+}
+
+// e^x - 1, exact for small x (no cancellation), for x >= 0 in range
+template<typename V>
+PICOGRAD_SIMD_INLINE void expm1_v(V& x) {
+    V scale, q;
+    exp_parts(x, scale, q);
+    x = scale * q + (scale - 1);
+}
+
+template<typename V>
+PICOGRAD_SIMD_INLINE void log_v(V& x) {
+    using T = element_t<V>;
+    using Tr = float_traits<T>;
+    using IV = int_vec_t<V>;
+    V in = x == 0 ? T(1.0E-15f) : x;  // same clamp as kernels::safe_log_arg
+    // Subnormals have no implicit leading 1: scale them into the normal range first
+    const IV subnormal = in > 0 && in < std::numeric_limits<T>::min();
+    IV bits = (IV)(subnormal ? in * T(typename Tr::Int(1) << Tr::mantissa_bits) : in);
+    using UIV = typename vec<std::make_unsigned_t<typename Tr::Int>, sizeof(V)>::type;
+    IV e = (IV)((UIV)bits >> Tr::mantissa_bits) - Tr::exponent_bias;  // logical shift (AVX2 has no 64-bit arithmetic one)
+    e = e - (subnormal & Tr::mantissa_bits);
+    const IV mantissa_mask = IV{} + ((typename Tr::Int(1) << Tr::mantissa_bits) - 1);
+    const IV one_bits = (IV)(V{} + T(1));
+    V m = (V)((bits & mantissa_mask) | one_bits);  // in [1, 2)
+    auto big = m > T(1.41421356237309504880);
+    m = big ? m * T(0.5) : m;  // now in [sqrt(0.5), sqrt(2))
+    e = e - big;  // big is -1 where true
+    // log(m) = 2 atanh(s) = 2 (s + s^3/3 + s^5/5 + ...), with s = (m - 1) / (m + 1)
+    V s = (m - 1) / (m + 1);
+    V s2 = s * s;
+    V p;
+    horner(p, s2, Tr::log_coeffs);
+    const V magic = V{} + Tr::round_magic;
+    V e_real = (V)(e + (IV)magic) - magic;
+    V result = e_real * Tr::ln2_hi + (T(2) * s * p + e_real * Tr::ln2_lo);
+    result = in < 0 ? std::numeric_limits<T>::quiet_NaN() : result;
+    const IV inf_bits = (IV)(V{} + std::numeric_limits<T>::infinity());
+    const IV is_inf = bits == inf_bits;  // +inf; a bitwise blend, since GCC scalarizes this select for AVX-512
+    result = (V)(((IV)result & ~is_inf) | (bits & is_inf));
+    keep_nan(result, in);
+    x = result;
+}
+
+template<typename V>
+PICOGRAD_SIMD_INLINE void tanh_v(V& x) {
+    using T = element_t<V>;
+    using Tr = float_traits<T>;
+    using IV = int_vec_t<V>;
+    const IV abs_mask = IV{} + std::numeric_limits<typename Tr::Int>::max();
+    V abs_x = (V)((IV)x & abs_mask);
+    V saturated = abs_x < Tr::tanh_saturation ? abs_x : Tr::tanh_saturation;
+    // tanh(x) = (e^2x - 1) / (e^2x + 1), written with expm1 so that small x keep their precision
+    V em = saturated * T(2);
+    expm1_v(em);
+    V t = em / (em + 2);
+    t = abs_x < Tr::tanh_saturation ? t : 1;
+    t = x < 0 ? -t : t;
+    keep_nan(t, x);
+    x = t;
+}
+
+template<typename V>
+PICOGRAD_SIMD_INLINE void sigmoid_v(V& x) {
+    using T = element_t<V>;
+    V e = -x;
+    exp_v(e);
+    x = T(1) / (T(1) + e);
+}
+
+template<typename V>
+PICOGRAD_SIMD_INLINE void relu_v(V& x) {
+    x = x > 0 ? x : 0;
+}
+
+template<Op op, typename V>
+PICOGRAD_SIMD_INLINE void forward_v(V& x) {
+    if constexpr (op == Op::exp) exp_v(x);
+    else if constexpr (op == Op::log) log_v(x);
+    else if constexpr (op == Op::tanh) tanh_v(x);
+    else if constexpr (op == Op::sigmoid) sigmoid_v(x);
+    else if constexpr (op == Op::relu) relu_v(x);
+}
+
+// grad_in += grad_out * f'(in), expressed through the forward output where that is cheaper
+template<Op op, typename V>
+PICOGRAD_SIMD_INLINE void backward_v(const V& in, const V& out, const V& grad_out, V& grad_in) {
+    using T = element_t<V>;
+    if constexpr (op == Op::exp) grad_in += grad_out * out;
+    else if constexpr (op == Op::log) grad_in += grad_out / (in == 0 ? T(1.0E-15f) : in);
+    else if constexpr (op == Op::tanh) grad_in += grad_out * (1 - out * out);
+    else if constexpr (op == Op::sigmoid) grad_in += grad_out * out * (1 - out);
+    else if constexpr (op == Op::relu) grad_in += out > 0 ? grad_out : 0;
+}
+
+// Load/store `count` (at most one vector's worth of) elements; the rest of the vector is padded
+template<typename V, typename T>
+PICOGRAD_SIMD_INLINE void load_partial(V& v, const T* src, std::size_t count, T pad) {
+    T buffer[sizeof(V) / sizeof(T)];
+    for (std::size_t i = 0; i < sizeof(V) / sizeof(T); ++i) buffer[i] = i < count ? src[i] : pad;
+    std::memcpy(&v, buffer, sizeof(V));
+}
+
+template<typename V, typename T>
+PICOGRAD_SIMD_INLINE void store_partial(T* dst, const V& v, std::size_t count) {
+    T buffer[sizeof(V) / sizeof(T)];
+    std::memcpy(buffer, &v, sizeof(V));
+    for (std::size_t i = 0; i < count; ++i) dst[i] = buffer[i];
+}
+
+template<Op op, typename V, typename T>
+PICOGRAD_SIMD_INLINE void forward_loop(const T* in, T* out, std::size_t n) {
+    constexpr std::size_t lanes = sizeof(V) / sizeof(T);
+    std::size_t i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        V x;
+        std::memcpy(&x, in + i, sizeof(V));
+        forward_v<op>(x);
+        std::memcpy(out + i, &x, sizeof(V));
+    }
+    if (i < n) {
+        V x;
+        load_partial(x, in + i, n - i, T(1));  // padded with a harmless argument
+        forward_v<op>(x);
+        store_partial(out + i, x, n - i);
+    }
+}
+
+template<Op op, typename V, typename T>
+PICOGRAD_SIMD_INLINE void backward_loop(const T* in, const T* out, const T* grad_out, T* grad_in, std::size_t n) {
+    constexpr std::size_t lanes = sizeof(V) / sizeof(T);
+    const T* arg = op == Op::log ? in : out;  // log's derivative needs the input, the others the output
+    std::size_t i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        V x, g, gi;
+        std::memcpy(&x, arg + i, sizeof(V));
+        std::memcpy(&g, grad_out + i, sizeof(V));
+        std::memcpy(&gi, grad_in + i, sizeof(V));
+        backward_v<op>(x, x, g, gi);
+        std::memcpy(grad_in + i, &gi, sizeof(V));
+    }
+    if (i < n) {
+        V x, g, gi;
+        load_partial(x, arg + i, n - i, T(1));
+        load_partial(g, grad_out + i, n - i, T(0));
+        load_partial(gi, grad_in + i, n - i, T(0));
+        backward_v<op>(x, x, g, gi);
+        store_partial(grad_in + i, gi, n - i);
+    }
+}
+
+#if defined(PICOGRAD_SIMD_X86)
+template<Op op, typename T>
+__attribute__((target("avx2,fma"))) void forward_avx2(const T* in, T* out, std::size_t n) {
+    forward_loop<op, typename vec<T, 32>::type>(in, out, n);
+}
+
+template<Op op, typename T>
+__attribute__((target("avx512f,avx512dq"))) void forward_avx512(const T* in, T* out, std::size_t n) {
+    forward_loop<op, typename vec<T, 64>::type>(in, out, n);
+}
+
+template<Op op, typename T>
+__attribute__((target("avx2,fma"))) void backward_avx2(const T* in, const T* out, const T* grad_out, T* grad_in, std::size_t n) {
+    backward_loop<op, typename vec<T, 32>::type>(in, out, grad_out, grad_in, n);
+}
+
+template<Op op, typename T>
+__attribute__((target("avx512f,avx512dq"))) void backward_avx512(const T* in, const T* out, const T* grad_out, T* grad_in, std::size_t n) {
+    backward_loop<op, typename vec<T, 64>::type>(in, out, grad_out, grad_in, n);
+}
+#endif
+
+#undef PICOGRAD_SIMD_INLINE
+
+#endif // PICOGRAD_SIMD_X86 || PICOGRAD_SIMD_NEON
+
+template<typename T>
+constexpr bool vectorizable = std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+template<Op op, typename T>
+void forward(const T* in, T* out, std::size_t n) {
+    if constexpr (vectorizable<T>) {
+        switch (active_isa()) {
+#if defined(PICOGRAD_SIMD_X86)
+        case Isa::avx512:
+            return forward_avx512<op>(in, out, n);
+        case Isa::avx2:
+            return forward_avx2<op>(in, out, n);
+#elif defined(PICOGRAD_SIMD_NEON)
+        case Isa::neon:
+            return forward_loop<op, typename vec<T, 16>::type>(in, out, n);
+#endif
+        default:
+            break;
+        }
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+        out[i] = kernels::forward(op, in[i]);
+    }
+}
+
+template<Op op, typename T>
+void backward(const T* in, const T* out, const T* grad_out, T* grad_in, std::size_t n) {
+    if constexpr (vectorizable<T>) {
+        switch (active_isa()) {
+#if defined(PICOGRAD_SIMD_X86)
+        case Isa::avx512:
+            return backward_avx512<op>(in, out, grad_out, grad_in, n);
+        case Isa::avx2:
+            return backward_avx2<op>(in, out, grad_out, grad_in, n);
+#elif defined(PICOGRAD_SIMD_NEON)
+        case Isa::neon:
+            return backward_loop<op, typename vec<T, 16>::type>(in, out, grad_out, grad_in, n);
+#endif
+        default:
+            break;
+        }
+    }
+    T unused_grad{0};
+    for (std::size_t i = 0; i < n; ++i) {
+        kernels::backward(op, out[i], grad_out[i], in[i], T(0), grad_in[i], unused_grad);
+    }
+}
+
+} // namespace detail
+
+
+// out[i] = f(in[i]); out may be the same array as in
+template<typename T>
+void exp(const T* in, T* out, std::size_t n) { detail::forward<Op::exp>(in, out, n); }
+template<typename T>
+void log(const T* in, T* out, std::size_t n) { detail::forward<Op::log>(in, out, n); }
+template<typename T>
+void tanh(const T* in, T* out, std::size_t n) { detail::forward<Op::tanh>(in, out, n); }
+template<typename T>
+void sigmoid(const T* in, T* out, std::size_t n) { detail::forward<Op::sigmoid>(in, out, n); }
+template<typename T>
+void relu(const T* in, T* out, std::size_t n) { detail::forward<Op::relu>(in, out, n); }
+
+// grad_in[i] += grad_out[i] * f'(in[i]), where out = f(in) is the result of the forward kernel
+template<typename T>
+void exp_backward(const T* in, const T* out, const T* grad_out, T* grad_in, std::size_t n) { detail::backward<Op::exp>(in, out, grad_out, grad_in, n); }
+template<typename T>
+void log_backward(const T* in, const T* out, const T* grad_out, T* grad_in, std::size_t n) { detail::backward<Op::log>(in, out, grad_out, grad_in, n); }
+template<typename T>
+void tanh_backward(const T* in, const T* out, const T* grad_out, T* grad_in, std::size_t n) { detail::backward<Op::tanh>(in, out, grad_out, grad_in, n); }
+template<typename T>
+void sigmoid_backward(const T* in, const T* out, const T* grad_out, T* grad_in, std::size_t n) { detail::backward<Op::sigmoid>(in, out, grad_out, grad_in, n); }
+template<typename T>
+void relu_backward(const T* in, const T* out, const T* grad_out, T* grad_in, std::size_t n) { detail::backward<Op::relu>(in, out, grad_out, grad_in, n); }
+
+// Same, selected by op. Return false (and do nothing) for ops without a batched kernel.
+template<typename T>
+bool forward(Op op, const T* in, T* out, std::size_t n) {
+    switch (op) {
+    case Op::exp:
+        exp(in, out, n);
+        return true;
+    case Op::log:
+        log(in, out, n);
+        return true;
+    case Op::tanh:
+        tanh(in, out, n);
+        return true;
+    case Op::sigmoid:
+        sigmoid(in, out, n);
+        return true;
+    case Op::relu:
+        relu(in, out, n);
+        return true;
+    default:
+        return false;
+    }
+}
+
+template<typename T>
+bool backward(Op op, const T* in, const T* out, const T* grad_out, T* grad_in, std::size_t n) {
+    switch (op) {
+    case Op::exp:
+        exp_backward(in, out, grad_out, grad_in, n);
+        return true;
+    case Op::log:
+        log_backward(in, out, grad_out, grad_in, n);
+        return true;
+    case Op::tanh:
+        tanh_backward(in, out, grad_out, grad_in, n);
+        return true;
+    case Op::sigmoid:
+        sigmoid_backward(in, out, grad_out, grad_in, n);
+        return true;
+    case Op::relu:
+        relu_backward(in, out, grad_out, grad_in, n);
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace simd
+} // namespace ajs
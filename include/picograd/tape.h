@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>          // std::size_t
+#include <memory>           // std::allocator
+#include <new>              // placement new
+#include <utility>          // std::forward
+#include <vector>
+
+#include "profile.h"
+
+namespace ajs {
+
+template<typename T>
+class Value;
+
+// Opt-in arena for graph nodes (meant for being used as a scoped stack object, like a lock guard).
+// While a Tape is alive, every Node that Value<T> operations create on this thread is bump-allocated
+// into the Tape's blocks instead of getting its own std::make_shared heap allocation, and the Values
+// pointing to them do no reference counting. All nodes are destroyed in one go by reset() (typically
+// right after backward()) or when the Tape goes out of scope; the blocks are kept for reuse.
+//
+// Values created before the Tape (e.g. model parameters) are not affected and keep their gradients.
+// Values created while the Tape is active must not be used after it has been reset or destroyed.
+// Tapes can be nested; the most recently created live one is used.
+template<typename T>
+class Tape
+{
+    using Node = typename Value<T>::Node;
+
+public:
+    explicit Tape(std::size_t block_size=4096);  // block size is in nodes
+    Tape(const Tape&) = delete;
+    Tape& operator=(const Tape&) = delete;
+    ~Tape();
+
+    void reset();
+    std::size_t size() const;  // number of nodes currently on the tape
+    std::size_t capacity() const;  // number of nodes that fit into the allocated blocks
+
+    static Tape* active();
+
+private:
+    friend class Value<T>;
+    template<typename... Args>
+    Node* emplace(Args&&... args);
+    void add_block();
+
+    std::size_t block_size_;
+    std::vector<Node*> blocks_{};
+    std::size_t block_{0};  // index of the block we are currently filling
+    std::size_t used_{0};  // number of nodes in the current block
+    Tape* previous_;
+
+    static thread_local Tape* active_;
+};
+
+
+template<typename T>
+thread_local Tape<T>* Tape<T>::active_{nullptr};
+
+template<typename T>
+Tape<T>::Tape(std::size_t block_size): block_size_{block_size > 0 ? block_size : 1}, previous_{active_} {
+    active_ = this;
+}
+
+template<typename T>
+Tape<T>::~Tape() {
+    reset();
+    std::allocator<Node> alloc;
+    for (auto block : blocks_) {
+        alloc.deallocate(block, block_size_);
+    }
+    // Unlink from the stack of tapes, which is not necessarily LIFO (e.g. tapes held by unique_ptrs)
+    if (active_ == this) {
+        active_ = previous_;
+        return;
+    }
+    for (auto tape = active_; tape; tape = tape->previous_) {
+        if (tape->previous_ == this) {
+            tape->previous_ = previous_;
+            return;
+        }
+    }
+}
+
+template<typename T>
+void Tape<T>::reset() {
+    // Newest nodes first, so that nodes are destroyed before the nodes they point to
+    for (std::size_t b = blocks_.empty() ? 0 : block_ + 1; b-- > 0; ) {
+        auto count = (b == block_) ? used_ : block_size_;
+        for (std::size_t i = count; i-- > 0; ) {
+            blocks_[b][i].~Node();
+        }
+    }
+    block_ = 0;
+    used_ = 0;
+}
+
+template<typename T>
+std::size_t Tape<T>::size() const {
+    return blocks_.empty() ? 0 : block_ * block_size_ + used_;
+}
+
+template<typename T>
+std::size_t Tape<T>::capacity() const {
+    return blocks_.size() * block_size_;
+}
+
+template<typename T>
+Tape<T>* Tape<T>::active() {
+    return active_;
+}
+
+template<typename T>
+template<typename... Args>
+typename Tape<T>::Node* Tape<T>::emplace(Args&&... args) {
+    // Only advance block_ and used_ once the block and the Node exist, so that a throwing
+    // allocation or Node constructor leaves reset() with nothing but fully constructed nodes
+    if (blocks_.empty()) {
+        add_block();
+    }
+    else if (used_ == block_size_) {
+        if (block_ + 1 == blocks_.size()) {
+            add_block();
+        }
+        ++block_;
+        used_ = 0;
+    }
+    auto node = new (blocks_[block_] + used_) Node(std::forward<Args>(args)...);
+    ++used_;
+    return node;
+}
+
+template<typename T>
+void Tape<T>::add_block() {
+    blocks_.reserve(blocks_.size() + 1);  // so that push_back cannot throw and leak the block
+    blocks_.push_back(std::allocator<Node>().allocate(block_size_));
+    profile::allocated(block_size_ * sizeof(Node));
+}
+
+} // namespace ajs
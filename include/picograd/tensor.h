@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>          // std::size_t
+#include <cstdint>
+#include <initializer_list>
+#include <memory>           // smart pointers
+#include <ostream>
+#include <vector>
+
+#include "gemm.h"
+#include "ops.h"
+#include "simd.h"
+#include "topo.h"
+#include "value.h"          // LOG macros
+
+namespace ajs {
+
+// Shaped, row-major array that takes part in automatic differentiation as a whole.
+// Works like Value (same ops, same copy semantics: copies share the underlying node), but every
+// operation records a single graph node for all of its elements. Elementwise ops broadcast their
+// operands like numpy does (e.g. a {batch, n} tensor plus a {n} bias, or a tensor times a scalar).
+template<typename T>
+class Tensor
+{
+public:
+    using Shape = std::vector<std::size_t>;
+
+private:
+    struct Node {
+        Node(Shape s, std::vector<T> d);
+        Node(Shape s, std::vector<T> d, Op o, std::shared_ptr<Node> ch1, std::shared_ptr<Node> ch2, T p=0);
+        ~Node() {
+            LOG("destroying tensor node " << this);
+        }
+
+        void backward();  // propagate grad to the children, depending on op
+
+        std::vector<T> data;
+        std::vector<T> grad{};  // empty until the first backward pass reaches the node
+        Shape shape;
+        Shape strides;
+        T param{0};  // constant second operand of unary ops (e.g. the exponent of pow)
+        Op op{Op::none};
+        std::uint64_t mark{0};  // epoch of the last topological sort that reached this node
+        std::shared_ptr<Node> child1{nullptr};
+        std::shared_ptr<Node> child2{nullptr};
+    };
+
+public:
+    Tensor();
+    Tensor(const T scalar);  // 0-dimensional tensor (also converts scalars in expressions like t * 2)
+    Tensor(Shape shape, T fill=0);
+    Tensor(Shape shape, std::vector<T> data);
+
+    // Elementwise (broadcasting)
+    Tensor operator+(const Tensor& other) const;
+    Tensor operator-(const Tensor& other) const;
+    Tensor operator*(const Tensor& other) const;
+    Tensor operator/(const Tensor& other) const;
+    Tensor operator-() const;
+    Tensor pow(T exponent) const;
+    Tensor exp() const;
+    Tensor log() const;
+    Tensor tanh() const;
+    Tensor relu() const;
+    Tensor sigmoid() const;
+
+    // Matrix product of a {m, k} and a {k, n} tensor
+    Tensor matmul(const Tensor& other) const;
+
+    // Reductions over all elements, resulting in a 0-dimensional tensor
+    Tensor sum() const;
+    Tensor mean() const;
+
+    void backward();
+
+    const Shape& shape() const;
+    const Shape& strides() const;
+    std::size_t ndim() const;
+    std::size_t size() const;
+
+    const std::vector<T>& get_data() const;
+    const std::vector<T>& get_grad() const;  // empty before the first backward pass
+    T item() const;  // the only element of a single-element tensor
+    T at(std::initializer_list<std::size_t> index) const;
+    void set_data(std::vector<T> data);
+    void zero_grad();
+
+protected:
+    std::shared_ptr<Node> node_{nullptr};
+
+    Tensor(std::shared_ptr<Node> node);
+    Tensor elementwise(Op op, const Tensor& other) const;
+    Tensor elementwise(Op op, T param=0) const;
+    static void topological_order(Node* root, std::vector<Node*>& out_topo);
+};
+
+template<typename T>
+std::ostream& operator<<(std::ostream& os, const Tensor<T>& t);
+
+} // namespace ajs
+
+// Needed because this is a template library
+#include "tensor.hpp"
@@ -0,0 +1,397 @@
+#include "tensor.h"
+#include <algorithm>        // std::fill
+#include <stdexcept>        // std::invalid_argument
+#include <string>
+#include <utility>          // std::move
+
+namespace ajs {
+
+namespace detail {
+
+inline std::size_t shape_size(const std::vector<std::size_t>& shape) {
+    std::size_t size = 1;
+    for (auto dim : shape) size *= dim;
+    return size;
+}
+
+inline std::vector<std::size_t> row_major_strides(const std::vector<std::size_t>& shape) {
+    std::vector<std::size_t> strides(shape.size());
+    std::size_t stride = 1;
+    for (auto i = shape.size(); i-- > 0; ) {
+        strides[i] = stride;
+        stride *= shape[i];
+    }
+    return strides;
+}
+
+inline std::string shape_str(const std::vector<std::size_t>& shape) {
+    std::string str = "[";
+    for (std::size_t i = 0; i < shape.size(); ++i) {
+        str += (i > 0 ? "," : "") + std::to_string(shape[i]);
+    }
+    return str + "]";
+}
+
+// numpy broadcasting: shapes are aligned at their last dimension, and dimensions of size 1 stretch
+inline std::vector<std::size_t> broadcast_shapes(const std::vector<std::size_t>& a, const std::vector<std::size_t>& b) {
+    std::vector<std::size_t> out(std::max(a.size(), b.size()));
+    for (std::size_t i = 0; i < out.size(); ++i) {
+        std::size_t dim_a = i < a.size() ? a[a.size() - 1 - i] : 1;
+        std::size_t dim_b = i < b.size() ? b[b.size() - 1 - i] : 1;
+        if (dim_a != dim_b && dim_a != 1 && dim_b != 1) {
+            throw std::invalid_argument("cannot broadcast shapes " + shape_str(a) + " and " + shape_str(b));
+        }
+        out[out.size() - 1 - i] = dim_a == 1 ? dim_b : dim_a;
+    }
+    return out;
+}
+
+// Strides for reading a tensor of the given shape as if it had out_shape (0 along stretched dimensions)
+inline std::vector<std::size_t> broadcast_strides(const std::vector<std::size_t>& shape,
+                                                  const std::vector<std::size_t>& strides,
+                                                  const std::vector<std::size_t>& out_shape) {
+    std::vector<std::size_t> out(out_shape.size(), 0);
+    auto offset = out_shape.size() - shape.size();
+    for (std::size_t i = 0; i < shape.size(); ++i) {
+        out[offset + i] = shape[i] == 1 ? 0 : strides[i];
+    }
+    return out;
+}
+
+// Calls f(i, offset_a, offset_b) for every element i (in row-major order) of a tensor of out_shape
+template<typename F>
+void for_each_broadcast(const std::vector<std::size_t>& out_shape,
+                        const std::vector<std::size_t>& strides_a,
+                        const std::vector<std::size_t>& strides_b,
+                        F&& f) {
+    auto size = shape_size(out_shape);
+    auto ndim = out_shape.size();
+    std::vector<std::size_t> index(ndim, 0);
+    std::size_t offset_a = 0;
+    std::size_t offset_b = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+        f(i, offset_a, offset_b);
+        // odometer-style increment of the multi-index, keeping both offsets in sync
+        for (auto d = ndim; d-- > 0; ) {
+            offset_a += strides_a[d];
+            offset_b += strides_b[d];
+            if (++index[d] < out_shape[d]) break;
+            offset_a -= strides_a[d] * out_shape[d];
+            offset_b -= strides_b[d] * out_shape[d];
+            index[d] = 0;
+        }
+    }
+}
+
+} // namespace detail
+
+
+template<typename T>
+Tensor<T>::Node::Node(Shape s, std::vector<T> d): data{std::move(d)}, shape{std::move(s)} {
+    strides = detail::row_major_strides(shape);
+    LOG("tensor node constructor with shape=" << detail::shape_str(shape) << " at " << this);
+}
+
+template<typename T>
+Tensor<T>::Node::Node(Shape s, std::vector<T> d, Op o, std::shared_ptr<Node> ch1, std::shared_ptr<Node> ch2, T p)
+    : data{std::move(d)}, shape{std::move(s)}, param{p}, op{o}, child1{ch1}, child2{ch2} {
+    strides = detail::row_major_strides(shape);
+    LOG("full tensor node constructor " << this);
+}
+
+template<typename T>
+void Tensor<T>::Node::backward() {
+    switch (op) {
+    case Op::none:
+        return;
+    case Op::matmul: {
+        auto m = child1->shape[0];
+        auto k = child1->shape[1];
+        auto n = child2->shape[1];
+        gemm::nt(m, k, n, grad.data(), child2->data.data(), child1->grad.data());  // dA += dC * B^T
+        gemm::tn(k, n, m, child1->data.data(), grad.data(), child2->grad.data());  // dB += A^T * dC
+        break;
+    }
+    case Op::sum:
+        for (auto& g : child1->grad) g += grad[0];
+        break;
+    case Op::mean: {
+        T g_each = grad[0] / T(child1->data.size());
+        for (auto& g : child1->grad) g += g_each;
+        break;
+    }
+    default:
+        if (child2) {
+            auto strides_a = detail::broadcast_strides(child1->shape, child1->strides, shape);
+            auto strides_b = detail::broadcast_strides(child2->shape, child2->strides, shape);
+            detail::for_each_broadcast(shape, strides_a, strides_b, [&](std::size_t i, std::size_t ia, std::size_t ib) {
+                kernels::backward(op, data[i], grad[i], child1->data[ia], child2->data[ib], child1->grad[ia], child2->grad[ib]);
+            });
+        }
+        else if (!simd::backward(op, child1->data.data(), data.data(), grad.data(), child1->grad.data(), data.size())) {
+            T unused_grad{0};
+            for (std::size_t i = 0; i < data.size(); ++i) {
+                kernels::backward(op, data[i], grad[i], child1->data[i], param, child1->grad[i], unused_grad);
+            }
+        }
+    }
+    LOG(op_str(op) << " tensor backward done for node " << this);
+}
+
+
+template<typename T>
+Tensor<T>::Tensor(): Tensor{T(0)} {
+}
+
+template<typename T>
+Tensor<T>::Tensor(const T scalar): node_{std::make_shared<Node>(Shape{}, std::vector<T>{scalar})} {
+}
+
+template<typename T>
+Tensor<T>::Tensor(Shape shape, T fill) {
+    auto size = detail::shape_size(shape);
+    node_ = std::make_shared<Node>(std::move(shape), std::vector<T>(size, fill));
+}
+
+template<typename T>
+Tensor<T>::Tensor(Shape shape, std::vector<T> data) {
+    if (data.size() != detail::shape_size(shape)) {
+        throw std::invalid_argument("tensor of shape " + detail::shape_str(shape) + " cannot hold "
+                                    + std::to_string(data.size()) + " elements");
+    }
+    node_ = std::make_shared<Node>(std::move(shape), std::move(data));
+}
+
+template<typename T>
+Tensor<T>::Tensor(std::shared_ptr<Node> node): node_{node} {
+}
+
+
+template<typename T>
+Tensor<T> Tensor<T>::elementwise(Op op, const Tensor& other) const {
+    LOG("forward pass for tensor " << op_str(op));
+    const auto& a = *node_;
+    const auto& b = *other.node_;
+    auto shape = a.shape == b.shape ? a.shape : detail::broadcast_shapes(a.shape, b.shape);
+    std::vector<T> data(detail::shape_size(shape));
+    if (a.shape == b.shape) {
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            data[i] = kernels::forward(op, a.data[i], b.data[i]);
+        }
+    }
+    else {
+        auto strides_a = detail::broadcast_strides(a.shape, a.strides, shape);
+        auto strides_b = detail::broadcast_strides(b.shape, b.strides, shape);
+        detail::for_each_broadcast(shape, strides_a, strides_b, [&](std::size_t i, std::size_t ia, std::size_t ib) {
+            data[i] = kernels::forward(op, a.data[ia], b.data[ib]);
+        });
+    }
+    return Tensor(std::make_shared<Node>(std::move(shape), std::move(data), op, node_, other.node_));
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::elementwise(Op op, T param) const {
+    LOG("forward pass for tensor " << op_str(op));
+    const auto& a = *node_;
+    std::vector<T> data(a.data.size());
+    if (!simd::forward(op, a.data.data(), data.data(), data.size())) {
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            data[i] = kernels::forward(op, a.data[i], param);
+        }
+    }
+    return Tensor(std::make_shared<Node>(a.shape, std::move(data), op, node_, nullptr, param));
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::operator+(const Tensor& other) const {
+    return elementwise(Op::add, other);
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::operator-(const Tensor& other) const {
+    return elementwise(Op::sub, other);
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::operator*(const Tensor& other) const {
+    return elementwise(Op::mult, other);
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::operator/(const Tensor& other) const {
+    return elementwise(Op::div, other);
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::operator-() const {
+    return elementwise(Op::neg);
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::pow(T exponent) const {
+    return elementwise(Op::pow, exponent);
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::exp() const {
+    return elementwise(Op::exp);
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::log() const {
+    return elementwise(Op::log);
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::tanh() const {
+    return elementwise(Op::tanh);
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::relu() const {
+    return elementwise(Op::relu);
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::sigmoid() const {
+    return elementwise(Op::sigmoid);
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::matmul(const Tensor& other) const {
+    LOG("forward pass for tensor matmul");
+    const auto& a = *node_;
+    const auto& b = *other.node_;
+    if (a.shape.size() != 2 || b.shape.size() != 2 || a.shape[1] != b.shape[0]) {
+        throw std::invalid_argument("cannot matmul shapes " + detail::shape_str(a.shape) + " and " + detail::shape_str(b.shape));
+    }
+    auto m = a.shape[0];
+    auto k = a.shape[1];
+    auto n = b.shape[1];
+    std::vector<T> data(m * n, 0);
+    gemm::nn(m, n, k, a.data.data(), b.data.data(), data.data());
+    return Tensor(std::make_shared<Node>(Shape{m, n}, std::move(data), Op::matmul, node_, other.node_));
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::sum() const {
+    LOG("forward pass for tensor sum");
+    T total = 0;
+    for (auto x : node_->data) total += x;
+    return Tensor(std::make_shared<Node>(Shape{}, std::vector<T>{total}, Op::sum, node_, nullptr));
+}
+
+template<typename T>
+Tensor<T> Tensor<T>::mean() const {
+    LOG("forward pass for tensor mean");
+    if (size() == 0) throw std::invalid_argument("mean() of a tensor without elements");
+    T total = 0;
+    for (auto x : node_->data) total += x;
+    return Tensor(std::make_shared<Node>(Shape{}, std::vector<T>{total / T(size())}, Op::mean, node_, nullptr));
+}
+
+
+template<typename T>
+void Tensor<T>::topological_order(Node* root, std::vector<Node*>& out_topo) {
+    detail::topological_order(std::span<Node* const>(&root, 1), out_topo);
+}
+
+template<typename T>
+void Tensor<T>::backward() {
+    thread_local std::vector<Node*> topo{};
+    topological_order(node_.get(), topo);
+    for (auto node : topo) {
+        // Inner nodes start from scratch on every pass, leaves accumulate
+        if (node->op != Op::none || node->grad.size() != node->data.size()) {
+            node->grad.assign(node->data.size(), 0);
+        }
+    }
+    std::fill(node_->grad.begin(), node_->grad.end(), T(1));
+    for (auto iter_node = topo.rbegin(); iter_node != topo.rend(); ++iter_node) {
+        (*iter_node)->backward();
+    }
+}
+
+
+template<typename T>
+const typename Tensor<T>::Shape& Tensor<T>::shape() const {
+    return node_->shape;
+}
+
+template<typename T>
+const typename Tensor<T>::Shape& Tensor<T>::strides() const {
+    return node_->strides;
+}
+
+template<typename T>
+std::size_t Tensor<T>::ndim() const {
+    return node_->shape.size();
+}
+
+template<typename T>
+std::size_t Tensor<T>::size() const {
+    return node_->data.size();
+}
+
+template<typename T>
+const std::vector<T>& Tensor<T>::get_data() const {
+    return node_->data;
+}
+
+template<typename T>
+const std::vector<T>& Tensor<T>::get_grad() const {
+    return node_->grad;
+}
+
+template<typename T>
+T Tensor<T>::item() const {
+    if (size() != 1) {
+        throw std::invalid_argument("item() of a tensor with " + std::to_string(size()) + " elements");
+    }
+    return node_->data[0];
+}
+
+template<typename T>
+T Tensor<T>::at(std::initializer_list<std::size_t> index) const {
+    if (index.size() != ndim()) {
+        throw std::invalid_argument("index with " + std::to_string(index.size()) + " dimensions into tensor of shape "
+                                    + detail::shape_str(shape()));
+    }
+    std::size_t offset = 0;
+    std::size_t d = 0;
+    for (auto i : index) {
+        if (i >= node_->shape[d]) {
+            throw std::invalid_argument("index " + std::to_string(i) + " in dimension " + std::to_string(d)
+                                        + " of tensor of shape " + detail::shape_str(shape()));
+        }
+        offset += i * node_->strides[d++];
+    }
+    return node_->data[offset];
+}
+
+template<typename T>
+void Tensor<T>::set_data(std::vector<T> data) {
+    if (data.size() != size()) {
+        throw std::invalid_argument("tensor of shape " + detail::shape_str(shape()) + " cannot hold "
+                                    + std::to_string(data.size()) + " elements");
+    }
+    node_->data = std::move(data);
+}
+
+template<typename T>
+void Tensor<T>::zero_grad() {
+    node_->grad.assign(node_->data.size(), 0);
+}
+
+
+template<typename T>
+std::ostream& operator<<(std::ostream& os, const Tensor<T>& t) {
+    os << "Tensor(shape=" << detail::shape_str(t.shape()) << ",data=[";
+    const auto& data = t.get_data();
+    for (std::size_t i = 0; i < data.size() && i < 8; ++i) {
+        os << (i > 0 ? "," : "") << data[i];
+    }
+    return (os << (data.size() > 8 ? ",...])@" : "])@") << &t);
+}
+
+} // namespace ajs
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>          // std::size_t
+#include <deque>
+#include <exception>        // std::exception_ptr
+#include <memory>           // std::unique_ptr
+#include <mutex>
+#include <thread>
+#include <utility>          // std::forward, std::exchange
+#include <vector>
+
+namespace ajs {
+
+// Work-stealing thread pool for fork/join style jobs (like the parallel backward pass).
+// A job is started with run(), which executes its root function on the calling thread; the
+// function (and every task) may spawn() further tasks. Each thread pushes the tasks it spawns
+// onto its own deque and takes them from the back (newest first, which keeps the working set
+// small), while idle threads steal from the front of the others' deques. run() returns once all
+// tasks of the job have finished. The calling thread counts as one of the pool's threads.
+class ThreadPool
+{
+public:
+    // Tasks are a function pointer plus two words of arguments, so that spawning does not allocate
+    struct Task {
+        void (*function)(void* context, std::size_t arg);
+        void* context;
+        std::size_t arg;
+    };
+
+    explicit ThreadPool(std::size_t threads=std::thread::hardware_concurrency());
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    std::size_t size() const;  // number of threads, including the one calling run()
+
+    // Run f() on this thread and wait until it and all tasks spawned from the job have finished.
+    // Jobs on the same pool are serialized. Called from inside a job of this pool (e.g. by a task),
+    // it runs f() inline instead, and the tasks f() spawns join the enclosing job. If f() or a task
+    // throws, the first exception is rethrown once the job has finished (later ones are dropped).
+    template<typename F>
+    void run(F&& f);
+
+    // Only valid inside a job (from its root function or one of its tasks)
+    void spawn(Task task);
+
+private:
+    struct Worker {
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;  // tasks are tiny, so a spinlock beats a mutex
+        std::deque<Task> tasks;
+    };
+
+    void worker_loop(std::size_t index);
+    bool pop(std::size_t index, Task& task);  // own tasks first, then steal
+    void execute(const Task& task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::mutex job_mutex_;  // serializes run()
+    std::atomic<std::size_t> generation_{0};  // incremented for every job (and on shutdown), workers wait on it
+    std::atomic<bool> stop_{false};
+    std::atomic<std::size_t> unfinished_{0};  // spawned tasks (and the root function) not done yet
+    std::mutex error_mutex_;
+    std::exception_ptr error_;  // first exception of the current job
+
+    static thread_local ThreadPool* current_pool_;
+    static thread_local std::size_t current_worker_;
+};
+
+
+inline thread_local ThreadPool* ThreadPool::current_pool_{nullptr};
+inline thread_local std::size_t ThreadPool::current_worker_{0};
+
+inline ThreadPool::ThreadPool(std::size_t threads) {
+    if (threads == 0) threads = 1;
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (std::size_t i = 1; i < threads; ++i) {  // worker 0 is whoever calls run()
+        threads_.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+inline ThreadPool::~ThreadPool() {
+    stop_.store(true, std::memory_order_relaxed);
+    generation_.fetch_add(1, std::memory_order_release);
+    generation_.notify_all();
+    for (auto& thread : threads_) thread.join();
+}
+
+inline std::size_t ThreadPool::size() const {
+    return workers_.size();
+}
+
+template<typename F>
+void ThreadPool::run(F&& f) {
+    if (current_pool_ == this) return std::forward<F>(f)();  // nested: job_mutex_ is held already
+    std::lock_guard<std::mutex> job_lock(job_mutex_);
+    auto previous_pool = current_pool_;
+    auto previous_worker = current_worker_;
+    current_pool_ = this;
+    current_worker_ = 0;
+    unfinished_.store(1, std::memory_order_relaxed);  // the root function
+    generation_.fetch_add(1, std::memory_order_release);
+    generation_.notify_all();
+
+    try {
+        std::forward<F>(f)();
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        if (!error_) error_ = std::current_exception();
+    }
+    unfinished_.fetch_sub(1, std::memory_order_release);
+    Task task;
+    while (unfinished_.load(std::memory_order_acquire) > 0) {  // even after an exception: tasks may use f's locals
+        if (pop(0, task)) execute(task);
+        else std::this_thread::yield();
+    }
+    current_pool_ = previous_pool;
+    current_worker_ = previous_worker;
+    if (auto error = std::exchange(error_, nullptr)) std::rethrow_exception(error);
+}
+
+inline void ThreadPool::spawn(Task task) {
+    unfinished_.fetch_add(1, std::memory_order_relaxed);
+    auto& worker = *workers_[current_pool_ == this ? current_worker_ : 0];
+    while (worker.lock.test_and_set(std::memory_order_acquire)) {}
+    worker.tasks.push_back(task);
+    worker.lock.clear(std::memory_order_release);
+}
+
+inline bool ThreadPool::pop(std::size_t index, Task& task) {
+    auto n = workers_.size();
+    for (std::size_t k = 0; k < n; ++k) {
+        auto& worker = *workers_[(index + k) % n];
+        if (worker.lock.test_and_set(std::memory_order_acquire)) continue;  // busy, try the next one
+        bool found = !worker.tasks.empty();
+        if (found && k == 0) {
+            task = worker.tasks.back();
+            worker.tasks.pop_back();
+        }
+        else if (found) {
+            task = worker.tasks.front();
+            worker.tasks.pop_front();
+        }
+        worker.lock.clear(std::memory_order_release);
+        if (found) return true;
+    }
+    return false;
+}
+
+inline void ThreadPool::execute(const Task& task) {
+    try {
+        task.function(task.context, task.arg);
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        if (!error_) error_ = std::current_exception();
+    }
+    unfinished_.fetch_sub(1, std::memory_order_release);
+}
+
+inline void ThreadPool::worker_loop(std::size_t index) {
+    current_pool_ = this;
+    current_worker_ = index;
+    std::size_t seen_generation = 0;
+    while (true) {
+        generation_.wait(seen_generation, std::memory_order_acquire);
+        seen_generation = generation_.load(std::memory_order_acquire);
+        if (stop_.load(std::memory_order_relaxed)) return;
+        Task task;
+        while (unfinished_.load(std::memory_order_acquire) > 0) {
+            if (pop(index, task)) execute(task);
+            else std::this_thread::yield();
+        }
+    }
+}
+
+} // namespace ajs
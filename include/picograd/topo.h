@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace ajs::detail {
+
+// Topological order of the nodes reachable from roots (operands before the nodes using them), for
+// the node types of Value and Tensor, which have child1 and child2 pointers and a uint64_t mark.
+//
+// Iterative depth-first search, so that deep graphs (long chains) cannot overflow the stack.
+// Instead of keeping a set of visited nodes, every sort gets a new epoch and stamps it into the
+// nodes it reaches. The marks are plain fields, so sorts running at the same time on different
+// threads must not share any node (not even a leaf; see DataParallel for how parameters are
+// kept apart). The counter is 64 bits wide, so that it cannot wrap around to a stale mark.
+template<typename Node>
+void topological_order(std::span<Node* const> roots, std::vector<Node*>& out_topo) {
+    static std::atomic<std::uint64_t> epoch_counter{0};
+    std::uint64_t epoch = ++epoch_counter;  // never 0, the mark of fresh nodes
+
+    thread_local std::vector<Node*> stack{};
+    out_topo.clear();
+    stack.clear();
+    for (auto root : roots) {
+        if (root->mark == epoch) continue;  // reached from an earlier root
+        root->mark = epoch;
+        stack.push_back(root);
+        while (!stack.empty()) {
+            Node* node = stack.back();
+            Node* next = nullptr;
+            if (node->child1 && node->child1->mark != epoch) {
+                next = node->child1.get();
+            }
+            else if (node->child2 && node->child2->mark != epoch) {
+                next = node->child2.get();
+            }
+            if (next) {
+                next->mark = epoch;
+                stack.push_back(next);
+            }
+            else {
+                out_topo.push_back(node);  // AFTER pushing the dependent nodes
+                stack.pop_back();
+            }
+        }
+    }
+}
+
+} // namespace ajs::detail
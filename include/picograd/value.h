@@ -1,16 +1,25 @@
 #pragma once
 
-#include <functional>
 #include <string>
 #include <vector>           // std:vector
 #include <algorithm>        // std:find
-#include <unordered_set>
+#include <atomic>
+#include <cstdint>
 #include <cmath>            // std::log, std::pow, std::exp
 #include <memory>           // smart pointers
+#include <span>
 #include <sstream>          // std::ostringstream
+#include <iostream>         // std::cout
+#include <stdexcept>        // std::logic_error
+#include <unordered_set>
+
+#include "no_grad.h"
+#include "ops.h"
+#include "profile.h"
+#include "thread_pool.h"
+#include "topo.h"
 
 #if defined(VERBOSE_picograd) && !defined(NDEBUG)
-#include <iostream>
 #define FILENAME strrchr("/" __FILE__, '/') + 1
 #define LOG(x) std::cout << FILENAME << " (" << __LINE__ << "): " << x << std::endl
 #define LOGVAR(x) std::cout << FILENAME << " (" << __LINE__ << "): " << #x"=" << x << std::endl
@@ -21,50 +30,71 @@
 
 namespace ajs {
 
+template<typename T>
+class Tape;
+
+template<typename T>
+class DataParallel;
+
+template<typename T>
+class Program;
+
+template<typename T>
+class Checkpoint;
+
+template<typename T>
+class Autograd;
+
+template<typename T>
+class ParameterSet;
+
 template<typename T>
 class Value
 {
-    enum class Op {
-        none, add, sub, mult, div, neg, pow, exp, log, tanh, relu, sigmoid
-    };
-
     struct Node {
         Node(T d) : data{d} {
             LOG("node value constructor with data=" << d << " at " << this);
+            profile::node_created(Op::none);
         }
-        Node(T d, Op o, std::shared_ptr<Node> ch1, std::shared_ptr<Node> ch2) : data{d}, op{o}, child1{ch1}, child2{ch2} {
+        Node(T d, Op o, std::shared_ptr<Node> ch1, std::shared_ptr<Node> ch2, T p=0, T p2=0)
+            : op{o}, data{d}, param{p}, param2{p2}, child1{replicate(std::move(ch1))}, child2{replicate(std::move(ch2))} {
             LOG("full node constructor " << this);
+            profile::node_created(o);
         }
         ~Node() {
             LOG("destroying node " << this);
+            profile::node_freed();
+            if (owned(child1, child2) || owned(child2, child1)) release_children();
         }
-        std::string op_str() {
-            switch (op) {
-            case Op::none:
-                return "none";
-            case Op::add:
-                return "+";
-            case Op::sub:
-                return "-";
-            case Op::mult:
-                return "*";
-            case Op::div:
-                return "/";
-            case Op::neg:
-                return "neg";
-            case Op::pow:
-                return "pow";
-            case Op::exp:
-                return "exp";
-            case Op::tanh:
-                return "tanh";
-            case Op::relu:
-                return "relu";
-            case Op::sigmoid:
-                return "sigmoid";
-            default:
-                return "unknown";
+
+        // Frees the nodes below this one in a loop instead of through nested shared_ptr destructors,
+        // which would overflow the stack on long chains: the outermost teardown on a thread
+        // collects the children that only this node refers to (once, or as both operands, like in
+        // y * y), and nodes freed while it drains them hand it their children in turn. Shared
+        // children are only released, Tape children left alone.
+        static bool owned(const std::shared_ptr<Node>& child, const std::shared_ptr<Node>& other) {
+            return child && child.use_count() == (child == other ? 2 : 1);
+        }
+        void release_children() {
+            thread_local std::vector<std::shared_ptr<Node>>* pending = nullptr;
+            auto collect = [this](std::vector<std::shared_ptr<Node>>& into) {
+                bool owned1 = owned(child1, child2);
+                bool owned2 = owned(child2, child1);
+                if (owned1) into.push_back(std::move(child1));
+                if (owned2) into.push_back(std::move(child2));
+            };
+            if (pending) return collect(*pending);
+            std::vector<std::shared_ptr<Node>> nodes;
+            pending = &nodes;
+            collect(nodes);
+            while (!nodes.empty()) {
+                auto node = std::move(nodes.back());  // freed at the end of the iteration, pushing its children
+                nodes.pop_back();
             }
+            pending = nullptr;
+        }
+        std::string op_str() {
+            return ajs::op_str(op);
         }
         std::string str() {
             std::ostringstream stream;
@@ -73,39 +103,89 @@ class Value
 //            return std::string("Node(") + std::to_string(data) + ",grad=" + std::to_string(grad) + ",op=" + op_str() + ")";// + std::to_string(this);
         }
 
-        void print_graph(uint8_t level=0, std::vector<int> running_levels={}) {
-            std::ostringstream indent_os;
-            for (uint8_t i=1; i<level; ++i) {
-                if (std::find(running_levels.begin(), running_levels.end(), i-1) != running_levels.end()) {
-                    indent_os << " |  ";
-                }
-                else {
-                    indent_os << "    ";
-                }
+        // Prints the graph as a tree, without recursion. Subgraphs reached again through a shared
+        // node are not repeated: the node is marked "(see above)" instead.
+        void print_graph() {
+            struct Item {
+                Node* node;
+                std::size_t level;
+                bool sibling_follows;  // child1 of a node with a child2
+            };
+            std::vector<Item> stack{{this, 0, false}};
+            std::vector<bool> running_levels;  // [i]: the node at level i has a child left to print
+            std::unordered_set<const Node*> printed;
+            while (!stack.empty()) {
+                auto [node, level, sibling_follows] = stack.back();
+                stack.pop_back();
+                running_levels.resize(level + 1);
+                if (level > 0) running_levels[level - 1] = sibling_follows;
+                for (std::size_t i = 1; i < level; ++i) std::cout << (running_levels[i - 1] ? " |  " : "    ");
+                if (level > 0) std::cout << " |__";
+                bool seen = !printed.insert(node).second;
+                std::cout << node->str() << (seen && node->child1 ? " (see above)" : "") << "\n";
+                if (seen) continue;
+                if (node->child2) stack.push_back({node->child2.get(), level + 1, false});
+                if (node->child1) stack.push_back({node->child1.get(), level + 1, bool(node->child2)});
             }
-            if (level > 0) indent_os << " |__";
-            auto indent_str = indent_os.str();
-            std::cout << indent_str << str() << "\n";
+            std::cout << std::endl;
+        }
+
+        // Operands as the kernels see them
+        T operand1() const { return op == Op::linear ? param : child1->data; }
+        T operand2() const { return op == Op::linear ? param2 : child2 ? child2->data : param; }
 
-            running_levels.push_back(level);
-            if (child1) child1->print_graph(level + 1, running_levels);
-            running_levels.pop_back();
-            if (child2) child2->print_graph(level + 1, running_levels);
+        // Recompute data from the children, depending on the op that produced this node
+        void forward() {
+            if (op == Op::none) return;
+            if (op == Op::linear) throw std::logic_error("linear nodes cannot be recomputed");
+            data = kernels::forward(op, child1->data, child2 ? child2->data : param);
+        }
 
-            if (level == 0) std::cout << std::endl;
+        // Propagate this node's grad to its children, depending on the op that produced it
+        void backward() {
+            if (op == Op::none) return;
+            profile::OpTimer timer(op, profile::Pass::backward);
+            T unused_grad{0};  // also takes the contributions to frozen leaves
+            kernels::backward(op, data, grad, operand1(), operand2(),
+                              child1->requires_grad ? child1->grad : unused_grad,
+                              child2 && child2->requires_grad ? child2->grad : unused_grad);
+            LOG(op_str() << " backward result: " << child1->str() << (child2 ? ", " + child2->str() : ""));
         }
 
+        // Small fields first, so that they share the padding and the cache line with data
+        Op op{Op::none};
+        std::uint8_t data_parallel{0};  // number of DataParallel trainers this parameter is registered with
+        bool requires_grad{true};  // false for constants, and for leaves frozen after they were used (see set_requires_grad())
+        std::uint32_t index{0};  // scratch position in a topological order (parallel backward pass, Program)
+        std::uint64_t mark{0};  // epoch of the last topological sort that reached this node
         T data;
         T grad{0};
-        Op op{Op::none};
+        T param{0};  // constant second operand of unary ops (e.g. the exponent of pow), or for linear nodes,
+        T param2{0};  // their derivatives with respect to child1 and child2
         std::shared_ptr<Node> child1{nullptr};
         std::shared_ptr<Node> child2{nullptr};
-        std::function<void()> backward{nullptr};
     };
 
 public:
+    // Topological order of the graph behind a Value (children before parents). Sorting once and
+    // keeping the Order around pays off when the same graph is evaluated repeatedly with new leaf
+    // data (set_data() on the leaves, then forward() and backward()). Keeps the graph alive.
+    class Order {
+    public:
+        void forward();  // recompute all nodes from the current leaf data
+        void backward();  // backpropagate from the root, like Value::backward()
+        void backward(ThreadPool& pool, bool deterministic=false);
+        std::size_t size() const { return nodes_.size(); }
+
+    private:
+        friend class Value;
+        std::shared_ptr<Node> root_{nullptr};
+        std::vector<Node*> nodes_{};
+    };
+
     Value();
     Value(const T data);
+    Value(const T data, bool requires_grad);
     Value(std::shared_ptr<Node> node);
     Value(const Value& other);  // Copy constructor (new Value points to same inner Node as old value)
     Value(Value&& other);  // Move constructor
@@ -121,25 +201,59 @@ public:
     Value operator-() const;
     Value operator-(const Value& other) const;
     Value operator/(const Value& other) const;
+    // Scalar operands are stored in the node (like the exponent of pow) instead of getting a node
+    Value operator+(T other) const;
+    Value operator-(T other) const;
+    Value operator*(T other) const;
+    Value operator/(T other) const;
+    friend Value operator+(T a, const Value& b) { return b + a; }
+    friend Value operator-(T a, const Value& b) { return b.reversed(Op::rsub, a); }
+    friend Value operator*(T a, const Value& b) { return b * a; }
+    friend Value operator/(T a, const Value& b) { return b.reversed(Op::rdiv, a); }
     Value pow(int exponent) const;
     Value pow(float exponent) const;
+    Value square() const;  // like pow(2), without std::pow
     Value exp() const;
     Value log() const;
     Value tanh() const;
     Value relu() const;
     Value sigmoid() const;
 
+    // Node(s) with precomputed data and derivatives with respect to the given operands, which
+    // backpropagate grad * derivatives[i] into operands[i] (this is what lazy expressions turn
+    // into, see expr.h). Repeated operands are merged; n distinct operands take max(1, n - 1)
+    // nodes. Such nodes cannot be recomputed by Order::forward() or compiled into a Program.
+    static Value linear(T data, std::span<const Value* const> operands, std::span<const T> derivatives);
+
     Value operator+=(const Value& other);
     Value operator*=(const Value& other);
     Value operator-=(const Value& other);
     Value operator/=(const Value& other);
+    Value operator+=(T other);
+    Value operator*=(T other);
+    Value operator-=(T other);
+    Value operator/=(T other);
 
     bool operator==(const Value& other) const;
     bool operator!=(const Value& other) const;
     bool operator<(const Value& other) const;
 
     void backward();
+    // Parallel backward pass: a node is processed as soon as all nodes that use it are done, so
+    // independent branches of the graph (e.g. the samples of a batch) run on different threads.
+    // Gradients flowing into shared nodes are added atomically, in whatever order the threads get
+    // there. With deterministic=true, they are instead collected per edge and summed in the order
+    // of the serial pass, which makes the result bitwise identical to backward().
+    // The graph must not be modified (or backpropagated from another thread) meanwhile.
+    void backward(ThreadPool& pool, bool deterministic=false);
+    Order topological_order() const;
     void print_graph();
+    // Streaming exports of the graph for graphs of any size and depth: every node is written once,
+    // children before parents, with no recursion. write_dot() writes Graphviz DOT (edges point
+    // from operand to result); write_json() writes
+    // {"nodes":[{"id":0,"op":"none","data":0.5,"grad":1,"children":[]},...],"root":n}.
+    void write_dot(std::ostream& os) const;
+    void write_json(std::ostream& os) const;
 
 //    Value get_view() const;  // redundant with how copy constructor works --Get a new Value object that points to the same node and structure as this one
 
@@ -149,6 +263,16 @@ public:
     void set_data(T data);
     void set_grad(T grad);
 
+    // Leaves created with requires_grad=false (or frozen with set_requires_grad(false)) are
+    // constants: operations on constants only are folded into a new constant right away, and
+    // operations mixing them with other Values store their data in the node like a scalar
+    // operand. So constants never show up in graphs (and get no gradient), but operations
+    // recorded with them do not follow later set_data() calls on them either. A leaf frozen after
+    // it was used stays an operand of the nodes recorded before, but backward passes skip its
+    // gradient, which keeps its value.
+    bool requires_grad() const;
+    void set_requires_grad(bool requires_grad);  // only for leaves
+
     // User-defined conversion functions (so you can go int(Value(3)), float(Value(3)) etc.)
     // Implicit conversion functions seem to break gradient descent: Values are implicitly reduced to doubles and then copy-constructed, losing the gradient information
     explicit operator double() const;  // originally allowed implicit here, but this led to creation of new objects from old objects, losing object state
@@ -156,8 +280,29 @@ public:
     explicit operator float() const;
 
 protected:
+    friend class Tape<T>;
+    friend class DataParallel<T>;
+    friend class Program<T>;
+    friend class Checkpoint<T>;
+    friend class Autograd<T>;
+    friend class ParameterSet<T>;
+
     std::shared_ptr<Node> node_{nullptr};
-    void topological_order(const std::shared_ptr<Node>& node, std::vector<std::shared_ptr<Node>>& topo, std::unordered_set<std::shared_ptr<Node>>& visited);
+    template<typename... Args>
+    static std::shared_ptr<Node> make_node(Args&&... args);  // on the active Tape if there is one, on the heap otherwise
+    static std::shared_ptr<Node> replicate(std::shared_ptr<Node> child);  // see DataParallel
+    // Result of op on the given operands: a node, or a constant if none of them requires a gradient
+    // (or a NoGradGuard is active)
+    static Value record(T data, Op op, const std::shared_ptr<Node>& ch1, const std::shared_ptr<Node>& ch2, T param=0);
+    [[gnu::noinline]] static Value record_constant(T data, Op op, const std::shared_ptr<Node>& ch1, const std::shared_ptr<Node>& ch2);
+    Value reversed(Op op, T other) const;  // other op *this, for rsub and rdiv
+    static void topological_order(Node* root, std::vector<Node*>& out_topo);
+    static void topological_order(std::span<Node* const> roots, std::vector<Node*>& out_topo);  // of several roots
+    static void backward(Node* root, const std::vector<Node*>& topo);
+    static void backward(Node* root, const std::vector<Node*>& topo, ThreadPool& pool, bool deterministic);
+
+private:
+    struct ParallelBackward;
 };
 
 template<typename T>
@@ -167,3 +312,6 @@ std::ostream& operator<<(std::ostream& os, const Value<T>& v);
 
 // Needed because this is a template library
 #include "value.hpp"
+#include "tape.h"
+#include "data_parallel.h"
+#include "program.h"
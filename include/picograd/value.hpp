@@ -1,24 +1,54 @@
 #include "value.h"
 #include <iostream>
 #include <vector>
-#include <unordered_set>
+#include <algorithm>        // std::sort
+#include <utility>          // std::pair
 #include <cmath>            // std::log, std::pow, std::exp
 #include <memory>           // smart pointers
 
 namespace ajs {
 
+template<typename T>
+template<typename... Args>
+std::shared_ptr<typename Value<T>::Node> Value<T>::make_node(Args&&... args) {
+    if (auto tape = Tape<T>::active()) {
+        // Aliasing constructor with an empty owner: we get a non-null pointer without a control block,
+        // so copying it around (into Values, children, ...) does not touch any reference counts.
+        // The Tape owns the node and destroys it on reset().
+        return std::shared_ptr<Node>(std::shared_ptr<Node>{}, tape->emplace(std::forward<Args>(args)...));
+    }
+#ifdef PICOGRAD_PROFILE
+    return std::allocate_shared<Node>(profile::detail::CountingAllocator<Node>{}, std::forward<Args>(args)...);
+#else
+    return std::make_shared<Node>(std::forward<Args>(args)...);
+#endif
+}
+
+template<typename T>
+std::shared_ptr<typename Value<T>::Node> Value<T>::replicate(std::shared_ptr<Node> child) {
+    // Operands that are DataParallel parameters get swapped for the current shard's copy, if any
+    if (child && child->data_parallel) return DataParallel<T>::replica(std::move(child));
+    return child;
+}
+
 template<typename T>
 Value<T>::Value(): Value{0} {
     LOG("Default constructor deferring to number-only constructor: " << *this);
 }
 
 template<typename T>
-Value<T>::Value(const T data): node_{std::make_shared<Node>(data)} {
+Value<T>::Value(const T data): node_{make_node(data)} {
     LOG("Number-only constructor: " << *this);
 }
 
 template<typename T>
-Value<T>::Value(std::shared_ptr<Node> node): node_{node} {
+Value<T>::Value(const T data, bool requires_grad): node_{make_node(data)} {
+    node_->requires_grad = requires_grad;
+    LOG("Number-only constructor: " << *this << (requires_grad ? "" : " (constant)"));
+}
+
+template<typename T>
+Value<T>::Value(std::shared_ptr<Node> node): node_{std::move(node)} {
     LOG("Constructor with node: " << *this);
 }
 
@@ -59,247 +89,194 @@ Value<T>::~Value() {
 
 
 template<typename T>
-Value<T> Value<T>::operator+(const Value<T>& other) const {
-    LOG("forward pass for " << *this << " + " << other);
-    auto out_node = std::make_shared<Node>(get_data() + other.get_data(), Op::add, node_, other.node_);
-
-    struct lambda {  // native lambda function work just as well but the debugger refuses to jump into them (for performance, it does not matter): https://stackoverflow.com/questions/50346822/does-lambda-object-construction-cost-a-lot
-        std::shared_ptr<Node> out_node;
-        void operator()() {
-            auto a = out_node->child1;
-            auto b = out_node->child2;
-            auto grad = out_node->grad;
-            a->grad += 1 * grad + 0 * grad;  // for clarity
-            b->grad += 0 * grad + 1 * grad;
-            LOG(out_node->op_str() << " backward result: " << a->str() << ", " << b->str());
-        };
-    };
-
-    // TODO: maybe change to struct-based functors for easier debugging
-    out_node->backward = lambda{out_node};
-    return Value(out_node);
+Value<T> Value<T>::record(T data, Op op, const std::shared_ptr<Node>& ch1, const std::shared_ptr<Node>& ch2, T param) {
+    profile::OpTimer timer(op, profile::Pass::forward);
+    if (ch1->requires_grad && (!ch2 || ch2->requires_grad) && !NoGradGuard::active()) [[likely]] {
+        return Value(make_node(data, op, ch1, ch2, param));
+    }
+    return record_constant(data, op, ch1, ch2);
 }
 
-
-/*  // attempt to use std::variant to avoid code duplication. giving up for now :(
 template<typename T>
-struct PowVisitor {
-    T& data_;
-    int to_add_;
-    PowVisitor(const T& data): data_{data}, to_add_{0} {};
-    PowVisitor(const T& data, const int& to_add): data_{data}, to_add_{to_add} {};
-
-    T operator()(int exponent) {
-        return std::pow(data_, exponent + to_add_);
-    }
-    T operator()(float exponent) {
-        return std::pow(data_, exponent + to_add_);
+Value<T> Value<T>::record_constant(T data, Op op, const std::shared_ptr<Node>& ch1, const std::shared_ptr<Node>& ch2) {
+    // Constants do not become operands of new nodes: operations on constants only are folded, and
+    // a constant operand of a binary op is stored in the node like a scalar operand
+    if (NoGradGuard::active() || (!ch1->requires_grad && !(ch2 && ch2->requires_grad))) {
+        LOG("folding " << op_str(op) << " of constants");
+        return Value(data, false);
     }
-};
-
-// another try. sadly, visitors with varying return types are not allowed.
-struct Visitor {
-    int operator()(int x) {
-        return x;
-    }
-    float operator()(float x) {
-        return x;
-    }
-};
+    if (ch1->requires_grad) return Value(make_node(data, op, ch1, nullptr, ch2->data));
+    auto swapped = op == Op::sub ? Op::rsub : op == Op::div ? Op::rdiv : op;  // add and mult commute
+    return Value(make_node(data, swapped, ch2, nullptr, ch1->data));
+}
 
 template<typename T>
-Value<T> Value<T>::pow(std::variant<int, float> exponent) {
-    using ExpType = std::decay_t<decltype(exponent)>;
-    ExpType exp_val;  // Trying to use decltype to get type and use exp_val as out-param did not work either :( :(
-    std::visit([&](auto x){ exp_val = x; }, exponent);
-    LOG("at " << *this << ".pow(" << exp_val << ")");
-    T out_val = std::pow(data_, exp_val);
-    Value out{out_val, "pow", {this, nullptr}};
-
-    out.backward_ = [&out, exp_val](){
-        auto [a, b] = out.children_;
-        a->grad_ += out.grad_ * exp_val*std::pow(a->data_, exp_val-1);
-        LOG(out.op_ << " backward result: " << *a);
-    };
-    return out;
+Value<T> Value<T>::operator+(const Value<T>& other) const {
+    LOG("forward pass for " << *this << " + " << other);
+    return record(kernels::forward(Op::add, get_data(), other.get_data()), Op::add, node_, other.node_);
 }
-*/
 
 template<typename T>
-Value<T> Value<T>::pow(int exponent) const {  // TODO get rid of code duplication. How to keep it working with std::pow? std::variant and std::visit?
+Value<T> Value<T>::pow(int exponent) const {
     LOG("forward pass for " << *this << ".pow(" << exponent << ")");
-    auto out_node = std::make_shared<Node>(std::pow(get_data(), exponent), Op::pow, node_, nullptr);
-
-    struct lambda {  // native lambda function work just as well but the debugger refuses to jump into them (for performance, it does not matter): https://stackoverflow.com/questions/50346822/does-lambda-object-construction-cost-a-lot
-        std::shared_ptr<Node> out_node;
-        int exponent;
-        void operator()() {
-            auto a = out_node->child1;
-            auto grad = out_node->grad;
-            a->grad += grad * exponent*std::pow(a->data, exponent-1);
-            LOG(out_node->op_str() << " backward result: " << a->str());
-        };
-    };
-
-    out_node->backward = lambda{out_node, exponent};
-    return Value(out_node);
+    return record(kernels::forward(Op::pow, get_data(), T(exponent)), Op::pow, node_, nullptr, T(exponent));
 }
 
 template<typename T>
-Value<T> Value<T>::pow(float exponent) const {  // TODO get rid of code duplication. How to keep it working with std::pow? std::variant and std::visit?
+Value<T> Value<T>::pow(float exponent) const {
     LOG("forward pass for " << *this << ".pow(" << exponent << ")");
-    auto out_node = std::make_shared<Node>(std::pow(get_data(), exponent), Op::pow, node_, nullptr);
-
-    struct lambda {  // native lambda function work just as well but the debugger refuses to jump into them (for performance, it does not matter): https://stackoverflow.com/questions/50346822/does-lambda-object-construction-cost-a-lot
-        std::shared_ptr<Node> out_node;
-        float exponent;
-        void operator()() {
-            auto a = out_node->child1;
-            auto grad = out_node->grad;
-            a->grad += grad * exponent*std::pow(a->data, exponent-1);
-            LOG(out_node->op_str() << " backward result: " << a->str());
-        };
-    };
+    return record(kernels::forward(Op::pow, get_data(), T(exponent)), Op::pow, node_, nullptr, T(exponent));
+}
 
-    out_node->backward = lambda{out_node, exponent};
-    return Value(out_node);
+template<typename T>
+Value<T> Value<T>::square() const {
+    LOG("forward pass for " << *this << ".square()");
+    return record(kernels::forward(Op::square, get_data()), Op::square, node_, nullptr);
 }
 
 template<typename T>
 Value<T> Value<T>::operator*(const Value<T>& other) const {
     LOG("forward pass for " << *this << " * " << other);
-    auto out_node = std::make_shared<Node>(get_data() * other.get_data(), Op::mult, node_, other.node_);
-
-    struct lambda {  // native lambda function work just as well but the debugger refuses to jump into them (for performance, it does not matter): https://stackoverflow.com/questions/50346822/does-lambda-object-construction-cost-a-lot
-        std::shared_ptr<Node> out_node;
-        void operator()() {
-            auto a = out_node->child1;
-            auto b = out_node->child2;
-            auto grad = out_node->grad;
-            a->grad += grad * b->data;
-            b->grad += grad * a->data;
-            LOG(out_node->op_str() << " backward result: " << a->str() << ", " << b->str());
-        };
-    };
-
-    out_node->backward = lambda{out_node};
-    return Value(out_node);
+    return record(kernels::forward(Op::mult, get_data(), other.get_data()), Op::mult, node_, other.node_);
 }
 
 template<typename T>
 Value<T> Value<T>::operator-() const {
     LOG("forward pass for -" << *this);
-    return *this * -1;
+    return record(kernels::forward(Op::neg, get_data()), Op::neg, node_, nullptr);
 }
 
 template<typename T>
 Value<T> Value<T>::operator-(const Value<T>& other) const {
     LOG("forward pass for " << *this << " - " << other);
-    return *this + (-other);
+    return record(kernels::forward(Op::sub, get_data(), other.get_data()), Op::sub, node_, other.node_);
 }
 
 template<typename T>
 Value<T> Value<T>::operator/(const Value<T>& other) const {
     LOG("forward pass for " << *this << " / " << other);
-    return *this * other.pow(-1);
+    return record(kernels::forward(Op::div, get_data(), other.get_data()), Op::div, node_, other.node_);
+}
+
+template<typename T>
+Value<T> Value<T>::operator+(T other) const {
+    LOG("forward pass for " << *this << " + " << other);
+    return record(kernels::forward(Op::add, get_data(), other), Op::add, node_, nullptr, other);
+}
+
+template<typename T>
+Value<T> Value<T>::operator-(T other) const {
+    LOG("forward pass for " << *this << " - " << other);
+    return record(kernels::forward(Op::sub, get_data(), other), Op::sub, node_, nullptr, other);
+}
+
+template<typename T>
+Value<T> Value<T>::operator*(T other) const {
+    LOG("forward pass for " << *this << " * " << other);
+    return record(kernels::forward(Op::mult, get_data(), other), Op::mult, node_, nullptr, other);
+}
+
+template<typename T>
+Value<T> Value<T>::operator/(T other) const {
+    LOG("forward pass for " << *this << " / " << other);
+    return record(kernels::forward(Op::div, get_data(), other), Op::div, node_, nullptr, other);
+}
+
+template<typename T>
+Value<T> Value<T>::reversed(Op op, T other) const {
+    LOG("forward pass for " << other << " " << op_str(op) << " " << *this);
+    return record(kernels::forward(op, get_data(), other), op, node_, nullptr, other);
 }
 
 template<typename T>
 Value<T> Value<T>::exp() const {
     LOG("forward pass for " << *this << ".exp()");
-    auto out_node = std::make_shared<Node>(std::exp(get_data()), Op::exp, node_, nullptr);
-
-    struct lambda {  // native lambda function work just as well but the debugger refuses to jump into them (for performance, it does not matter): https://stackoverflow.com/questions/50346822/does-lambda-object-construction-cost-a-lot
-        std::shared_ptr<Node> out_node;
-        void operator()() {
-            auto a = out_node->child1;
-            auto grad = out_node->grad;
-            a->grad += grad * out_node->data;
-            LOG(out_node->op_str() << " backward result: " << a->str());
-        };
-    };
-
-    out_node->backward = lambda{out_node};
-    return Value(out_node);
+    return record(kernels::forward(Op::exp, get_data()), Op::exp, node_, nullptr);
 }
 
 template<typename T>
 Value<T> Value<T>::log() const {
     LOG("forward pass for " << *this << ".log()");
-    auto safe_data = get_data() != 0 ? get_data() : 1.0E-15f;  // TODO: necessary? is there a better way?
-    auto out_node = std::make_shared<Node>(std::log(safe_data), Op::log, node_, nullptr);
-
-    struct lambda {  // native lambda function work just as well but the debugger refuses to jump into them (for performance, it does not matter): https://stackoverflow.com/questions/50346822/does-lambda-object-construction-cost-a-lot
-        std::shared_ptr<Node> out_node;
-        T safe_data;
-        void operator()() {
-            auto a = out_node->child1;
-            auto grad = out_node->grad;
-            a->grad += grad * (1 / safe_data);
-            LOG(out_node->op_str() << " backward result: " << a->str());
-        };
-    };
-
-    out_node->backward = lambda{out_node, safe_data};
-    return Value(out_node);
+    return record(kernels::forward(Op::log, get_data()), Op::log, node_, nullptr);
 }
 
 template<typename T>
 Value<T> Value<T>::tanh() const {
     LOG("forward pass for " << *this << ".tanh()");
-    T exp_val = std::exp(get_data() * 2);
-    auto out_node = std::make_shared<Node>((exp_val - 1) / (exp_val + 1), Op::tanh, node_, nullptr);
-
-    struct lambda {  // native lambda function work just as well but the debugger refuses to jump into them (for performance, it does not matter): https://stackoverflow.com/questions/50346822/does-lambda-object-construction-cost-a-lot
-        std::shared_ptr<Node> out_node;
-        void operator()() {
-            auto a = out_node->child1;
-            auto grad = out_node->grad;
-            a->grad += grad * (1 - std::pow(out_node->data, 2));
-            LOG(out_node->op_str() << " backward result: " << a->str());
-        };
-    };
-
-    out_node->backward = lambda{out_node};
-    return Value(out_node);
+    return record(kernels::forward(Op::tanh, get_data()), Op::tanh, node_, nullptr);
 }
 
 template<typename T>
 Value<T> Value<T>::relu() const {
     LOG("forward pass for " << *this << ".relu()");
-    auto out_node = std::make_shared<Node>(get_data() > 0 ? get_data() : 0, Op::relu, node_, nullptr);
-
-    struct lambda {  // native lambda function work just as well but the debugger refuses to jump into them (for performance, it does not matter): https://stackoverflow.com/questions/50346822/does-lambda-object-construction-cost-a-lot
-        std::shared_ptr<Node> out_node;
-        void operator()() {
-            auto a = out_node->child1;
-            auto grad = out_node->grad;
-            a->grad += grad * (out_node->data > 0 ? 1 : 0);
-            LOG(out_node->op_str() << " backward result: " << a->str());
-        };
-    };
-
-    out_node->backward = lambda{out_node};
-    return Value(out_node);
+    return record(kernels::forward(Op::relu, get_data()), Op::relu, node_, nullptr);
 }
 
 template<typename T>
 Value<T> Value<T>::sigmoid() const {
     LOG("forward pass for " << *this << ".sigmoid()");
-    auto out_node = std::make_shared<Node>(T(1) / (T(1) + std::exp(-get_data())), Op::sigmoid, node_, nullptr);
-
-    struct lambda {  // native lambda function work just as well but the debugger refuses to jump into them (for performance, it does not matter): https://stackoverflow.com/questions/50346822/does-lambda-object-construction-cost-a-lot
-        std::shared_ptr<Node> out_node;
-        void operator()() {
-            auto a = out_node->child1;
-            auto grad = out_node->grad;
-            a->grad += grad * out_node->data * (1 - out_node->data);
-            LOG(out_node->op_str() << " backward result: " << a->str());
-        };
-    };
-
-    out_node->backward = lambda{out_node};
-    return Value(out_node);
+    return record(kernels::forward(Op::sigmoid, get_data()), Op::sigmoid, node_, nullptr);
+}
+
+template<typename T>
+Value<T> Value<T>::linear(T data, std::span<const Value* const> operands, std::span<const T> derivatives) {
+    LOG("forward pass for linear node with " << operands.size() << " operands");
+    if (NoGradGuard::active()) return Value(data, false);
+    // Merge repeated operands into their first occurrence. Expressions are small, and for them a
+    // quadratic scan is cheapest; long operand lists (see functional.h) are sorted by node instead.
+    constexpr std::size_t scan_limit = 16;
+    thread_local std::vector<std::pair<const Node*, std::size_t>> sorted{};  // reused, so that we only allocate when inputs grow
+    thread_local std::vector<T> merged{};  // per operand, the sum of the derivatives of its occurrences
+    thread_local std::vector<bool> repeat{};
+    auto n = operands.size();
+    if (n > scan_limit) {
+        sorted.resize(n);
+        merged.assign(derivatives.begin(), derivatives.end());
+        repeat.assign(n, false);
+        for (std::size_t i = 0; i < n; ++i) sorted[i] = {operands[i]->node_.get(), i};
+        std::sort(sorted.begin(), sorted.end());
+        for (std::size_t i = 1; i < n; ++i) {
+            auto [node, position] = sorted[i];
+            if (node != sorted[i - 1].first) continue;
+            auto first_position = sorted[i - 1].second;
+            sorted[i].second = first_position;  // so that later repeats find it too
+            merged[first_position] += merged[position];
+            repeat[position] = true;
+        }
+    }
+    // Chain the distinct operands: the first node takes two of them, every further node the
+    // previous node (with derivative 1) and one more operand. Only the last node is visible, so
+    // all of them can carry the final data.
+    std::shared_ptr<Node> first{nullptr};
+    T first_derivative{0};
+    std::shared_ptr<Node> chain{nullptr};
+    for (std::size_t i = 0; i < n; ++i) {
+        auto& node = operands[i]->node_;
+        if (!node->requires_grad) continue;
+        T derivative;
+        if (n > scan_limit) {
+            if (repeat[i]) continue;
+            derivative = merged[i];
+        }
+        else {
+            bool repeated = false;
+            for (std::size_t j = 0; j < i && !repeated; ++j) repeated = operands[j]->node_ == node;
+            if (repeated) continue;
+            derivative = derivatives[i];
+            for (auto j = i + 1; j < n; ++j) {
+                if (operands[j]->node_ == node) derivative += derivatives[j];
+            }
+        }
+        if (!first) {
+            first = node;
+            first_derivative = derivative;
+        }
+        else if (!chain) chain = make_node(data, Op::linear, first, node, first_derivative, derivative);
+        else chain = make_node(data, Op::linear, std::move(chain), node, T(1), derivative);
+    }
+    if (chain) return Value(std::move(chain));
+    if (first) return Value(make_node(data, Op::linear, std::move(first), nullptr, first_derivative));
+    return Value(data, false);  // constant operands only
 }
 
 
@@ -329,6 +306,30 @@ Value<T> Value<T>::operator/=(const Value& other) {
     return *this;
 }
 
+template<typename T>
+Value<T> Value<T>::operator+=(T other) {
+    *this = *this + other;
+    return *this;
+}
+
+template<typename T>
+Value<T> Value<T>::operator*=(T other) {
+    *this = *this * other;
+    return *this;
+}
+
+template<typename T>
+Value<T> Value<T>::operator-=(T other) {
+    *this = *this - other;
+    return *this;
+}
+
+template<typename T>
+Value<T> Value<T>::operator/=(T other) {
+    *this = *this / other;
+    return *this;
+}
+
 
 
 template<typename T>
@@ -351,38 +352,169 @@ bool Value<T>::operator<(const Value<T>& other) const {
 
 
 template<typename T>
-void Value<T>::topological_order(
-        const std::shared_ptr<Node>& node,  // we only ever want to look at them, but don't own them (and they won't disappear mid-processing)
-        std::vector<std::shared_ptr<Node>>& inout_topo,
-        std::unordered_set<std::shared_ptr<Node>>& inout_visited) {
-    if (!inout_visited.contains(node)) {
-        inout_visited.insert(node);
-        if (node->child1 != nullptr) {  // todo: use std::optional?
-            topological_order(node->child1, inout_topo, inout_visited);
-        }
-        if (node->child2 != nullptr) {  // todo: use std::optional?
-            topological_order(node->child2, inout_topo, inout_visited);
-        }
-        inout_topo.push_back(node);  // AFTER pushing the dependent nodes
-        // TODO: push_back shares ownership by copying -- necessary? Alternatives?
-    }
+void Value<T>::topological_order(Node* root, std::vector<Node*>& out_topo) {
+    topological_order(std::span<Node* const>(&root, 1), out_topo);
 }
 
 template<typename T>
-void Value<T>::backward() {
-    std::vector<std::shared_ptr<Node>> topo{};
-    std::unordered_set<std::shared_ptr<Node>> visited{};
-    topological_order(node_, topo, visited);
-//        std::cout << *this << " vs " << *topo.front() << std::endl;
-    set_grad(1);
+void Value<T>::topological_order(std::span<Node* const> roots, std::vector<Node*>& out_topo) {
+    profile::SortTimer timer;
+    detail::topological_order(roots, out_topo);
+    timer.sorted(out_topo);
+}
+
+template<typename T>
+void Value<T>::backward(Node* root, const std::vector<Node*>& topo) {
+    profile::Scope scope("backward");
+    // Gradients of inner nodes are derived from scratch on every pass (only leaves accumulate)
+    for (auto node : topo) {
+        if (node->op != Op::none) node->grad = 0;
+    }
+    root->grad = 1;
     for (auto iter_node = topo.rbegin(); iter_node != topo.rend(); ++iter_node) {
         LOG("Processing " << (*iter_node)->str());
-        auto back_func = (*iter_node)->backward;
-        if (back_func != nullptr) {
-            LOG("Calling " << (**iter_node).str() << ".backward():");
-            back_func();
+        (*iter_node)->backward();
+    }
+}
+
+template<typename T>
+void Value<T>::backward() {
+    thread_local std::vector<Node*> topo{};  // reused, so that we only allocate when graphs grow
+    topological_order(node_.get(), topo);
+    backward(node_.get(), topo);
+}
+
+// State shared by the tasks of one parallel backward pass. Nodes are referred to by their position
+// in the topological order (Node::index), and each node counts the users whose gradient
+// contribution it is still waiting for; whoever delivers the last one goes on to process it.
+template<typename T>
+struct Value<T>::ParallelBackward {
+    const std::vector<Node*>* topo;
+    ThreadPool* pool;
+    bool deterministic;
+    std::vector<std::uint32_t> pending;  // per node, the number of users not done yet
+    // Deterministic mode only: each edge (user -> child) gets a slot for its contribution. The
+    // slots of a child are contiguous (from first[child] on) and ordered like the serial pass
+    // visits the users, so that adding them up in sequence reproduces the serial result.
+    std::vector<std::uint32_t> first;
+    std::vector<std::uint32_t> slot;  // per node, the slots of the edges to its child1 and child2
+    std::vector<std::uint32_t> filled;  // per node, the number of its slots assigned so far
+    std::vector<T> contributions;
+
+    void prepare(const std::vector<Node*>& nodes) {
+        auto n = nodes.size();
+        topo = &nodes;
+        pending.assign(n, 0);
+        for (std::size_t i = 0; i < n; ++i) {  // children come first, so their index is already set
+            auto node = nodes[i];
+            node->index = static_cast<std::uint32_t>(i);
+            if (node->op != Op::none && !deterministic) node->grad = 0;
+            if (node->child1) ++pending[node->child1->index];
+            if (node->child2) ++pending[node->child2->index];
+        }
+        if (!deterministic) return;
+        first.resize(n + 1);
+        first[0] = 0;
+        for (std::size_t i = 0; i < n; ++i) first[i + 1] = first[i] + pending[i];
+        filled.assign(n, 0);
+        slot.resize(2 * n);
+        for (std::size_t i = n; i-- > 0; ) {  // users before their children, like the serial pass
+            auto node = nodes[i];
+            if (node->child1) slot[2 * i] = first[node->child1->index] + filled[node->child1->index]++;
+            if (node->child2) slot[2 * i + 1] = first[node->child2->index] + filled[node->child2->index]++;
         }
+        contributions.resize(first[n]);
     }
+
+    // Accounts for one contribution to `child`; true if it was the last one (child is ready).
+    // If no other user is left (the common case of a single user), nobody else can touch the
+    // child's grad and count anymore, and we get away without atomic read-modify-writes.
+    bool deliver(std::size_t i, int k, Node* child, T grad) {
+        std::atomic_ref<std::uint32_t> count(pending[child->index]);
+        bool last = count.load(std::memory_order_acquire) == 1;
+        if (deterministic) contributions[slot[2 * i + k]] = grad;
+        else if (last) child->grad += grad;
+        else std::atomic_ref<T>(child->grad).fetch_add(grad, std::memory_order_relaxed);
+        if (last) {
+            count.store(0, std::memory_order_relaxed);
+            return true;
+        }
+        return count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    static void run(void* context, std::size_t i) {
+        auto& self = *static_cast<ParallelBackward*>(context);
+        auto root = self.topo->size() - 1;
+        while (true) {  // follows one ready child inline, spawns tasks for the others
+            Node* node = (*self.topo)[i];
+            if (self.deterministic && i != root) {
+                T grad = node->op == Op::none ? node->grad : T(0);  // only leaves accumulate
+                for (auto s = self.first[i]; s < self.first[i + 1]; ++s) grad += self.contributions[s];
+                node->grad = grad;
+            }
+            if (node->op == Op::none) return;
+            T grad1{0};
+            T grad2{0};
+            {
+                profile::OpTimer timer(node->op, profile::Pass::backward);
+                kernels::backward(node->op, node->data, node->grad, node->operand1(), node->operand2(), grad1, grad2);
+            }
+            if (!node->child1->requires_grad) grad1 = 0;  // frozen leaves keep their gradient
+            if (node->child2 && !node->child2->requires_grad) grad2 = 0;
+            bool ready1 = self.deliver(i, 0, node->child1.get(), grad1);
+            bool ready2 = node->child2 && self.deliver(i, 1, node->child2.get(), grad2);
+            if (ready1 && ready2) {
+                self.pool->spawn({&ParallelBackward::run, &self, node->child2->index});
+            }
+            if (ready1) i = node->child1->index;
+            else if (ready2) i = node->child2->index;
+            else return;
+        }
+    }
+};
+
+template<typename T>
+void Value<T>::backward(Node* root, const std::vector<Node*>& topo, ThreadPool& pool, bool deterministic) {
+    if (pool.size() == 1) return backward(root, topo);  // same result, without the bookkeeping
+    profile::Scope scope("parallel backward");
+    thread_local ParallelBackward state{};  // reused, so that we only allocate when graphs grow
+    state.pool = &pool;
+    state.deterministic = deterministic;
+    state.prepare(topo);
+    root->grad = 1;
+    pool.run([&] { ParallelBackward::run(&state, topo.size() - 1); });
+}
+
+template<typename T>
+void Value<T>::backward(ThreadPool& pool, bool deterministic) {
+    thread_local std::vector<Node*> topo{};
+    topological_order(node_.get(), topo);
+    backward(node_.get(), topo, pool, deterministic);
+}
+
+template<typename T>
+typename Value<T>::Order Value<T>::topological_order() const {
+    Order order;
+    order.root_ = node_;
+    topological_order(node_.get(), order.nodes_);
+    return order;
+}
+
+template<typename T>
+void Value<T>::Order::forward() {
+    for (auto node : nodes_) {
+        node->forward();
+    }
+}
+
+template<typename T>
+void Value<T>::Order::backward() {
+    Value::backward(root_.get(), nodes_);
+}
+
+template<typename T>
+void Value<T>::Order::backward(ThreadPool& pool, bool deterministic) {
+    Value::backward(root_.get(), nodes_, pool, deterministic);
 }
 
 
@@ -391,6 +523,42 @@ void Value<T>::print_graph() {
     if (node_) node_.get()->print_graph();
 }
 
+template<typename T>
+void Value<T>::write_dot(std::ostream& os) const {
+    std::vector<Node*> order;
+    topological_order(node_.get(), order);
+    os << "digraph picograd {\n";
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        auto node = order[i];
+        node->index = std::uint32_t(i);  // children are numbered before their parents
+        os << "  n" << i << " [label=\"" << op_str(node->op) << "\\ndata " << node->data << "\\ngrad " << node->grad << "\"];\n";
+        if (node->child1) os << "  n" << node->child1->index << " -> n" << i << ";\n";
+        if (node->child2) os << "  n" << node->child2->index << " -> n" << i << ";\n";
+    }
+    os << "}\n";
+}
+
+template<typename T>
+void Value<T>::write_json(std::ostream& os) const {
+    auto number = [&os](T x) -> std::ostream& {
+        return std::isfinite(x) ? os << x : os << "null";  // JSON has no NaN or infinity
+    };
+    std::vector<Node*> order;
+    topological_order(node_.get(), order);
+    os << R"({"nodes":[)";
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        auto node = order[i];
+        node->index = std::uint32_t(i);
+        os << (i ? ",\n" : "\n") << R"({"id":)" << i << R"(,"op":")" << op_str(node->op) << R"(","data":)";
+        number(node->data) << R"(,"grad":)";
+        number(node->grad) << R"(,"children":[)";
+        if (node->child1) os << node->child1->index;
+        if (node->child2) os << "," << node->child2->index;
+        os << "]}";
+    }
+    os << "\n]," << R"("root":)" << order.size() - 1 << "}\n";
+}
+
 
 //template<typename T>
 //Value<T> Value<T>::get_view() const {  // redundant with how copy constructor works
@@ -423,6 +591,16 @@ inline
 void Value<T>::set_grad(T grad) {
     node_->grad = grad;
 }
+template<typename T>
+inline
+bool Value<T>::requires_grad() const {
+    return node_->requires_grad;
+}
+template<typename T>
+void Value<T>::set_requires_grad(bool requires_grad) {
+    if (node_->op != Op::none) throw std::logic_error("only leaves can be frozen");
+    node_->requires_grad = requires_grad;
+}
 
 
 template<typename T>
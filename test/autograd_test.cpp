@@ -0,0 +1,111 @@
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <functional>
+#include <vector>
+
+#include "picograd/autograd.h"
+#include "picograd/expr.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+using Values = std::vector<Value<double>>;
+using Function = std::function<Value<double>(const Value<double>&, const Value<double>&)>;
+
+// dy/dx at (x, y) as computed by a fresh graph's backward pass
+std::vector<double> gradient(const Function& f, double x, double y) {
+    Values xs{x, y};
+    f(xs[0], xs[1]).backward();
+    return {xs[0].get_grad(), xs[1].get_grad()};
+}
+
+} // namespace
+
+TEST(Autograd, GradMatchesBackward) {
+    Values xs{0.7, -1.3};
+    auto y = (xs[0] * xs[1]).tanh() + xs[0] / xs[1] - xs[1].exp();
+    auto unrelated = Value(2.0);
+    auto g = grad(y, Values{xs[0], xs[1], unrelated});
+    auto g2 = grad(y, Values{xs[0], xs[1], unrelated}, true);
+    y.backward();
+    for (std::size_t i = 0; i < 2; ++i) {
+        EXPECT_DOUBLE_EQ(g[i].get_data(), xs[i].get_grad());
+        EXPECT_NEAR(g2[i].get_data(), xs[i].get_grad(), 1e-14);
+        EXPECT_FALSE(g[i].requires_grad());
+        EXPECT_TRUE(g2[i].requires_grad());
+    }
+    EXPECT_EQ(g[2].get_data(), 0.0);
+    EXPECT_EQ(unrelated.get_grad(), 0.0);  // grad() leaves the nodes' gradients alone
+}
+
+TEST(Autograd, HessianVectorProducts) {
+    // Every op, against central differences of the gradient
+    std::vector<Function> functions{
+        [](auto& x, auto& y) { return x * x * y + x / y - y; },
+        [](auto& x, auto& y) { return (x * y).exp() + (x * x + 1).log() + (2 - x) * (1 / y); },
+        [](auto& x, auto& y) { return (x - y).tanh() * (x * y).sigmoid() + (-x * 3).square(); },
+        [](auto& x, auto& y) { return x.pow(3) * y.pow(2.5f) + (x * y - 0.1).relu() * y; },
+    };
+    double x = 0.8;
+    double y = 1.7;
+    double h = 1e-6;
+    for (std::size_t f = 0; f < functions.size(); ++f) {
+        Values xs{x, y};
+        auto out = functions[f](xs[0], xs[1]);
+        for (auto v : {std::vector<double>{1, 0}, std::vector<double>{0.3, -2}}) {
+            auto hv = hvp(out, xs, v);
+            auto plus = gradient(functions[f], x + h * v[0], y + h * v[1]);
+            auto minus = gradient(functions[f], x - h * v[0], y - h * v[1]);
+            for (std::size_t i = 0; i < 2; ++i) {
+                EXPECT_NEAR(hv[i], (plus[i] - minus[i]) / (2 * h), 1e-6) << "function " << f << ", " << i;
+            }
+        }
+    }
+
+    // Gradient penalty: d/dx of |dy/dx|^2 is 2 H dy/dx
+    Values xs{x, y};
+    auto out = functions[1](xs[0], xs[1]);
+    auto g = grad(out, xs, true);
+    auto penalty = g[0].square() + g[1].square();
+    penalty.backward();
+    auto expected = hvp(out, xs, {2 * g[0].get_data(), 2 * g[1].get_data()});
+    EXPECT_NEAR(xs[0].get_grad(), expected[0], 1e-12);
+    EXPECT_NEAR(xs[1].get_grad(), expected[1], 1e-12);
+
+    auto fused = Value<double>(expr::lazy(xs[0]) * xs[1]);
+    EXPECT_THROW(grad(fused, xs, true), std::invalid_argument);
+
+    // log(0) is clamped in the second-order rules too, like in backward()
+    Values at_zero{0.0, 2.0};
+    auto logged = at_zero[0].log() * at_zero[1];
+    auto dlogged = grad(logged, at_zero, true);
+    logged.backward();
+    EXPECT_DOUBLE_EQ(dlogged[0].get_data(), at_zero[0].get_grad());
+    auto hv = hvp(logged, at_zero, {1, 0});
+    for (auto& leaf : at_zero) leaf.set_grad(0);
+    dlogged[0].backward();
+    EXPECT_EQ(hv[0], 0.0);
+    EXPECT_EQ(at_zero[0].get_grad(), 0.0);
+    EXPECT_DOUBLE_EQ(hv[1], at_zero[1].get_grad());
+    EXPECT_TRUE(std::isfinite(hv[1]));
+}
+
+TEST(Autograd, JacobianVectorProducts) {
+    Values xs{0.4, -0.9};
+    auto z = xs[0] * xs[1];
+    Values ys{z, xs[0].tanh() + xs[1].square() / z};
+    auto jv = jvp(ys, xs, {1.5, -0.5});
+    double x = 0.4;
+    double y = -0.9;
+    double dtanh = 1 - std::tanh(x) * std::tanh(x);
+    // d(y / x)/dx = -y / x^2, d(y / x)/dy = 1 / x
+    EXPECT_NEAR(jv[0], 1.5 * y - 0.5 * x, 1e-14);
+    EXPECT_NEAR(jv[1], 1.5 * (dtanh - y / (x * x)) - 0.5 / x, 1e-14);
+
+    // Inner nodes can be perturbed too; linear nodes are fine in forward mode
+    auto fused = Value<double>(expr::lazy(z).square() * 2);
+    EXPECT_NEAR(jvp(Values{fused}, Values{z}, {1.0})[0], 4 * x * y, 1e-14);
+}
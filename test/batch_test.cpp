@@ -0,0 +1,86 @@
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <vector>
+
+#include "picograd/batch.h"
+#include "picograd/tape.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+// Every op, written once for scalar and batched Values (as in dual_test.cpp)
+template<typename S>
+std::vector<S> function(const std::vector<S>& x) {
+    return {
+        x[0] * x[1] + x[2] / x[0] - x[1],
+        (x[0] * 2.0 + 1.0).exp() * (1.0 - x[1]) + (3.0 / x[2]).log(),
+        (x[0] - x[2]).tanh() * x[1].sigmoid() + (-x[2]).relu() + x[0].relu(),
+        x[0].pow(3) * x[2].pow(1.5f) + x[1].square() / 4.0,
+    };
+}
+
+} // namespace
+
+TEST(Batch, Arithmetic) {
+    using B = Batch<float, 4>;
+    B a{{1, 2, 3, 4}};
+    B b = 2.0f;
+    EXPECT_EQ(a + b, (B{{3, 4, 5, 6}}));
+    EXPECT_EQ(1.0f - a, (B{{0, -1, -2, -3}}));
+    EXPECT_EQ(a * a / b, (B{{0.5f, 2, 4.5f, 8}}));
+    EXPECT_EQ(-a, (B{{-1, -2, -3, -4}}));
+    a += 1.0f;
+    EXPECT_EQ(a, (B{{2, 3, 4, 5}}));
+    EXPECT_EQ(a.sum(), 14.0f);
+}
+
+TEST(Batch, LanesMatchScalarValues) {
+    using B = Batch<double, 5>;
+    // One sample per lane, including relu's kink and log's clamp at 0
+    std::vector<std::vector<double>> samples{{0.6, -1.2, 2.5}, {-0.3, 0.4, 1.5}, {1.1, 2.0, 0.7},
+                                             {0.5, 0.0, 3.0}, {-0.9, -0.1, 0.2}};
+    std::vector<Value<B>> x;
+    for (std::size_t k = 0; k < 3; ++k) {
+        B lanes;
+        for (std::size_t i = 0; i < samples.size(); ++i) lanes[i] = samples[i][k];
+        x.emplace_back(lanes);
+    }
+    auto out = function(x);
+    for (std::size_t j = 0; j < out.size(); ++j) {
+        for (auto& v : x) v.set_grad(0);
+        out[j].backward();
+        for (std::size_t i = 0; i < samples.size(); ++i) {
+            std::vector<Value<double>> scalars(samples[i].begin(), samples[i].end());
+            auto y = function(scalars)[j];
+            y.backward();
+            EXPECT_NEAR(out[j].get_data()[i], y.get_data(), 1e-12 * (1 + std::abs(y.get_data()))) << j << ", " << i;
+            for (std::size_t k = 0; k < 3; ++k) {
+                auto expected = scalars[k].get_grad();
+                EXPECT_NEAR(x[k].get_grad()[i], expected, 1e-12 * (1 + std::abs(expected))) << j << ", " << i << ", " << k;
+            }
+        }
+    }
+
+    B zeros = 0.0;
+    auto log = Value<B>(zeros).log();
+    EXPECT_DOUBLE_EQ(log.get_data()[2], std::log(double(1e-15f)));  // clamped in every lane, like scalars
+}
+
+TEST(Batch, SharedParametersOnATape) {
+    using B = Batch<float, 8>;
+    Value<B> w(0.5f);  // broadcast: the same weight for every sample
+    B inputs;
+    for (std::size_t i = 0; i < B::lanes; ++i) inputs[i] = float(i);
+    Tape<B> tape;
+    Value<B> x(inputs);
+    auto loss = (w * x - 1.0f).square();
+    loss.backward();
+    for (std::size_t i = 0; i < B::lanes; ++i) {
+        EXPECT_FLOAT_EQ(loss.get_data()[i], (0.5f * float(i) - 1.0f) * (0.5f * float(i) - 1.0f));
+        EXPECT_FLOAT_EQ(w.get_grad()[i], 2 * (0.5f * float(i) - 1.0f) * float(i));
+    }
+    EXPECT_EQ(tape.size(), 4u);  // one graph for all 8 samples
+}
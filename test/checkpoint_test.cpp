@@ -0,0 +1,123 @@
+#include "gtest/gtest.h"
+
+#include <stdexcept>
+#include <vector>
+
+#include "picograd/checkpoint.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+using Values = std::vector<Value<double>>;
+
+// A few steps of a two-unit recurrence h = tanh(w * h + u * h' + b), over the parameters in p
+Values steps(const Values& h, const Values& p, int count) {
+    Values state = h;
+    for (int i = 0; i < count; ++i) {
+        state = {(p[0] * state[0] + p[1] * state[1] + p[4]).tanh(),
+                 (p[2] * state[0] + p[3] * state[1] + p[4]).sigmoid()};
+    }
+    return state;
+}
+
+// Gradients of the parameters and the initial state, with segments of four steps (or no
+// checkpointing at all if checkpoint is null)
+Values gradients(Checkpoint<double>* checkpoint, int segments) {
+    Values p{0.9, -0.4, 0.3, 1.1, 0.05};
+    Values state{0.5, -0.25};
+    Values h = state;
+    for (int s = 0; s < segments; ++s) {
+        if (checkpoint) {
+            h = checkpoint->segment([&](const Values& in) { return steps(in, p, 4); }, h);
+        }
+        else {
+            h = steps(h, p, 4);
+        }
+    }
+    auto loss = (h[0] - 0.3).square() + h[1] * h[0];
+    if (checkpoint) checkpoint->backward(loss);
+    else loss.backward();
+
+    Values grads;
+    for (auto& v : p) grads.emplace_back(v.get_grad());
+    for (auto& v : state) grads.emplace_back(v.get_grad());
+    return grads;
+}
+
+} // namespace
+
+TEST(Checkpoint, MatchesFullGraph) {
+    auto expected = gradients(nullptr, 6);
+    std::size_t segment = 4 * 10 * Checkpoint<double>::node_size;  // nodes per segment
+    for (std::size_t budget : {std::size_t(0), 2 * segment + 100, 100 * segment}) {
+        Checkpoint<double> checkpoint(budget);
+        auto grads = gradients(&checkpoint, 6);
+        for (std::size_t i = 0; i < grads.size(); ++i) {
+            EXPECT_NEAR(grads[i].get_data(), expected[i].get_data(), 1e-14) << "budget " << budget << ", " << i;
+        }
+        EXPECT_EQ(checkpoint.segments(), 0u);
+        EXPECT_EQ(checkpoint.kept_bytes(), 0u);
+        // All segments have the same size: one at a time without a budget, two more with a budget
+        // of two, all of them with an unlimited budget
+        std::size_t kept = budget == 0 ? 1 : budget < 100 * segment ? 3 : 6;
+        EXPECT_EQ(checkpoint.peak_bytes(), kept * segment) << "budget " << budget;
+    }
+}
+
+TEST(Checkpoint, StaysWithinBudgetWhileRecording) {
+    Values p{0.9, -0.4, 0.3, 1.1, 0.05};
+    std::size_t segment = 4 * 10 * Checkpoint<double>::node_size;
+    Checkpoint<double> checkpoint(2 * segment + 100);
+    Values h{0.5, -0.25};
+    for (int s = 0; s < 6; ++s) {
+        h = checkpoint.segment([&](const Values& in) { return steps(in, p, 4); }, h);
+        EXPECT_LE(checkpoint.peak_bytes(), 2 * segment);  // the third segment is not built to find out
+    }
+    EXPECT_EQ(checkpoint.kept_bytes(), 2 * segment);
+    checkpoint.backward(h[0] + h[1]);
+    EXPECT_EQ(checkpoint.peak_bytes(), 3 * segment);  // plus one recomputed segment
+
+    // Smaller segments than predicted are kept, bigger ones are recomputed
+    h = checkpoint.segment([&](const Values& in) { return steps(in, p, 2); }, h);
+    EXPECT_EQ(checkpoint.kept_bytes(), segment / 2);
+    h = checkpoint.segment([&](const Values& in) { return steps(in, p, 8); }, h);
+    EXPECT_EQ(checkpoint.kept_bytes(), segment / 2);
+    checkpoint.backward(h[0]);
+    EXPECT_NE(p[0].get_grad(), 0.0);
+}
+
+TEST(Checkpoint, RecomputedSegmentWithOtherOutputs) {
+    Checkpoint<double> checkpoint(0);  // every segment is recomputed
+    Values p{0.9, -0.4, 0.3, 1.1, 0.05};
+    int runs = 0;
+    auto h = checkpoint.segment([&](const Values& in) { return steps(in, p, 4); }, Values{0.5, -0.25});
+    h = checkpoint.segment([&](const Values& in) {
+        auto out = steps(in, p, 4);
+        if (runs++ > 0) out.pop_back();  // not the same function any more
+        return out;
+    }, h);
+    EXPECT_THROW(checkpoint.backward(h[0] + h[1]), std::logic_error);
+    EXPECT_EQ(checkpoint.segments(), 0u);  // released, so that the checkpoint can be used again
+    EXPECT_EQ(checkpoint.kept_bytes(), 0u);
+
+    auto expected = gradients(nullptr, 2);
+    auto grads = gradients(&checkpoint, 2);
+    for (std::size_t i = 0; i < grads.size(); ++i) EXPECT_NEAR(grads[i].get_data(), expected[i].get_data(), 1e-14);
+}
+
+TEST(Checkpoint, SegmentInputsMustBeLeaves) {
+    Checkpoint<double> checkpoint;
+    auto x = Value(1.0);
+    auto identity = [](const Values& in) { return in; };
+    EXPECT_THROW(checkpoint.segment(identity, {x * 2}), std::invalid_argument);
+
+    // Outputs are new leaves; an identity segment passes their gradients straight through
+    auto out = checkpoint.segment(identity, {x});
+    out[0].set_data(2.0);
+    EXPECT_DOUBLE_EQ(x.get_data(), 1.0);
+    checkpoint.backward(out[0] * 3);
+    EXPECT_DOUBLE_EQ(x.get_grad(), 3.0);
+    EXPECT_EQ(checkpoint.peak_bytes(), 0u);
+}
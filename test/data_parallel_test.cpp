@@ -0,0 +1,140 @@
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+// Tiny regression model: one tanh neuron with two inputs, squared error per sample
+struct Model {
+    std::vector<Value<double>> params{Value(0.3), Value(-0.2), Value(0.1)};
+
+    Value<double> loss(std::size_t i) const {
+        double x1 = std::sin(double(i));
+        double x2 = std::cos(0.5 * double(i));
+        double target = x1 > x2 ? 1.0 : -1.0;
+        auto out = (params[0] * x1 + params[1] * x2 + params[2]).tanh();
+        return (out - target).pow(2);
+    }
+
+    Value<double> loss(std::size_t begin, std::size_t end) const {
+        Value<double> sum = 0.0;
+        for (auto i = begin; i < end; ++i) sum = sum + loss(i);
+        return sum;
+    }
+
+    std::vector<double> grads() const {
+        std::vector<double> out;
+        for (auto& p : params) out.push_back(p.get_grad());
+        return out;
+    }
+};
+
+} // namespace
+
+TEST(DataParallel, MatchesSerialBackward) {
+    Model model;
+    auto serial_loss = model.loss(0, 100);
+    serial_loss.backward();
+    auto serial = model.grads();
+    for (auto& p : model.params) p.set_grad(0);
+
+    ThreadPool pool(4);
+    DataParallel<double> trainer(model.params, pool);
+    EXPECT_EQ(trainer.shards(), 4u);
+    auto loss = trainer.step(100, [&](std::size_t begin, std::size_t end) { return model.loss(begin, end); });
+    EXPECT_NEAR(loss, serial_loss.get_data(), 1e-12);
+    auto parallel = model.grads();
+    for (std::size_t i = 0; i < serial.size(); ++i) {
+        EXPECT_NEAR(parallel[i], serial[i], 1e-12);
+    }
+
+    // Gradients accumulate over steps, like backward() into leaves
+    trainer.step(100, [&](std::size_t begin, std::size_t end) { return model.loss(begin, end); });
+    for (std::size_t i = 0; i < serial.size(); ++i) {
+        EXPECT_NEAR(model.grads()[i], 2 * serial[i], 1e-12);
+    }
+}
+
+TEST(DataParallel, SeesParameterUpdates) {
+    Model model;
+    ThreadPool pool(3);
+    DataParallel<double> trainer(model.params, pool);
+    auto loss_fn = [&](std::size_t begin, std::size_t end) { return model.loss(begin, end); };
+    double previous = trainer.step(64, loss_fn);
+    for (int step = 0; step < 20; ++step) {
+        for (auto& p : model.params) {
+            p.set_data(p.get_data() - 0.01 * p.get_grad());
+            p.set_grad(0);
+        }
+        double loss = trainer.step(64, loss_fn);
+        EXPECT_LT(loss, previous);
+        previous = loss;
+    }
+}
+
+TEST(DataParallel, SmallBatchesAndOutsideUse) {
+    Model model;
+    ThreadPool pool(4);
+    {
+        DataParallel<double> trainer(model.params, pool);
+        EXPECT_DOUBLE_EQ(trainer.step(2, [&](std::size_t begin, std::size_t end) { return model.loss(begin, end); }),
+                         model.loss(0, 2).get_data());  // fewer samples than threads
+
+        // Graphs built outside of step() use the parameters themselves
+        auto loss = model.loss(1, 2);
+        for (auto& p : model.params) p.set_grad(0);
+        loss.backward();
+        EXPECT_NE(model.params[0].get_grad(), 0.0);
+    }
+    EXPECT_THROW(DataParallel<double>({model.params[0] * 2}, pool), std::invalid_argument);
+}
+
+TEST(DataParallel, TrainersSharingParameters) {
+    Model model;
+    ThreadPool pool(1);  // one shard, on this thread
+    DataParallel<double> trainer(model.params, pool);
+    bool replicated = false;
+    auto loss_fn = [&](std::size_t begin, std::size_t end) {
+        auto owners = model.params[0].get_node().use_count();
+        auto loss = model.loss(begin, end);
+        replicated = model.params[0].get_node().use_count() == owners;  // the graph uses a copy
+        return loss;
+    };
+    {
+        DataParallel<double> other(model.params, pool);
+        other.step(4, loss_fn);
+        EXPECT_TRUE(replicated);
+    }
+    trainer.step(4, loss_fn);  // still registered after the other trainer is gone
+    EXPECT_TRUE(replicated);
+}
+
+TEST(DataParallel, ThrowingLossLeavesThreadsClean) {
+    Model model;
+    ThreadPool pool(2);
+    {
+        DataParallel<double> trainer(model.params, pool);
+        auto throwing = [&](std::size_t begin, std::size_t end) -> Value<double> {
+            auto loss = model.loss(begin, end);
+            throw std::runtime_error("bad sample");
+            return loss;
+        };
+        EXPECT_THROW(trainer.step(8, throwing), std::runtime_error);  // shard 0 throws on this thread
+
+        // Graphs built outside of step() afterwards use the parameters themselves, not replicas
+        auto owners = model.params[0].get_node().use_count();
+        auto loss = model.loss(0, 1);
+        EXPECT_GT(model.params[0].get_node().use_count(), owners);
+    }
+    auto owners = model.params[0].get_node().use_count();
+    auto loss = model.loss(0, 1);
+    EXPECT_GT(model.params[0].get_node().use_count(), owners);
+    loss.backward();
+    EXPECT_NE(model.params[1].get_grad(), 0.0);  // the first sample has x1 = 0
+}
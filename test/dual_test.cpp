@@ -0,0 +1,73 @@
+#include "gtest/gtest.h"
+
+#include <stdexcept>
+#include <vector>
+
+#include "picograd/dual.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+// Every op, written once for Values and Duals
+template<typename S>
+std::vector<S> function(const std::vector<S>& x) {
+    return {
+        x[0] * x[1] + x[2] / x[0] - x[1],
+        (x[0] * 2.0 + 1.0).exp() * (1.0 - x[1]) + (3.0 / x[2]).log(),
+        (x[0] - x[2]).tanh() * x[1].sigmoid() + (-x[2]).relu() + x[0].relu(),
+        x[0].pow(3) * x[2].pow(1.5f) + x[1].square() / 4.0,
+    };
+}
+
+} // namespace
+
+TEST(Dual, MatchesReverseMode) {
+    std::vector<double> x{0.6, -1.2, 2.5};
+    std::vector<Dual<double, 3>> duals{Dual<double, 3>::variable(x[0], 0), Dual<double, 3>::variable(x[1], 1),
+                                       Dual<double, 3>::variable(x[2], 2)};
+    auto out = function(duals);
+    for (std::size_t i = 0; i < out.size(); ++i) {
+        std::vector<Value<double>> values(x.begin(), x.end());
+        auto y = function(values)[i];
+        y.backward();
+        EXPECT_DOUBLE_EQ(out[i].get_data(), y.get_data());
+        for (std::size_t j = 0; j < x.size(); ++j) {
+            EXPECT_NEAR(out[i].get_tangent(j), values[j].get_grad(), 1e-12) << i << ", " << j;
+        }
+    }
+
+    // Unused lanes and constants stay 0
+    auto partial = Dual<float, 4>::variable(2.0f, 1) * 3.0f + Dual<float, 4>(1.0f);
+    EXPECT_EQ(partial.tangent(), (std::array<float, 4>{0, 3, 0, 0}));
+    EXPECT_THROW((Dual<float, 4>::variable(2.0f, 4)), std::invalid_argument);
+}
+
+TEST(Dual, JacobianModes) {
+    auto f = [](const auto& x) { return function(x); };
+    std::vector<double> x{0.6, -1.2, 2.5};
+    auto reverse = jacobian(f, x, JacobianMode::reverse);
+    ASSERT_EQ(reverse.size(), 4u);
+    for (auto mode : {JacobianMode::automatic, JacobianMode::forward}) {
+        // Two lanes: the third input takes a second forward run
+        auto forward = jacobian<2>(f, x, mode);
+        ASSERT_EQ(forward.size(), 4u);
+        for (std::size_t i = 0; i < 4; ++i) {
+            ASSERT_EQ(forward[i].size(), 3u);
+            for (std::size_t j = 0; j < 3; ++j) EXPECT_NEAR(forward[i][j], reverse[i][j], 1e-12);
+        }
+    }
+
+    // Many inputs, one output: automatic switches to reverse mode after the first forward run
+    auto sum = [](const auto& x) {
+        auto s = x[0];
+        for (std::size_t i = 1; i < x.size(); ++i) s = s + x[i] * x[i];
+        return std::vector{s};
+    };
+    std::vector<double> many(20, 0.5);
+    auto gradient = jacobian<4>(sum, many);
+    ASSERT_EQ(gradient.size(), 1u);
+    EXPECT_DOUBLE_EQ(gradient[0][0], 1.0);
+    EXPECT_DOUBLE_EQ(gradient[0][19], 1.0);
+}
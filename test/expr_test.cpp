@@ -0,0 +1,85 @@
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "picograd/expr.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+using expr::lazy;
+
+TEST(Expr, MatchesUnfusedGraph) {
+    auto x = Value(0.7);
+    auto w = Value(-1.3);
+    auto b = Value(0.4);
+    auto unfused = ((x * w + b).tanh() - x).pow(2) + (w / (x + 2.0)).exp() - (-b).sigmoid().log();
+    unfused.backward();
+    double gx = x.get_grad();
+    double gw = w.get_grad();
+    double gb = b.get_grad();
+    x.set_grad(0);
+    w.set_grad(0);
+    b.set_grad(0);
+
+    Value<double> fused = ((lazy(x) * w + b).tanh() - x).pow(2) + (w / (lazy(x) + 2.0)).exp()
+                          - (-lazy(b)).sigmoid().log();
+    EXPECT_DOUBLE_EQ(fused.get_data(), unfused.get_data());
+    fused.backward();
+    EXPECT_DOUBLE_EQ(x.get_grad(), gx);
+    EXPECT_DOUBLE_EQ(w.get_grad(), gw);
+    EXPECT_DOUBLE_EQ(b.get_grad(), gb);
+}
+
+TEST(Expr, NodeCounts) {
+    auto x = Value(2.0f);
+    auto y = Value(-1.0f);
+    auto z = Value(0.5f);
+    Tape<float> tape;
+
+    Value<float> square = (lazy(x) - y).pow(2);  // one node, with both derivatives
+    EXPECT_EQ(tape.size(), 1u);
+    EXPECT_FLOAT_EQ(square.get_data(), 9.0f);
+    square.backward();
+    EXPECT_FLOAT_EQ(x.get_grad(), 6.0f);
+    EXPECT_FLOAT_EQ(y.get_grad(), -6.0f);
+
+    tape.reset();
+    Value<float> repeated = (lazy(x) * x + 3.0f * lazy(x)).exp() / x;  // a single operand
+    EXPECT_EQ(tape.size(), 1u);
+    x.set_grad(0);
+    repeated.backward();
+    float e = std::exp(2.0f * 2.0f + 3.0f * 2.0f);
+    EXPECT_FLOAT_EQ(x.get_grad(), e * (2 * 2.0f + 3) / 2.0f - e / (2.0f * 2.0f));
+
+    tape.reset();
+    Value<float> chained = lazy(x) * y + lazy(y) * z + lazy(z) * x;  // three operands, chained in two nodes
+    EXPECT_EQ(tape.size(), 2u);
+    x.set_grad(0);
+    y.set_grad(0);
+    z.set_grad(0);
+    chained.backward();
+    EXPECT_FLOAT_EQ(x.get_grad(), -1.0f + 0.5f);
+    EXPECT_FLOAT_EQ(y.get_grad(), 2.0f + 0.5f);
+    EXPECT_FLOAT_EQ(z.get_grad(), -1.0f + 2.0f);
+
+    tape.reset();
+    Value<float> constant = lazy(Value(3.0f)) * 0.0f + 1.0f;  // the literal operand is one node
+    EXPECT_FLOAT_EQ(constant.get_data(), 1.0f);
+    EXPECT_EQ(tape.size(), 2u);
+}
+
+TEST(Expr, LazyValuesAndUnsupportedReplays) {
+    auto x = Value(1.5);
+    Value<double> same = lazy(x);
+    EXPECT_EQ(same.get_node(), x.get_node());
+
+    auto deferred = lazy(x).pow(3) - 1;  // reads x when converted
+    x.set_data(2.0);
+    Value<double> y = deferred;
+    EXPECT_DOUBLE_EQ(y.get_data(), 7.0);
+
+    auto order = y.topological_order();
+    EXPECT_THROW(order.forward(), std::logic_error);
+    EXPECT_THROW(Program<double>{y}, std::invalid_argument);
+}
@@ -0,0 +1,76 @@
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "picograd/functional.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+std::vector<Value<double>> make_values(const std::vector<double>& data) {
+    std::vector<Value<double>> values;
+    for (auto d : data) values.emplace_back(d);
+    return values;
+}
+
+std::vector<double> grads(const std::vector<Value<double>>& values) {
+    std::vector<double> out;
+    for (auto& v : values) out.push_back(v.get_grad());
+    return out;
+}
+
+} // namespace
+
+TEST(Functional, MseMatchesElementaryOps) {
+    auto prediction = make_values({0.5, -1.0, 2.0});
+    auto target = make_values({1.0, -1.5, 0.0});
+    Value<double> reference(0.0);
+    for (std::size_t i = 0; i < 3; ++i) reference = reference + (prediction[i] - target[i]).square();
+    reference = reference / 3.0;
+    reference.backward();
+    auto prediction_grads = grads(prediction);
+    auto target_grads = grads(target);
+    for (auto& v : prediction) v.set_grad(0);
+    for (auto& v : target) v.set_grad(0);
+
+    auto loss = functional::mse(prediction, target);
+    EXPECT_EQ(loss.topological_order().size(), 6u + 5u);  // the leaves and a chain of linear nodes
+    EXPECT_DOUBLE_EQ(loss.get_data(), reference.get_data());
+    loss.backward();
+    for (std::size_t i = 0; i < 3; ++i) {
+        EXPECT_DOUBLE_EQ(prediction[i].get_grad(), prediction_grads[i]);
+        EXPECT_DOUBLE_EQ(target[i].get_grad(), target_grads[i]);
+    }
+    EXPECT_THROW(functional::mse(prediction, make_values({1.0})), std::invalid_argument);
+}
+
+TEST(Functional, CrossEntropyAndLogSoftmax) {
+    auto logits = make_values({1000.0, 999.0, 997.0});  // exp() of these would overflow
+    double sum = 1 + std::exp(-1.0) + std::exp(-3.0);
+    auto loss = functional::cross_entropy(logits, 1);
+    EXPECT_NEAR(loss.get_data(), 1 + std::log(sum), 1e-14);
+    loss.backward();
+    auto ce_grads = grads(logits);
+    EXPECT_DOUBLE_EQ(ce_grads[0], 1 / sum);
+    EXPECT_DOUBLE_EQ(ce_grads[1], std::exp(-1.0) / sum - 1);
+    EXPECT_DOUBLE_EQ(ce_grads[2], std::exp(-3.0) / sum);
+
+    for (auto& v : logits) v.set_grad(0);
+    auto log_probs = functional::log_softmax(logits);
+    auto nll = -log_probs[1];
+    EXPECT_DOUBLE_EQ(nll.get_data(), loss.get_data());
+    nll.backward();
+    auto nll_grads = grads(logits);
+    for (std::size_t i = 0; i < 3; ++i) EXPECT_NEAR(nll_grads[i], ce_grads[i], 1e-15);
+
+    auto probs = functional::softmax(logits);
+    double total = 0;
+    for (auto& p : probs) total += p.get_data();
+    EXPECT_NEAR(total, 1.0, 1e-14);
+    EXPECT_NEAR(probs[0].get_data(), 1 / sum, 1e-14);
+    EXPECT_THROW(functional::cross_entropy(logits, 3), std::invalid_argument);
+}
@@ -0,0 +1,105 @@
+#include "gtest/gtest.h"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "picograd/gemm.h"
+#include "picograd/tensor.h"
+
+using namespace ajs;
+
+namespace {
+
+template<typename T>
+std::vector<T> filled(std::size_t n, std::size_t seed) {
+    std::vector<T> out(n);
+    for (std::size_t i = 0; i < n; ++i) out[i] = T(int((i * 7919 + seed * 104729) % 201) - 100) / T(64);
+    return out;
+}
+
+// (i, j) element of a row-major matrix with `cols` columns, optionally read transposed
+template<typename T>
+T element(const std::vector<T>& M, std::size_t cols, bool transposed, std::size_t i, std::size_t j) {
+    return transposed ? M[j * cols + i] : M[i * cols + j];
+}
+
+// Compare nn, nt and tn for every instruction set this CPU has with a naive triple loop
+template<typename T>
+void check_products(std::size_t m, std::size_t n, std::size_t k, T tolerance) {
+    auto A = filled<T>(m * k, 1);
+    auto B = filled<T>(k * n, 2);
+    auto C0 = filled<T>(m * n, 3);  // the products accumulate into C
+    auto restore = simd::active_isa();
+    for (auto variant : {"nn", "nt", "tn"}) {
+        bool trans_a = variant[0] == 't';
+        bool trans_b = variant[1] == 't';
+        std::vector<T> expected = C0;
+        for (std::size_t i = 0; i < m; ++i) {
+            for (std::size_t j = 0; j < n; ++j) {
+                for (std::size_t p = 0; p < k; ++p) {
+                    expected[i * n + j] += element(A, trans_a ? m : k, trans_a, i, p) * element(B, trans_b ? k : n, trans_b, p, j);
+                }
+            }
+        }
+        for (auto isa : {simd::Isa::scalar, simd::Isa::neon, simd::Isa::avx2, simd::Isa::avx512}) {
+            if (!simd::set_isa(isa)) continue;
+            SCOPED_TRACE(std::string(simd::isa_str(isa)) + " " + variant + " " + std::to_string(m) + "x"
+                         + std::to_string(n) + "x" + std::to_string(k));
+            std::vector<T> C = C0;
+            if (!trans_a && !trans_b) gemm::nn(m, n, k, A.data(), B.data(), C.data());
+            else if (!trans_a) gemm::nt(m, n, k, A.data(), B.data(), C.data());
+            else gemm::tn(m, n, k, A.data(), B.data(), C.data());
+            for (std::size_t i = 0; i < C.size(); ++i) {
+                EXPECT_NEAR(C[i], expected[i], tolerance * std::max(T(1), std::abs(expected[i]))) << "at " << i;
+            }
+        }
+    }
+    simd::set_isa(restore);
+}
+
+} // namespace
+
+TEST(Gemm, MatchesNaiveProduct) {
+    // Sizes around and across the register tile and cache block edges
+    for (auto [m, n, k] : std::vector<std::array<std::size_t, 3>>{
+             {1, 1, 1}, {3, 5, 7}, {6, 16, 8}, {13, 33, 17}, {97, 65, 300}, {130, 40, 513}}) {
+        check_products<float>(m, n, k, 1e-5f);
+        check_products<double>(m, n, k, 1e-13);
+    }
+}
+
+TEST(Gemm, EmptyDimensions) {
+    std::vector<float> A{1, 2}, B{3, 4}, C{5};
+    gemm::nn<float>(1, 1, 0, A.data(), B.data(), C.data());
+    EXPECT_EQ(C[0], 5);
+    gemm::nn<float>(0, 1, 2, A.data(), B.data(), C.data());
+    EXPECT_EQ(C[0], 5);
+}
+
+TEST(Gemm, TensorMatmulGradients) {
+    // d/dA sum(A B) = 1 B^T, d/dB sum(A B) = A^T 1
+    std::size_t m = 9, k = 21, n = 19;
+    auto a_data = filled<double>(m * k, 4);
+    auto b_data = filled<double>(k * n, 5);
+    Tensor<double> A({m, k}, a_data);
+    Tensor<double> B({k, n}, b_data);
+    auto y = A.matmul(B).sum();
+    y.backward();
+    for (std::size_t i = 0; i < m; ++i) {
+        for (std::size_t p = 0; p < k; ++p) {
+            double row_sum = 0;
+            for (std::size_t j = 0; j < n; ++j) row_sum += b_data[p * n + j];
+            EXPECT_NEAR(A.get_grad()[i * k + p], row_sum, 1e-12);
+        }
+    }
+    for (std::size_t p = 0; p < k; ++p) {
+        double col_sum = 0;
+        for (std::size_t i = 0; i < m; ++i) col_sum += a_data[i * k + p];
+        for (std::size_t j = 0; j < n; ++j) {
+            EXPECT_NEAR(B.get_grad()[p * n + j], col_sum, 1e-12);
+        }
+    }
+}
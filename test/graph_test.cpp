@@ -0,0 +1,90 @@
+#include "gtest/gtest.h"
+
+#include <stdexcept>
+
+#include "picograd/graph.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+// Every op, written once for Values and Vars
+template<typename S>
+S expression(const S& x, const S& w, const S& b) {
+    auto z = x * w + b;
+    auto t = z.tanh();
+    return (t - x).pow(2) + (-z).exp() / (w * w) + (w.square() + 1).log() - t.relu()
+           + (2.0 - z.sigmoid()) * (1.0 / w) + x.pow(1.5f) / 3.0 - (z - 0.5).square();
+}
+
+} // namespace
+
+TEST(Graph, MatchesValue) {
+    Graph<double> graph;
+    auto x = graph.variable(0.7);
+    auto w = graph.variable(-1.3);
+    auto b = graph.variable(0.2);
+    EXPECT_EQ(graph.size(), 3u);
+    auto y = expression(x, w, b);
+
+    auto vx = Value(0.7);
+    auto vw = Value(-1.3);
+    auto vb = Value(0.2);
+    auto vy = expression(vx, vw, vb);
+    EXPECT_DOUBLE_EQ(y.get_data(), vy.get_data());
+    EXPECT_EQ(graph.size(), 3 + vy.topological_order().size() - 3);  // same nodes
+
+    for (int pass = 1; pass <= 2; ++pass) {  // leaves accumulate, operations start over
+        y.backward();
+        vy.backward();
+        EXPECT_DOUBLE_EQ(x.get_grad(), vx.get_grad());
+        EXPECT_DOUBLE_EQ(w.get_grad(), vw.get_grad());
+        EXPECT_DOUBLE_EQ(b.get_grad(), vb.get_grad());
+    }
+    for (std::size_t i = 3; i < graph.size(); ++i) {
+        EXPECT_LT(graph.operand1(i), i);  // indices are a topological order
+        if (graph.operand2(i) != Graph<double>::no_operand) {
+            EXPECT_LT(graph.operand2(i), i);
+        }
+    }
+}
+
+TEST(Graph, RewindKeepsParameters) {
+    Graph<float> graph(16);
+    auto w = graph.variable(2.0f);
+    auto parameters = graph.size();
+    for (float x : {1.0f, 3.0f}) {
+        auto loss = (w * x - 1.0f).square();
+        loss.backward();
+        graph.rewind(parameters);
+        EXPECT_EQ(graph.size(), 1u);
+    }
+    EXPECT_FLOAT_EQ(w.get_grad(), 2 * (2 - 1) * 1 + 2 * (6 - 1) * 3);
+    graph.zero_grad();
+    EXPECT_EQ(w.get_grad(), 0.0f);
+    EXPECT_THROW(graph.rewind(5), std::invalid_argument);
+    EXPECT_EQ(Graph<float>::bytes_per_node, 17u);
+}
+
+TEST(Graph, RejectsForeignAndRewoundVars) {
+    Graph<float> graph;
+    Graph<float> other;
+    auto w = graph.variable(2.0f);
+    auto x = other.variable(3.0f);
+    EXPECT_THROW(w * x, std::invalid_argument);
+    EXPECT_THROW(graph.backward(x), std::invalid_argument);
+
+    auto parameters = graph.size();
+    auto y = w * 3.0f;
+    graph.rewind(parameters);
+    EXPECT_THROW(y + w, std::invalid_argument);
+    EXPECT_THROW(y.exp(), std::invalid_argument);
+    EXPECT_THROW(y.backward(), std::invalid_argument);
+    EXPECT_THROW(y.get_data(), std::invalid_argument);
+    EXPECT_THROW(y.get_grad(), std::invalid_argument);
+    EXPECT_THROW(y.set_data(1.0f), std::invalid_argument);
+    EXPECT_THROW(y.set_grad(1.0f), std::invalid_argument);
+    EXPECT_EQ(w.get_data(), 2.0f);
+    EXPECT_EQ(graph.size(), parameters);
+}
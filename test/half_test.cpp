@@ -0,0 +1,271 @@
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "picograd/graph.h"
+#include "picograd/half.h"
+#include "picograd/nn.h"
+#include "picograd/optim.h"
+#include "picograd/serialize.h"
+#include "picograd/thread_pool.h"
+
+using namespace ajs;
+
+namespace {
+
+// A 2-8-1 tanh network on a Graph, with fixed weights; returns the loss over some samples and the
+// gradients of the weights
+template<typename T, typename Storage>
+std::vector<double> network_gradients(double& loss_out) {
+    Graph<T, Storage> graph;
+    std::vector<Var<T, Storage>> w;
+    for (int i = 0; i < 33; ++i) w.push_back(graph.variable(T(std::sin(double(i) * 1.7) * 0.8)));
+    auto parameters = graph.size();
+    double loss_sum = 0;
+    for (int s = 0; s < 16; ++s) {
+        T x0 = T(std::cos(double(s))), x1 = T(std::sin(double(3 * s))), target = T(std::cos(double(s) * 0.3));
+        auto out = w[32];
+        for (int k = 0; k < 8; ++k) out = out + w[24 + k] * (w[k] * x0 + w[8 + k] * x1 + w[16 + k]).tanh();
+        auto loss = (out - target).square();
+        loss.backward();
+        loss_sum += double(loss.get_data());
+        graph.rewind(parameters);
+    }
+    loss_out = loss_sum;
+    std::vector<double> grads;
+    for (auto& v : w) grads.push_back(double(v.get_grad()));
+    return grads;
+}
+
+} // namespace
+
+TEST(Half, Bfloat16Rounding) {
+    EXPECT_EQ(float(bfloat16(1.0f)), 1.0f);
+    EXPECT_EQ(float(bfloat16(1.0f + 0x1p-8f)), 1.0f);  // halfway: to even
+    EXPECT_EQ(float(bfloat16(1.0f + 3 * 0x1p-8f)), 1.0f + 0x1p-6f);  // halfway: to even, up
+    EXPECT_EQ(float(bfloat16(1.0f + 0x1p-8f + 0x1p-20f)), 1.0f + 0x1p-7f);  // above halfway
+    EXPECT_EQ(float(bfloat16(-3.0f)), -3.0f);
+    EXPECT_TRUE(std::isinf(float(bfloat16(std::numeric_limits<float>::max()))));
+    EXPECT_TRUE(std::isnan(float(bfloat16(std::numeric_limits<float>::quiet_NaN()))));
+    EXPECT_TRUE(std::isnan(float(bfloat16(std::numeric_limits<float>::signaling_NaN()))));
+    for (std::uint32_t bits = 0; bits < 0x10000; ++bits) {  // every bfloat16 converts to float and back exactly
+        auto x = bfloat16::from_bits(std::uint16_t(bits));
+        if (!std::isnan(float(x))) {
+            ASSERT_EQ(bfloat16(float(x)).bits(), bits);
+        }
+    }
+}
+
+TEST(Half, Float16Rounding) {
+    EXPECT_EQ(float(float16(1.0f + 0x1p-11f)), 1.0f);  // halfway: to even
+    EXPECT_EQ(float(float16(1.0f + 3 * 0x1p-11f)), 1.0f + 0x1p-9f);
+    EXPECT_EQ(float(float16(65504.0f)), 65504.0f);  // largest finite
+    EXPECT_EQ(float(float16(65519.0f)), 65504.0f);
+    EXPECT_TRUE(std::isinf(float(float16(65520.0f))));
+    EXPECT_TRUE(std::isinf(float(float16(-1e6f))));
+    EXPECT_EQ(float(float16(0x1p-24f)), 0x1p-24f);  // smallest subnormal
+    EXPECT_EQ(float(float16(0x1p-25f)), 0.0f);  // halfway: to even (0)
+    EXPECT_EQ(float(float16(0x1.8p-24f)), 0x1p-23f);  // halfway: to even, up
+    EXPECT_EQ(float(float16(0x1.ffcp-15f)), 0x1p-14f);  // rounds up from subnormal to normal
+    EXPECT_EQ(float16(-0.0f).bits(), 0x8000u);
+    EXPECT_TRUE(std::isnan(float(float16(std::numeric_limits<float>::quiet_NaN()))));
+    for (std::uint32_t bits = 0; bits < 0x10000; ++bits) {  // every float16 converts to float and back exactly
+        auto x = float16::from_bits(std::uint16_t(bits));
+        if (!std::isnan(float(x))) {
+            ASSERT_EQ(float16(float(x)).bits(), bits);
+        }
+    }
+
+    std::vector<double> in{0.1, -2.5, 1e-9};
+    std::vector<float16> out(3);
+    convert(std::span<const double>(in), std::span<float16>(out));
+    EXPECT_EQ(float(out[1]), -2.5f);
+    EXPECT_NEAR(float(out[0]), 0.1f, 1e-4f);
+    EXPECT_EQ(float(out[2]), 0.0f);  // underflows
+}
+
+TEST(Half, MixedPrecisionGraphMatchesDouble) {
+    EXPECT_EQ((Graph<float, bfloat16>::bytes_per_node), 13u);
+    Graph<float, bfloat16> graph;
+    auto x = graph.variable(2.0f);
+    auto y = x.pow(2.01f);  // the exponent is not a bfloat16
+    EXPECT_EQ(graph.param(y.index()), 2.01f);
+    y.backward();
+    EXPECT_NEAR(x.get_grad(), 2.01f * std::pow(2.0f, 1.01f), 1e-5f);
+    double exact_loss, bf16_loss, f16_loss;
+    auto exact = network_gradients<double, double>(exact_loss);
+    auto bf16_grads = network_gradients<float, bfloat16>(bf16_loss);
+    auto f16_grads = network_gradients<float, float16>(f16_loss);
+    EXPECT_NEAR(bf16_loss, exact_loss, 2e-2 * exact_loss);
+    EXPECT_NEAR(f16_loss, exact_loss, 2e-3 * exact_loss);  // 3 more mantissa bits than bfloat16
+    double scale = 0;
+    for (auto g : exact) scale = std::max(scale, std::abs(g));
+    for (std::size_t i = 0; i < exact.size(); ++i) {
+        EXPECT_NEAR(bf16_grads[i], exact[i], 2e-2 * scale) << i;
+        EXPECT_NEAR(f16_grads[i], exact[i], 2e-2 * scale) << i;
+    }
+}
+
+TEST(Half, MixedPrecisionGraphKeepsLeafGradientsAndParams) {
+    Graph<float, bfloat16> graph;
+    auto w = graph.variable(1.0f);
+    auto parameters = graph.size();
+    for (int step = 0; step < 3; ++step) {
+        auto x = graph.variable(2.0f);
+        auto y = w * 1.001f * x + 0.5f;
+        EXPECT_EQ(graph.param(y.index()), 0.5f);
+        EXPECT_EQ(graph.operand2(y.index()), (Graph<float, bfloat16>::no_operand));
+        EXPECT_EQ(graph.operand1(x.index()), (Graph<float, bfloat16>::no_operand));
+        y.backward();
+        graph.rewind(parameters);
+    }
+    EXPECT_FLOAT_EQ(w.get_grad(), 3 * 1.001f * 2);  // accumulated in float: 6 in bfloat16
+    auto z = w.exp() * 3.0f;  // the params of the dropped nodes are gone
+    EXPECT_EQ(graph.param(z.index() - 1), 0.0f);
+    EXPECT_EQ(graph.param(z.index()), 3.0f);
+}
+
+TEST(Half, ReducedPrecisionModelFiles) {
+    auto path = (std::filesystem::temp_directory_path() / "picograd_half_model.bin").string();
+    nn::MLP<float> trained(2, {16, 16, 1}, 1);
+    nn::MLP<float> loaded(2, {16, 16, 1}, 2);
+    for (auto dtype : {serialize::DType::f32, serialize::DType::bf16, serialize::DType::f16}) {
+        serialize::Writer writer;
+        writer.add("mlp", trained.parameters(), dtype);
+        writer.save(path);
+        serialize::MappedFile file(path);
+        EXPECT_EQ(file.at("mlp").bytes, trained.parameters().size() * (dtype == serialize::DType::f32 ? 4 : 2));
+        file.load("mlp", loaded.parameters());
+        auto expected = trained(std::vector<float>{0.3f, -0.7f})[0].get_data();
+        auto tolerance = dtype == serialize::DType::bf16 ? 3e-2f : dtype == serialize::DType::f16 ? 3e-3f : 0.0f;
+        EXPECT_NEAR(loaded(std::vector<float>{0.3f, -0.7f})[0].get_data(), expected, tolerance);
+    }
+    serialize::Writer writer;
+    EXPECT_THROW(writer.add("mlp", trained.parameters(), serialize::DType::u8), std::invalid_argument);
+    std::filesystem::remove(path);
+}
+
+TEST(Half, LossScaling) {
+    ParameterSet<float> parameters(2);
+    auto w = parameters.add(1e-3f);
+    auto b = parameters.add(0.5f);
+    optim::LossScaler<float> scaler(1024.0f, 2);
+
+    scaler.scaled(w * 1e-4f + b).backward();
+    EXPECT_EQ(w.get_grad(), 1024.0f * 1e-4f);
+    EXPECT_TRUE(scaler.unscale(parameters));
+    EXPECT_FLOAT_EQ(w.get_grad(), 1e-4f);
+    EXPECT_FLOAT_EQ(b.get_grad(), 1.0f);
+    EXPECT_EQ(float(float16(1e-4f * 1e-4f)), 0.0f);  // too small for 16 bits unscaled ...
+    EXPECT_NE(float(float16(1e-4f * 1e-4f * scaler.scale())), 0.0f);  // ... but not scaled
+    parameters.zero_grad();
+
+    scaler.scaled(w * 1e38f).backward();  // overflows
+    EXPECT_FALSE(scaler.unscale(parameters));
+    EXPECT_EQ(w.get_grad(), 0.0f);
+    EXPECT_EQ(scaler.scale(), 512.0f);
+    EXPECT_EQ(scaler.skipped(), 1u);
+
+    for (int step = 0; step < 2; ++step) {
+        scaler.scaled(w + b).backward();
+        EXPECT_TRUE(scaler.unscale(parameters));
+        EXPECT_FLOAT_EQ(w.get_grad(), 1.0f);
+        parameters.zero_grad();
+    }
+    EXPECT_EQ(scaler.scale(), 1024.0f);  // grown after 2 good steps
+}
+
+TEST(Half, LossScalingOnMixedPrecisionGraph) {
+    Graph<float, bfloat16> graph;
+    auto w = graph.variable(0.75f);
+    auto b = graph.variable(-0.25f);
+    auto parameters = graph.size();
+    GraphParameters<float, bfloat16> leaves(graph, 0, parameters);
+    optim::SGD<float, GraphParameters<float, bfloat16>> optimizer(leaves, 0.5f);
+    optim::LossScaler<float> scaler(1024.0f, 2);
+
+    auto loss = ((w * 1e-3f + b).tanh() * 1e-4f).square();
+    loss.backward();
+    float w_grad = w.get_grad(), b_grad = b.get_grad();
+    graph.zero_grad();
+    graph.rewind(parameters);
+    loss = ((w * 1e-3f + b).tanh() * 1e-4f).square();
+    scaler.scaled(loss).backward();
+    EXPECT_FLOAT_EQ(w.get_grad(), 1024.0f * w_grad);
+    EXPECT_TRUE(scaler.unscale(graph));
+    EXPECT_FLOAT_EQ(w.get_grad(), w_grad);
+    EXPECT_FLOAT_EQ(b.get_grad(), b_grad);
+    graph.zero_grad();
+    graph.rewind(parameters);
+
+    scaler.scaled(w * 1e38f).backward();  // overflows
+    EXPECT_FALSE(scaler.unscale(graph));
+    EXPECT_EQ(w.get_grad(), 0.0f);
+    EXPECT_EQ(scaler.scale(), 512.0f);
+    EXPECT_EQ(scaler.skipped(), 1u);
+    graph.rewind(parameters);
+
+    for (int step = 0; step < 2; ++step) {
+        scaler.scaled(w + b).backward();
+        EXPECT_TRUE(scaler.unscale(graph));
+        EXPECT_FLOAT_EQ(w.get_grad(), 1.0f);
+        optimizer.step();
+        EXPECT_EQ(w.get_grad(), 0.0f);  // consumed by the step
+        graph.rewind(parameters);
+    }
+    EXPECT_EQ(w.get_data(), -0.25f);
+    EXPECT_EQ(scaler.scale(), 1024.0f);  // grown after 2 good steps
+}
+
+TEST(Half, OptimizersKeepFloatMasterWeights) {
+    // A step of 2e-4 is below half a bfloat16 ulp of 1 (2^-8): rounded into the leaf on every step,
+    // it would be lost
+    Graph<float, bfloat16> naive;
+    auto u = naive.variable(1.0f);
+    Graph<float, bfloat16> graph;
+    auto w = graph.variable(1.0f);
+    auto v = graph.variable(1.0f);
+    auto parameters = graph.size();
+    GraphParameters<float, bfloat16> leaves(graph, 0, parameters);
+    EXPECT_EQ(leaves.size(), 2u);
+    EXPECT_EQ(leaves[1].index(), v.index());
+    optim::SGD<float, GraphParameters<float, bfloat16>> sgd(leaves, 1e-4f);
+    ThreadPool pool(2);
+    for (int step = 0; step < 100; ++step) {
+        (u * 2.0f).backward();
+        u.set_data(u.get_data() - 1e-4f * u.get_grad());
+        naive.zero_grad();
+        naive.rewind(1);
+
+        (w * 2.0f + v * 2.0f).backward();
+        if (step % 2) sgd.step();
+        else sgd.step(pool);
+        graph.rewind(parameters);
+    }
+    EXPECT_EQ(u.get_data(), 1.0f);
+    EXPECT_NEAR(leaves.get_data(0), 0.98f, 1e-5f);
+    EXPECT_EQ(w.get_data(), float(bfloat16(leaves.get_data(0))));
+    EXPECT_NEAR(v.get_data(), 0.98f, 4e-3f);
+
+    Graph<float, bfloat16> other;
+    auto x = other.variable(1.0f);
+    GraphParameters<float, bfloat16> x_leaves(other, 0, other.size());
+    optim::AdamW<float, GraphParameters<float, bfloat16>> adamw(x_leaves, 1e-4f, 0.9f, 0.999f, 1e-8f, 0.0f);
+    for (int step = 0; step < 100; ++step) {
+        (x * x).backward();
+        adamw.step();
+        other.rewind(1);
+    }
+    EXPECT_NEAR(x_leaves.get_data(0), 0.99f, 1e-4f);  // Adam steps by about lr
+    EXPECT_LT(x.get_data(), 1.0f);
+
+    x_leaves.set_data(0, 0.25f);
+    EXPECT_EQ(x.get_data(), 0.25f);
+    Graph<float> empty;
+    EXPECT_THROW(GraphParameters<float>(empty, 0, 1), std::invalid_argument);
+}
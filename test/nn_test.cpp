@@ -0,0 +1,90 @@
+#include "gtest/gtest.h"
+
+#include <vector>
+
+#include "picograd/nn.h"
+#include "picograd/optim.h"
+#include "picograd/tape.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+TEST(NN, ParametersAreConsecutiveRangesOfOneSet) {
+    nn::MLP<double> model(3, {4, 4, 1});
+    EXPECT_EQ(model.parameters().size(), 4 * 4 + 4 * 5 + 5u);
+    EXPECT_EQ(nn::MLP<double>::parameter_count(3, {4, 4, 1}), model.parameters().size());
+    EXPECT_EQ(model.parameter_set().size(), model.parameter_set().capacity());
+
+    std::size_t offset = 0;
+    for (auto& layer : model.layers()) {
+        EXPECT_EQ(&layer.parameter_set(), &model.parameter_set());
+        EXPECT_EQ(layer.parameters().offset(), offset);
+        for (auto& neuron : layer.neurons()) {
+            EXPECT_EQ(neuron.parameters().offset(), offset);
+            offset += neuron.parameters().size();
+        }
+    }
+    EXPECT_EQ(offset, model.parameters().size());
+    EXPECT_FALSE(model.layers().back().neurons()[0].nonlinear());
+    EXPECT_TRUE(model.layers().front().neurons()[0].nonlinear());
+
+    // Same seed, same weights
+    nn::MLP<double> again(3, {4, 4, 1});
+    nn::MLP<double> other(3, {4, 4, 1}, 7);
+    EXPECT_EQ(again.parameters()[5].get_data(), model.parameters()[5].get_data());
+    EXPECT_NE(other.parameters()[5].get_data(), model.parameters()[5].get_data());
+}
+
+TEST(NN, Neuron) {
+    nn::Neuron<double> neuron(2, false);
+    auto p = neuron.parameters();
+    ASSERT_EQ(p.size(), 3u);
+    EXPECT_EQ(p[2].get_data(), 0.0);  // bias
+    p[0].set_data(0.5);
+    p[1].set_data(-2.0);
+    p[2].set_data(0.25);
+
+    Value<double> x0(3.0);
+    Value<double> x1(1.0);
+    auto out = neuron({x0, x1});
+    EXPECT_DOUBLE_EQ(out.get_data(), 0.5 * 3.0 - 2.0 * 1.0 + 0.25);
+    EXPECT_DOUBLE_EQ(neuron(std::vector<double>{3.0, 1.0}).get_data(), out.get_data());
+    out.backward();
+    EXPECT_DOUBLE_EQ(p[0].get_grad(), 3.0);
+    EXPECT_DOUBLE_EQ(p[1].get_grad(), 1.0);
+    EXPECT_DOUBLE_EQ(p[2].get_grad(), 1.0);
+    EXPECT_DOUBLE_EQ(x1.get_grad(), -2.0);
+
+    nn::Neuron<double> relu(2);
+    relu.parameters()[2].set_data(-100.0);
+    EXPECT_EQ(relu(std::vector<double>{1.0, 1.0}).get_data(), 0.0);
+}
+
+TEST(NN, ZeroGradCoversOnlyTheModule) {
+    nn::MLP<double> model(2, {3, 1});
+    auto loss = model(std::vector<double>{0.5, -1.5})[0].square();
+    loss.backward();
+    auto first = model.layers()[0].parameters();
+    auto last = model.layers()[1].parameters();
+    EXPECT_NE(last[last.size() - 1].get_grad(), 0.0);  // the output bias
+
+    model.layers()[1].parameters().zero_grad();
+    for (std::size_t i = 0; i < last.size(); ++i) EXPECT_EQ(last[i].get_grad(), 0.0);
+    model.zero_grad();
+    for (std::size_t i = 0; i < first.size(); ++i) EXPECT_EQ(first[i].get_grad(), 0.0);
+}
+
+TEST(NN, LearnsXor) {
+    nn::MLP<double> model(2, {8, 1}, 3);
+    optim::Adam<double> optimizer(model.parameter_set(), 0.05);
+    std::vector<std::vector<double>> xs{{0, 0}, {0, 1}, {1, 0}, {1, 1}};
+    std::vector<double> ys{-1, 1, 1, -1};
+    for (int step = 0; step < 300; ++step) {
+        Tape<double> tape;
+        Value<double> loss(0.0);
+        for (std::size_t i = 0; i < xs.size(); ++i) loss = loss + (model(xs[i])[0] - ys[i]).square();
+        loss.backward();
+        optimizer.step();
+    }
+    for (std::size_t i = 0; i < xs.size(); ++i) EXPECT_NEAR(model(xs[i])[0].get_data(), ys[i], 0.1);
+}
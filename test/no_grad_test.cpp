@@ -0,0 +1,44 @@
+#include "gtest/gtest.h"
+
+#include <thread>
+
+#include "picograd/functional.h"
+#include "picograd/no_grad.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+TEST(NoGrad, ComputesDataWithoutGraph) {
+    auto w = Value(0.5);
+    auto x = Value(2.0);
+    auto graph = (w * x + 1).tanh() - w / x;
+    {
+        NoGradGuard guard;
+        EXPECT_TRUE(NoGradGuard::active());
+        Tape<double> tape;
+        auto y = (w * x + 1).tanh() - w / x;
+        EXPECT_DOUBLE_EQ(y.get_data(), graph.get_data());
+        EXPECT_FALSE(y.requires_grad());
+        EXPECT_EQ(y.topological_order().size(), 1u);  // no operands
+        auto loss = functional::cross_entropy(std::vector<Value<double>>{w, x, y}, 0);
+        EXPECT_EQ(loss.topological_order().size(), 1u);
+        EXPECT_EQ(tape.size(), 6u);  // one constant per operation (five, and the loss)
+    }
+    EXPECT_FALSE(NoGradGuard::active());
+    graph.backward();  // graphs built outside of the guard are unaffected
+    EXPECT_DOUBLE_EQ(w.get_grad(), 2 * (1 - std::pow(std::tanh(2.0), 2)) - 0.5);
+}
+
+TEST(NoGrad, NestingAndThreads) {
+    {
+        NoGradGuard outer;
+        {
+            NoGradGuard inner;
+        }
+        EXPECT_TRUE(NoGradGuard::active());
+        bool other_thread = true;
+        std::thread([&] { other_thread = NoGradGuard::active(); }).join();
+        EXPECT_FALSE(other_thread);
+    }
+    EXPECT_FALSE(NoGradGuard::active());
+}
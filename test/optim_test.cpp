@@ -0,0 +1,123 @@
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "picograd/optim.h"
+#include "picograd/parameters.h"
+#include "picograd/thread_pool.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+TEST(ParameterSet, ValuesReferToTheSet) {
+    ParameterSet<double> params(2);
+    auto w = params.add(3.0);
+    auto b = params.add(-1.0);
+    EXPECT_EQ(params.size(), 2u);
+    EXPECT_THROW(params.add(0.0), std::length_error);
+
+    auto loss = (w * 2.0 + b).square();  // (6 - 1)^2
+    loss.backward();
+    EXPECT_DOUBLE_EQ(params[0].get_grad(), 20.0);
+    EXPECT_DOUBLE_EQ(params[1].get_grad(), 10.0);
+    params.zero_grad();
+    EXPECT_DOUBLE_EQ(w.get_grad(), 0.0);
+    EXPECT_DOUBLE_EQ(b.get_grad(), 0.0);
+
+    params[1].set_data(4.0);
+    EXPECT_DOUBLE_EQ(b.get_data(), 4.0);
+    EXPECT_EQ(params.values().size(), 2u);
+}
+
+TEST(Optim, SGD) {
+    ParameterSet<double> params(1);
+    auto w = params.add(1.0);
+    optim::SGD<double> plain(params, 0.1, 0.0, 0.5);
+    w.set_grad(2.0);
+    plain.step();
+    EXPECT_DOUBLE_EQ(w.get_data(), 1.0 - 0.1 * (2.0 + 0.5 * 1.0));
+    EXPECT_DOUBLE_EQ(w.get_grad(), 0.0);  // consumed by the step
+
+    ParameterSet<double> other(1);
+    auto u = other.add(1.0);
+    optim::SGD<double> momentum(other, 0.1, 0.9);
+    u.set_grad(2.0);
+    momentum.step();  // velocity 2
+    EXPECT_DOUBLE_EQ(u.get_data(), 1.0 - 0.1 * 2.0);
+    u.set_grad(1.0);
+    momentum.step();  // velocity 0.9 * 2 + 1
+    EXPECT_DOUBLE_EQ(u.get_data(), 1.0 - 0.1 * 2.0 - 0.1 * 2.8);
+}
+
+TEST(Optim, Adam) {
+    double lr = 0.01, beta1 = 0.9, beta2 = 0.999, eps = 1e-8, decay = 0.1;
+    ParameterSet<double> params(1);
+    auto w = params.add(0.5);
+    optim::Adam<double> adam(params, lr, beta1, beta2, eps, decay);
+    ParameterSet<double> other(1);
+    auto x = other.add(0.5);
+    optim::AdamW<double> adamw(other, lr, beta1, beta2, eps, decay);
+
+    // Reference implementations
+    double m = 0, v = 0, data = 0.5, mw = 0, vw = 0, dataw = 0.5;
+    double grads[] = {0.3, -1.2, 0.7};
+    for (int t = 1; t <= 3; ++t) {
+        double g = grads[t - 1] + decay * data;
+        m = beta1 * m + (1 - beta1) * g;
+        v = beta2 * v + (1 - beta2) * g * g;
+        data -= lr * (m / (1 - std::pow(beta1, t))) / (std::sqrt(v / (1 - std::pow(beta2, t))) + eps);
+
+        g = grads[t - 1];
+        mw = beta1 * mw + (1 - beta1) * g;
+        vw = beta2 * vw + (1 - beta2) * g * g;
+        dataw = dataw * (1 - lr * decay) - lr * (mw / (1 - std::pow(beta1, t))) / (std::sqrt(vw / (1 - std::pow(beta2, t))) + eps);
+
+        w.set_grad(grads[t - 1]);
+        x.set_grad(grads[t - 1]);
+        adam.step();
+        adamw.step();
+        EXPECT_NEAR(w.get_data(), data, 1e-12);
+        EXPECT_NEAR(x.get_data(), dataw, 1e-12);
+    }
+}
+
+TEST(Optim, ParallelStepMatchesSerial) {
+    std::size_t n = 10000;  // a few chunks, the last one partial
+    ParameterSet<float> serial(n);
+    ParameterSet<float> parallel(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        serial.add(float(i % 11) * 0.1f);
+        parallel.add(float(i % 11) * 0.1f);
+    }
+    optim::AdamW<float> a(serial, 1e-2f);
+    optim::AdamW<float> b(parallel, 1e-2f);
+    ThreadPool pool(3);
+    for (int step = 0; step < 3; ++step) {
+        for (std::size_t i = 0; i < n; ++i) {
+            serial[i].set_grad(float(i % 5) - 2.0f);
+            parallel[i].set_grad(float(i % 5) - 2.0f);
+        }
+        a.step();
+        b.step(pool);
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(serial[i].get_data(), parallel[i].get_data());
+        ASSERT_EQ(parallel[i].get_grad(), 0.0f);
+    }
+}
+
+TEST(Optim, TrainsALine) {
+    ParameterSet<double> params(2);
+    auto w = params.add(0.0);
+    auto b = params.add(0.0);
+    optim::Adam<double> optimizer(params, 0.05);
+    for (int step = 0; step < 500; ++step) {
+        Value<double> loss(0.0);
+        for (double x : {-1.0, 0.0, 1.0, 2.0}) loss = loss + (w * x + b - (3 * x - 1)).square();
+        loss.backward();
+        optimizer.step();
+    }
+    EXPECT_NEAR(w.get_data(), 3.0, 1e-3);
+    EXPECT_NEAR(b.get_data(), -1.0, 1e-3);
+}
@@ -0,0 +1,131 @@
+#include "gtest/gtest.h"
+
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "picograd/profile.h"
+#include "picograd/tape.h"
+#include "picograd/value.h"
+
+// Built into its own test binary with PICOGRAD_PROFILE (see CMakeLists.txt)
+static_assert(ajs::profile::enabled);
+
+using namespace ajs;
+
+namespace {
+
+std::uint64_t count(const profile::Report& report, Op op) {
+    return report.ops[std::size_t(op)].count;
+}
+
+} // namespace
+
+TEST(Profile, CountsOpsAndNodes) {
+    profile::reset();
+    {
+        Value<double> a(0.5);
+        Value<double> b(2.0);
+        auto y = (a * b + 1.0).tanh() * a;
+        auto report = profile::report();
+        EXPECT_EQ(count(report, Op::none), 2u);
+        EXPECT_EQ(count(report, Op::mult), 2u);
+        EXPECT_EQ(count(report, Op::add), 1u);
+        EXPECT_EQ(count(report, Op::tanh), 1u);
+        EXPECT_EQ(report.nodes_created, 6u);
+        EXPECT_EQ(report.nodes_freed, 0u);
+        EXPECT_GE(report.bytes_allocated, 6 * sizeof(double) * 4);
+
+        y.backward();
+        report = profile::report();
+        EXPECT_EQ(report.sorts, 1u);
+        EXPECT_EQ(report.sorted_nodes, 6u);
+        EXPECT_EQ(report.max_depth, 5u);  // y, mult, tanh, add, mult, a
+        EXPECT_EQ(report.ops[std::size_t(Op::mult)].backward_count, 2u);
+        EXPECT_EQ(report.ops[std::size_t(Op::tanh)].backward_count, 1u);
+        EXPECT_EQ(report.ops[std::size_t(Op::none)].backward_count, 0u);
+    }
+    EXPECT_EQ(profile::report().nodes_freed, 6u);
+}
+
+TEST(Profile, TapesAndThreads) {
+    profile::reset();
+    {
+        Tape<float> tape(1000);
+        Value<float> x(1.0f);
+        for (int i = 0; i < 10; ++i) x = x * 1.5f;
+    }
+    auto report = profile::report();
+    EXPECT_EQ(report.nodes_created, 11u);
+    EXPECT_EQ(report.nodes_freed, 11u);
+    EXPECT_GT(report.bytes_allocated, 0u);
+    EXPECT_EQ(report.bytes_allocated % 1000, 0u);  // one block of 1000 nodes
+
+    std::thread([] {  // counted after the thread has exited
+        Value<float> y(2.0f);
+        (y * y).backward();
+    }).join();
+    report = profile::report();
+    EXPECT_EQ(report.nodes_created, 13u);
+    EXPECT_EQ(report.sorts, 1u);
+}
+
+TEST(Profile, Exports) {
+    profile::reset();
+    {
+        profile::Scope scope("step");
+        Value<double> a(0.5);
+        auto y = a.exp() * a;
+        y.backward();
+    }
+    std::ostringstream counters;
+    profile::write_counters(counters, profile::report());
+    EXPECT_NE(counters.str().find("exp"), std::string::npos);
+    EXPECT_NE(counters.str().find("max depth 3"), std::string::npos);
+
+    std::ostringstream trace;
+    profile::write_chrome_trace(trace);
+    auto json = trace.str();
+    EXPECT_EQ(json.rfind(R"({"traceEvents":[)", 0), 0u);
+    EXPECT_NE(json.find(R"("name":"step","ph":"X")"), std::string::npos);
+    EXPECT_NE(json.find(R"("name":"backward","ph":"X")"), std::string::npos);
+    EXPECT_NE(json.find(R"("name":"topological_order","ph":"X")"), std::string::npos);
+    EXPECT_NE(json.find(R"("name":"op count","ph":"C")"), std::string::npos);
+    EXPECT_NE(json.find(R"("exp":1)"), std::string::npos);
+
+    profile::reset();
+    EXPECT_EQ(profile::report().nodes_created, 0u);
+    std::ostringstream empty;
+    profile::write_chrome_trace(empty);
+    EXPECT_EQ(empty.str().find(R"("name":"step")"), std::string::npos);
+}
+
+TEST(Profile, SamplesOpTimes) {
+    profile::reset();
+    {
+        Tape<double> tape(1 << 14);
+        Value<double> x(0.5);
+        auto y = x;
+        for (int i = 0; i < 4096; ++i) y = (y * 0.5).tanh();  // period 2: sampling must not alias
+        y.backward();
+    }
+    auto report = profile::report();
+    for (auto op : {Op::mult, Op::tanh}) {
+        auto& stats = report.ops[std::size_t(op)];
+        EXPECT_EQ(stats.count, 4096u);
+        EXPECT_EQ(stats.backward_count, 4096u);
+        EXPECT_GT(stats.forward_ns, 0u);
+        EXPECT_GT(stats.backward_ns, 0u);
+    }
+
+    profile::sample_every(1);
+    profile::reset();
+    {
+        Value<double> x(0.5);
+        (x.exp() * x).backward();
+    }
+    report = profile::report();
+    EXPECT_GT(report.ops[std::size_t(Op::exp)].forward_ns, 0u);
+    EXPECT_GT(report.ops[std::size_t(Op::exp)].backward_ns, 0u);
+    profile::sample_every(64);
+}
@@ -0,0 +1,75 @@
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <vector>
+
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+// Builds the same expression as the graph the tests compile
+double expression(double x, double w, double b) {
+    double z = x * w + b;
+    double t = std::tanh(z);
+    return std::pow(t - x, 2) + std::exp(-z) / (w * w) + std::log(std::abs(w)) - (t > 0 ? t : 0);
+}
+
+} // namespace
+
+TEST(Program, ReplaysGraphOnNewLeafData) {
+    auto x = Value(0.5);
+    auto w = Value(-1.5);
+    auto b = Value(0.25);
+    auto z = x * w + b;
+    auto t = z.tanh();
+    auto y = (t - x).pow(2) + (-z).exp() / (w * w) + w.pow(2).pow(0.5f).log() - t.relu();
+
+    Program<double> program(y);
+    EXPECT_EQ(program.leaves(), 3u);  // x, w, b (negation and subtraction are single nodes)
+    EXPECT_DOUBLE_EQ(program.output(), y.get_data());
+    EXPECT_DOUBLE_EQ(program.output(), expression(0.5, -1.5, 0.25));
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        EXPECT_LT(program.operand1(i), program.leaves() + i);  // operands come first
+        if (program.operand2(i) != Program<double>::no_operand) {
+            EXPECT_LT(program.operand2(i), program.leaves() + i);
+        }
+    }
+
+    for (double xv : {-2.0, 0.1, 3.0}) {
+        x.set_data(xv);
+        w.set_data(xv + 0.7);
+        EXPECT_DOUBLE_EQ(program.forward(), expression(xv, xv + 0.7, 0.25));
+
+        // Same gradients as a backward pass through the (recomputed) graph
+        auto order = y.topological_order();
+        order.forward();
+        x.set_grad(0);
+        w.set_grad(0);
+        order.backward();
+        double gx = x.get_grad();
+        double gw = w.get_grad();
+        x.set_grad(0);
+        w.set_grad(0);
+        program.backward();
+        EXPECT_DOUBLE_EQ(x.get_grad(), gx);
+        EXPECT_DOUBLE_EQ(w.get_grad(), gw);
+        program.backward();  // leaves accumulate
+        EXPECT_DOUBLE_EQ(x.get_grad(), 2 * gx);
+    }
+}
+
+TEST(Program, OutlivesTheGraph) {
+    auto x = Value(2.0f);
+    Program<float> program = [&] {
+        Tape<float> tape;  // inner nodes are gone after this
+        auto y = x * x * x;
+        return Program<float>(y);
+    }();
+    EXPECT_EQ(program.size(), 2u);
+    x.set_data(3.0f);
+    EXPECT_FLOAT_EQ(program.forward(), 27.0f);
+    program.backward();
+    EXPECT_FLOAT_EQ(x.get_grad(), 27.0f);
+}
@@ -0,0 +1,149 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "picograd/nn.h"
+#include "picograd/program.h"
+#include "picograd/serialize.h"
+#include "picograd/tensor.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+std::string temp_file(const char* name) {
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+} // namespace
+
+TEST(Serialize, RoundTripsArraysInPlace) {
+    auto path = temp_file("picograd_arrays.bin");
+    Tensor<float> w({2, 3}, {1, 2, 3, 4, 5, 6});
+    std::vector<double> bias{0.5, -0.25};
+    std::vector<std::uint32_t> ids{7, 8, 9};
+    {
+        serialize::Writer writer;
+        writer.add("w", w);
+        writer.add("bias", bias, {1, 2});
+        writer.add("ids", ids);
+        writer.add("empty", std::vector<float>{});
+        writer.save(path);
+    }
+    EXPECT_EQ(std::filesystem::file_size(path) % serialize::alignment, 0u);
+
+    serialize::MappedFile file(path);
+    ASSERT_EQ(file.size(), 4u);
+    EXPECT_EQ(file[0].name, "w");
+    EXPECT_EQ(file.at("w").shape, (serialize::Shape{2, 3}));
+    EXPECT_EQ(file.at("bias").shape, (serialize::Shape{1, 2}));
+    EXPECT_EQ(file.at("bias").dtype, serialize::DType::f64);
+    EXPECT_EQ(file.find("missing"), nullptr);
+
+    auto data = file.get<float>("w");
+    EXPECT_EQ(std::vector<float>(data.begin(), data.end()), w.get_data());
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(data.data()) % serialize::alignment, 0u);
+    auto ids_loaded = file.get<std::uint32_t>("ids");
+    EXPECT_EQ(std::vector<std::uint32_t>(ids_loaded.begin(), ids_loaded.end()), ids);
+    EXPECT_TRUE(file.get<float>("empty").empty());
+
+    auto tensor = file.tensor<float>("w");
+    EXPECT_EQ(tensor.shape(), w.shape());
+    EXPECT_EQ(tensor.get_data(), w.get_data());
+    EXPECT_EQ(file.tensor<double>("bias").at({0, 1}), -0.25);
+
+    EXPECT_THROW(file.get<double>("w"), std::invalid_argument);
+    EXPECT_THROW(file.get<float>("missing"), std::invalid_argument);
+    std::filesystem::remove(path);
+}
+
+TEST(Serialize, Models) {
+    auto path = temp_file("picograd_model.bin");
+    nn::MLP<float> trained(2, {8, 1}, 1);
+    nn::MLP<float> fresh(2, {8, 1}, 2);
+    std::vector<float> x{0.3f, -0.7f};
+    {
+        serialize::Writer writer;
+        writer.add("mlp", trained.parameters());
+        writer.add("hidden", trained.layers()[0].parameters());
+        writer.save(path);
+    }
+    serialize::MappedFile file(path);
+    EXPECT_NE(fresh(x)[0].get_data(), trained(x)[0].get_data());
+    file.load("mlp", fresh.parameters());
+    EXPECT_EQ(fresh(x)[0].get_data(), trained(x)[0].get_data());
+    EXPECT_EQ(file.get<float>("hidden").size(), trained.layers()[0].parameters().size());
+    EXPECT_THROW(file.load("hidden", fresh.parameters()), std::invalid_argument);  // wrong size
+    std::filesystem::remove(path);
+}
+
+TEST(Serialize, Programs) {
+    auto path = temp_file("picograd_program.bin");
+    Value<double> a(0.5);
+    Value<double> b(-1.5);
+    auto out = (a * b + 2.0).tanh() + (a / b).exp();
+    Program<double> program(out);
+    {
+        serialize::Writer writer;
+        writer.add("f", program);
+        writer.save(path);
+    }
+    serialize::MappedFile file(path);
+    auto loaded = file.program<double>("f");
+    ASSERT_EQ(loaded.size(), program.size());
+    ASSERT_EQ(loaded.leaves(), program.leaves());
+    EXPECT_EQ(loaded.output(), program.output());
+
+    // The loaded program has leaves of its own
+    for (std::size_t i = 0; i < loaded.leaves(); ++i) {
+        loaded.leaf(i).set_data(program.leaf(i).get_data() * 2);
+        program.leaf(i).set_data(program.leaf(i).get_data() * 2);
+    }
+    EXPECT_DOUBLE_EQ(loaded.forward(), program.forward());
+    loaded.backward();
+    program.backward();
+    for (std::size_t i = 0; i < loaded.leaves(); ++i) {
+        EXPECT_DOUBLE_EQ(loaded.leaf(i).get_grad(), program.leaf(i).get_grad());
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(Serialize, RejectsBadInput) {
+    serialize::Writer writer;
+    EXPECT_THROW(writer.add("", std::vector<float>{1}), std::invalid_argument);
+    EXPECT_THROW(writer.add(std::string(64, 'x'), std::vector<float>{1}), std::invalid_argument);
+    EXPECT_THROW(writer.add("a", std::vector<float>{1, 2}, {3}), std::invalid_argument);
+    writer.add("a", std::vector<float>{1, 2});
+    EXPECT_THROW(writer.add("a", std::vector<float>{1}), std::invalid_argument);
+
+    EXPECT_THROW(Program<float>({1.0f}, {Op::add}, {0}, {1}, {0.0f}), std::invalid_argument);  // operand is itself
+    EXPECT_THROW(Program<float>({1.0f}, {Op::linear}, {0}, {0}, {0.0f}), std::invalid_argument);
+
+    auto path = temp_file("picograd_bad.bin");
+    EXPECT_THROW(serialize::MappedFile(path + ".missing"), std::runtime_error);
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << "not a model";
+    }
+    EXPECT_THROW(serialize::MappedFile{path}, std::runtime_error);
+
+    writer.save(path);
+    auto size = std::filesystem::file_size(path);
+    std::filesystem::resize_file(path, size - 8);
+    EXPECT_THROW(serialize::MappedFile{path}, std::runtime_error);  // truncated
+    std::filesystem::resize_file(path, size);
+    {
+        std::fstream out(path, std::ios::binary | std::ios::in | std::ios::out);
+        out.seekp(64 + 64 + 8);  // shape[0] of the first entry
+        std::uint64_t huge = ~std::uint64_t(0);
+        out.write(reinterpret_cast<const char*>(&huge), sizeof(huge));
+    }
+    EXPECT_THROW(serialize::MappedFile{path}, std::runtime_error);  // corrupt entry
+    std::filesystem::remove(path);
+}
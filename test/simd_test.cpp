@@ -0,0 +1,151 @@
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "picograd/simd.h"
+
+using namespace ajs;
+
+namespace {
+
+template<typename T>
+std::vector<T> linspace(T from, T to, std::size_t n) {
+    std::vector<T> out(n);
+    for (std::size_t i = 0; i < n; ++i) out[i] = from + (to - from) * T(i) / T(n - 1);
+    return out;
+}
+
+// Compare the batched kernels of every instruction set this CPU has against the scalar formulas
+template<typename T>
+void check_against_scalar(Op op, const std::vector<T>& in, T tolerance) {
+    std::vector<T> expected(in.size());
+    std::vector<T> expected_grad(in.size(), T(0.5));
+    std::vector<T> grad_out(in.size());
+    T unused_grad{0};
+    for (std::size_t i = 0; i < in.size(); ++i) {
+        expected[i] = kernels::forward(op, in[i]);
+        grad_out[i] = T(1) + T(i % 3);
+        kernels::backward(op, expected[i], grad_out[i], in[i], T(0), expected_grad[i], unused_grad);
+    }
+    auto restore = simd::active_isa();
+    for (auto isa : {simd::Isa::scalar, simd::Isa::neon, simd::Isa::avx2, simd::Isa::avx512}) {
+        if (!simd::set_isa(isa)) continue;
+        SCOPED_TRACE(std::string(simd::isa_str(isa)) + " " + op_str(op));
+        std::vector<T> out(in.size());
+        std::vector<T> grad_in(in.size(), T(0.5));
+        ASSERT_TRUE(simd::forward(op, in.data(), out.data(), in.size()));
+        ASSERT_TRUE(simd::backward(op, in.data(), out.data(), grad_out.data(), grad_in.data(), in.size()));
+        for (std::size_t i = 0; i < in.size(); ++i) {
+            auto scale = std::max(T(1), std::abs(expected[i]));
+            EXPECT_NEAR(out[i], expected[i], tolerance * scale) << "at x=" << in[i];
+            auto grad_scale = std::max(T(1), std::abs(expected_grad[i]));
+            EXPECT_NEAR(grad_in[i], expected_grad[i], tolerance * grad_scale) << "at x=" << in[i];
+        }
+    }
+    simd::set_isa(restore);
+}
+
+template<typename T>
+void check_all_ops(T tolerance) {
+    auto wide = linspace<T>(-30, 30, 1001);  // odd size, so the tail is exercised too
+    auto positive = linspace<T>(T(1e-6), T(1e4), 997);
+    positive.push_back(T(0));  // clamped like the scalar kernel
+    check_against_scalar(Op::exp, linspace<T>(-80, 80, 1003), tolerance);
+    check_against_scalar(Op::log, positive, tolerance);
+    check_against_scalar(Op::tanh, wide, tolerance);
+    check_against_scalar(Op::tanh, linspace<T>(T(-1e-3), T(1e-3), 101), tolerance);
+    check_against_scalar(Op::sigmoid, wide, tolerance);
+    check_against_scalar(Op::relu, wide, tolerance);
+}
+
+// log only: the scalar backward pass overflows for these
+template<typename T>
+void check_log_subnormals(const std::vector<T>& values) {
+    std::vector<T> in;
+    for (int i = 0; i < 7; ++i) in.insert(in.end(), values.begin(), values.end());  // full vectors and a tail
+    auto restore = simd::active_isa();
+    for (auto isa : {simd::Isa::scalar, simd::Isa::neon, simd::Isa::avx2, simd::Isa::avx512}) {
+        if (!simd::set_isa(isa)) continue;
+        SCOPED_TRACE(simd::isa_str(isa));
+        std::vector<T> out(in.size());
+        ASSERT_TRUE(simd::forward(Op::log, in.data(), out.data(), in.size()));
+        for (std::size_t i = 0; i < in.size(); ++i) {
+            EXPECT_NEAR(out[i], std::log(in[i]), 8 * std::numeric_limits<T>::epsilon() * std::abs(std::log(in[i])))
+                << "at x=" << in[i];
+        }
+    }
+    simd::set_isa(restore);
+}
+
+// exp near the ends of its range, where the results are huge or subnormal: relative error only
+template<typename T>
+void check_exp_bounds(const std::vector<T>& in) {
+    auto restore = simd::active_isa();
+    for (auto isa : {simd::Isa::scalar, simd::Isa::neon, simd::Isa::avx2, simd::Isa::avx512}) {
+        if (!simd::set_isa(isa)) continue;
+        SCOPED_TRACE(simd::isa_str(isa));
+        std::vector<T> out(in.size());
+        ASSERT_TRUE(simd::forward(Op::exp, in.data(), out.data(), in.size()));
+        for (std::size_t i = 0; i < in.size(); ++i) {
+            auto expected = std::exp(in[i]);
+            if (std::isinf(expected)) {
+                EXPECT_TRUE(std::isinf(out[i])) << "at x=" << in[i];
+                continue;
+            }
+            // Subnormal results only have the precision of their last bit
+            EXPECT_NEAR(out[i], expected, 8 * std::numeric_limits<T>::epsilon() * expected
+                                          + std::numeric_limits<T>::denorm_min()) << "at x=" << in[i];
+            EXPECT_EQ(out[i] == 0, expected == 0) << "at x=" << in[i];
+        }
+    }
+    simd::set_isa(restore);
+}
+
+} // namespace
+
+TEST(Simd, FloatMatchesScalarKernels) {
+    check_all_ops<float>(8 * std::numeric_limits<float>::epsilon());
+}
+
+TEST(Simd, DoubleMatchesScalarKernels) {
+    check_all_ops<double>(8 * std::numeric_limits<double>::epsilon());
+}
+
+TEST(Simd, LogOfSubnormals) {
+    check_log_subnormals<float>({1e-40f, 3e-39f, std::numeric_limits<float>::denorm_min(),
+                                 std::numeric_limits<float>::min() / 2, std::numeric_limits<float>::min(), 1.0f});
+    check_log_subnormals<double>({1e-310, 4e-320, std::numeric_limits<double>::denorm_min(),
+                                  std::numeric_limits<double>::min() / 2, std::numeric_limits<double>::min(), 1.0});
+}
+
+TEST(Simd, ExpNearOverflowAndUnderflow) {
+    auto low = linspace<float>(-104.5f, -85.0f, 1001);
+    auto high = linspace<float>(85.0f, 89.0f, 1001);
+    low.insert(low.end(), high.begin(), high.end());
+    check_exp_bounds(low);
+    auto low_d = linspace<double>(-746.0, -700.0, 1001);
+    auto high_d = linspace<double>(700.0, 710.0, 1001);
+    low_d.insert(low_d.end(), high_d.begin(), high_d.end());
+    check_exp_bounds(low_d);
+}
+
+TEST(Simd, InPlaceAndSpecialValues) {
+    std::vector<float> x{0.0f, 1.0f, -200.0f, 200.0f, std::numeric_limits<float>::quiet_NaN()};
+    simd::exp(x.data(), x.data(), x.size());
+    EXPECT_FLOAT_EQ(x[0], 1.0f);
+    EXPECT_FLOAT_EQ(x[1], std::exp(1.0f));
+    EXPECT_EQ(x[2], 0.0f);
+    EXPECT_TRUE(std::isinf(x[3]));
+    EXPECT_TRUE(std::isnan(x[4]));
+
+    std::vector<double> y{-1.0, 0.0};
+    simd::log(y.data(), y.data(), y.size());
+    EXPECT_TRUE(std::isnan(y[0]));
+    EXPECT_DOUBLE_EQ(y[1], std::log(double(1.0E-15f)));
+
+    EXPECT_FALSE(simd::forward(Op::pow, y.data(), y.data(), y.size()));
+    EXPECT_TRUE(simd::supported(simd::Isa::scalar));
+    EXPECT_TRUE(simd::supported(simd::detected_isa()));
+}
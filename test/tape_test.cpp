@@ -0,0 +1,73 @@
+#include "gtest/gtest.h"
+
+#include <memory>
+
+#include "picograd/value.h"
+
+using namespace ajs;
+
+TEST(Tape, SameResultAsHeapNodes) {
+    auto x = Value(-4.0);  // leaf lives on the heap, outside of the tape
+    {
+        Tape<double> tape;
+        auto z = Value(2.0) * x + 2.0 + x;
+        auto q = z.relu() + z * x;
+        auto h = (z * z).relu();
+        auto y = h + q + q * x;
+        y.backward();
+
+        EXPECT_DOUBLE_EQ(y.get_data(), -20.0);
+        EXPECT_GT(tape.size(), 0u);
+    }
+    EXPECT_DOUBLE_EQ(x.get_data(), -4.0);
+    EXPECT_DOUBLE_EQ(x.get_grad(), 46.0);
+}
+
+TEST(Tape, ResetReusesBlocks) {
+    auto a = Value(3.0f);
+    Tape<float> tape(16);
+    EXPECT_EQ(Tape<float>::active(), &tape);
+    for (int step = 0; step < 3; ++step) {
+        a.set_grad(0);
+        auto y = a;
+        for (int i = 0; i < 40; ++i) {
+            y = y * 1.5f;
+        }
+        y.backward();
+        EXPECT_EQ(tape.size(), 40u);  // one mult node per iteration, the factor is stored in the node
+        EXPECT_EQ(tape.capacity(), 48u);
+        EXPECT_FLOAT_EQ(a.get_grad(), std::pow(1.5f, 40));
+        tape.reset();
+        EXPECT_EQ(tape.size(), 0u);
+    }
+}
+
+TEST(Tape, Nesting) {
+    EXPECT_EQ(Tape<double>::active(), nullptr);
+    Tape<double> outer;
+    {
+        Tape<double> inner;
+        EXPECT_EQ(Tape<double>::active(), &inner);
+        auto a = Value(1.0) + 1.0;
+        EXPECT_EQ(inner.size(), 2u);
+        EXPECT_EQ(outer.size(), 0u);
+    }
+    EXPECT_EQ(Tape<double>::active(), &outer);
+    EXPECT_EQ(Tape<float>::active(), nullptr);
+}
+
+TEST(Tape, OutOfOrderDestruction) {
+    auto first = std::make_unique<Tape<double>>();
+    auto second = std::make_unique<Tape<double>>();
+    auto third = std::make_unique<Tape<double>>();
+    first.reset();  // unlinked from under the others
+    EXPECT_EQ(Tape<double>::active(), third.get());
+    second.reset();
+    EXPECT_EQ(Tape<double>::active(), third.get());
+    {
+        auto a = Value(1.0) + 1.0;
+        EXPECT_EQ(third->size(), 2u);
+    }
+    third.reset();
+    EXPECT_EQ(Tape<double>::active(), nullptr);  // not the destroyed first or second
+}
@@ -0,0 +1,169 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "picograd/thread_pool.h"
+#include "picograd/value.h"
+
+using namespace ajs;
+
+namespace {
+
+// Binary tree of tasks: each task spawns two more until depth 0
+struct TreeJob {
+    ThreadPool* pool;
+    std::atomic<std::size_t> count{0};
+
+    static void run(void* context, std::size_t depth) {
+        auto& self = *static_cast<TreeJob*>(context);
+        self.count.fetch_add(1, std::memory_order_relaxed);
+        if (depth == 0) return;
+        self.pool->spawn({&TreeJob::run, &self, depth - 1});
+        self.pool->spawn({&TreeJob::run, &self, depth - 1});
+    }
+};
+
+// A batch of samples, each run through a small two-layer net with shared weights, summed into a
+// loss. The samples are independent branches below the final sum.
+struct BatchGraph {
+    std::vector<Value<double>> weights;
+    Value<double> loss;
+
+    explicit BatchGraph(std::size_t batch) {
+        for (int i = 0; i < 12; ++i) weights.emplace_back(0.1 * (i % 5) - 0.2);
+        loss = Value(0.0);
+        for (std::size_t s = 0; s < batch; ++s) {
+            auto x1 = Value(0.01 * double(s));
+            auto x2 = Value(1.0 - 0.02 * double(s));
+            std::vector<Value<double>> hidden;
+            for (int h = 0; h < 4; ++h) {
+                hidden.push_back((x1 * weights[2 * h] + x2 * weights[2 * h + 1]).tanh());
+            }
+            auto out = hidden[0] * weights[8] + hidden[1] * weights[9] - hidden[2] * weights[10] + hidden[3] / (weights[11] + 2);
+            loss = loss + (out - x1).pow(2) + out.sigmoid().log();
+        }
+    }
+
+    std::vector<double> grads() const {
+        std::vector<double> out;
+        for (auto& w : weights) out.push_back(w.get_grad());
+        return out;
+    }
+
+    void zero_grads() {
+        for (auto& w : weights) w.set_grad(0);
+    }
+};
+
+} // namespace
+
+TEST(ThreadPool, RunsAllSpawnedTasks) {
+    ThreadPool pool(4);
+    EXPECT_EQ(pool.size(), 4u);
+    for (int repeat = 0; repeat < 3; ++repeat) {
+        TreeJob job{&pool};
+        pool.run([&] { TreeJob::run(&job, 10); });
+        EXPECT_EQ(job.count.load(), (1u << 11) - 1);
+    }
+}
+
+TEST(ThreadPool, SingleThread) {
+    ThreadPool pool(1);
+    TreeJob job{&pool};
+    pool.run([&] { TreeJob::run(&job, 5); });
+    EXPECT_EQ(job.count.load(), (1u << 6) - 1);
+}
+
+TEST(ThreadPool, NestedRunJoinsTheJob) {
+    ThreadPool pool(4);
+    TreeJob inner{&pool};
+    std::atomic<int> outer_tasks{0};
+    auto task = [](void* context, std::size_t) {
+        auto& [job, count] = *static_cast<std::pair<TreeJob*, std::atomic<int>*>*>(context);
+        job->pool->run([job] { TreeJob::run(job, 4); });  // from a task: inline, no deadlock
+        count->fetch_add(1);
+    };
+    std::pair<TreeJob*, std::atomic<int>*> context{&inner, &outer_tasks};
+    pool.run([&] {
+        for (std::size_t i = 0; i < 3; ++i) pool.spawn({task, &context, i});
+        pool.run([&] { TreeJob::run(&inner, 4); });  // from the root function
+    });
+    EXPECT_EQ(outer_tasks.load(), 3);
+    EXPECT_EQ(inner.count.load(), 4 * ((1u << 5) - 1));
+}
+
+TEST(ThreadPool, RethrowsExceptionsOfTasks) {
+    ThreadPool pool(4);
+    TreeJob job{&pool};
+    auto throwing = [](void*, std::size_t) { throw std::runtime_error("task failed"); };
+    EXPECT_THROW(pool.run([&] {
+        TreeJob::run(&job, 8);
+        pool.spawn({throwing, nullptr, 0});
+    }), std::runtime_error);
+    EXPECT_EQ(job.count.load(), (1u << 9) - 1);  // the other tasks still ran
+    EXPECT_THROW(pool.run([] { throw std::logic_error("root failed"); }), std::logic_error);
+
+    job.count = 0;  // the pool is still usable
+    pool.run([&] { TreeJob::run(&job, 3); });
+    EXPECT_EQ(job.count.load(), (1u << 4) - 1);
+}
+
+TEST(ParallelBackward, DeterministicMatchesSerialExactly) {
+    BatchGraph graph(64);
+    graph.loss.backward();
+    auto serial = graph.grads();
+
+    ThreadPool pool(4);
+    for (int repeat = 0; repeat < 3; ++repeat) {
+        graph.zero_grads();
+        graph.loss.backward(pool, true);
+        EXPECT_EQ(graph.grads(), serial);
+    }
+}
+
+TEST(ParallelBackward, AtomicMatchesSerial) {
+    BatchGraph graph(64);
+    graph.loss.backward();
+    auto serial = graph.grads();
+
+    ThreadPool pool(4);
+    graph.zero_grads();
+    graph.loss.backward(pool);
+    auto parallel = graph.grads();
+    for (std::size_t i = 0; i < serial.size(); ++i) {
+        EXPECT_NEAR(parallel[i], serial[i], 1e-12 * std::max(1.0, std::abs(serial[i])));
+    }
+}
+
+TEST(ParallelBackward, LeavesAccumulateAndOrderIsReusable) {
+    auto x = Value(3.0);
+    auto y = x * x + x.exp() / x;  // x is used by several nodes, once by both operands of a node
+    auto order = y.topological_order();
+    ThreadPool pool(3);
+    order.backward(pool, true);
+    double once = x.get_grad();
+    EXPECT_DOUBLE_EQ(once, 2 * 3.0 + std::exp(3.0) * (3.0 - 1) / 9);
+    order.backward(pool, true);  // leaves accumulate, inner nodes start from scratch
+    EXPECT_DOUBLE_EQ(x.get_grad(), 2 * once);
+    order.backward(pool);
+    EXPECT_NEAR(x.get_grad(), 3 * once, 1e-12);
+}
+
+TEST(ParallelBackward, SkipsConstants) {
+    auto x = Value(0.5);
+    auto k = Value(2.0, false);
+    Value<double> y(0.0);
+    for (int i = 0; i < 50; ++i) y = y + (x * k + double(i)).tanh() * k;
+    y.backward();
+    double serial = x.get_grad();
+    ThreadPool pool(3);
+    for (bool deterministic : {false, true}) {
+        x.set_grad(0);
+        y.backward(pool, deterministic);
+        EXPECT_NEAR(x.get_grad(), serial, 1e-12);
+        EXPECT_DOUBLE_EQ(k.get_grad(), 0.0);
+    }
+}
@@ -1,5 +1,8 @@
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <sstream>
 
 #include "picograd/value.h"
 
@@ -75,3 +78,197 @@ TEST(Value, TestPrinting) {
     auto a = (-Value(7.0) - 10) + Value(3.0) * -Value(-2.0).pow(2);
     a.print_graph();  // sorry, you'll have to check visually :)
 }
+
+TEST(Value, GraphIsFreed) {
+    auto a = Value(2.0);
+    auto y = (a * a).exp().log();
+    y.backward();
+    EXPECT_DOUBLE_EQ(a.get_grad(), 4.0);
+    std::weak_ptr node{y.get_node()};
+    y = Value(0.0);
+    EXPECT_TRUE(node.expired());  // nodes no longer keep themselves alive through their backward function
+}
+
+TEST(Value, CachedOrderWithNewLeafData) {
+    auto a = Value(2.0);
+    auto b = Value(3.0);
+    auto y = (a * b + a.pow(2)).tanh() * b;
+    auto order = y.topological_order();
+    EXPECT_EQ(order.size(), 7u);
+
+    for (double a_data : {2.0, -0.5, 0.1}) {
+        a.set_data(a_data);
+        a.set_grad(0);
+        b.set_grad(0);
+        order.forward();
+        order.backward();
+
+        auto fresh_a = Value(a_data);
+        auto fresh_b = Value(3.0);
+        auto fresh_y = (fresh_a * fresh_b + fresh_a.pow(2)).tanh() * fresh_b;
+        fresh_y.backward();
+        EXPECT_DOUBLE_EQ(y.get_data(), fresh_y.get_data());
+        EXPECT_DOUBLE_EQ(a.get_grad(), fresh_a.get_grad());
+        EXPECT_DOUBLE_EQ(b.get_grad(), fresh_b.get_grad());
+    }
+}
+
+TEST(Value, RepeatedBackward) {
+    auto a = Value(1.5);
+    auto y = (a * a).sigmoid() * a;
+    y.backward();
+    auto grad = a.get_grad();
+    a.set_grad(0);
+    y.backward();  // inner nodes must not carry over gradients from the first pass
+    EXPECT_DOUBLE_EQ(a.get_grad(), grad);
+}
+
+TEST(Value, DeepGraphBackward) {
+    auto a = Value(0.5f);
+    Tape<float> tape;  // keeps teardown of the chain cheap
+    auto y = a;
+    for (int i = 0; i < 200000; ++i) {
+        y = y.relu();
+    }
+    y.backward();  // would overflow the stack with a recursive sort
+    EXPECT_FLOAT_EQ(a.get_grad(), 1.0f);
+}
+
+TEST(Value, DeepGraphTeardown) {
+    auto a = Value(0.5f);
+    std::weak_ptr<void> first;
+    {
+        auto y = a;
+        for (int i = 0; i < 500000; ++i) {
+            y = y * 1.0f;  // on the heap: every node owns the one before
+            if (i == 0) first = y.get_node();
+        }
+        auto z = y + y.relu();  // a second owner of the chain
+        y.backward();
+    }  // would overflow the stack with nested destructors
+    EXPECT_TRUE(first.expired());
+    EXPECT_FLOAT_EQ(a.get_grad(), 1.0f);
+
+    auto b = Value(1.0f);
+    {
+        auto y = b;
+        for (int i = 0; i < 500000; ++i) {
+            y = y * y;  // both operands are the same node
+            if (i == 0) first = y.get_node();
+        }
+    }
+    EXPECT_TRUE(first.expired());
+}
+
+TEST(Value, SharedGraphExport) {
+    // Every level uses the one below twice: 2^40 paths through 121 nodes
+    auto a = Value(1.0);
+    auto y = a;
+    for (int i = 0; i < 40; ++i) y = (y * 0.5) + (y * 0.5);
+    y.backward();
+
+    testing::internal::CaptureStdout();
+    y.print_graph();  // prints every node once
+    auto tree = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(std::count(tree.begin(), tree.end(), '\n'), 121 + 40 + 1);  // the nodes, the repeated operands and endl
+    EXPECT_NE(tree.find("(see above)"), std::string::npos);
+
+    std::ostringstream dot;
+    y.write_dot(dot);
+    auto graph = dot.str();
+    EXPECT_EQ(graph.rfind("digraph picograd {\n  n0 [label=\"none\\ndata 1", 0), 0u);
+    EXPECT_EQ(std::count(graph.begin(), graph.end(), '\n'), 2 + 121 + 160);  // nodes and edges
+    EXPECT_NE(graph.find("n0 -> n1;"), std::string::npos);
+
+    std::ostringstream json;
+    Value<double>(std::nan("")).write_json(json);
+    EXPECT_EQ(json.str(), "{\"nodes\":[\n{\"id\":0,\"op\":\"none\",\"data\":null,\"grad\":0,\"children\":[]}\n],\"root\":0}\n");
+    json.str("");
+    y.write_json(json);
+    EXPECT_NE(json.str().find(R"("op":"+","data":1,"grad":1,"children":[118,119]})"), std::string::npos);
+    EXPECT_NE(json.str().find(R"("root":120})"), std::string::npos);
+}
+
+TEST(Value, NativeSubDivNegSquare) {
+    auto a = Value(3.0);
+    auto b = Value(-1.5);
+    Tape<double> tape;
+    auto y = (a - b).square() / b + (-a);  // one node per operation, no hidden constants
+    EXPECT_EQ(tape.size(), 5u);
+    EXPECT_EQ(y.topological_order().size(), 7u);
+    y.backward();
+
+    EXPECT_DOUBLE_EQ(y.get_data(), 4.5 * 4.5 / -1.5 - 3.0);
+    EXPECT_DOUBLE_EQ(a.get_grad(), 2 * 4.5 / -1.5 - 1);
+    EXPECT_DOUBLE_EQ(b.get_grad(), -2 * 4.5 / -1.5 - 4.5 * 4.5 / (1.5 * 1.5));
+}
+
+TEST(Value, ScalarOperands) {
+    auto x = Value(2.0);
+    Tape<double> tape;
+    auto c = x;
+    c += c + 1;  // no nodes for the literals
+    EXPECT_EQ(tape.size(), 2u);
+    auto y = (3.0 - c) * (1.0 / x) + c / 4 - 2 * x;
+    y.backward();
+
+    EXPECT_DOUBLE_EQ(c.get_data(), 5.0);
+    EXPECT_DOUBLE_EQ(y.get_data(), -2.0 / 2.0 + 5.0 / 4 - 4.0);
+    // y = (2 - 2x) / x + (2x + 1) / 4 - 2x
+    EXPECT_DOUBLE_EQ(x.get_grad(), -2.0 / (2.0 * 2.0) + 0.5 - 2);
+}
+
+TEST(Value, ConstantsAreFoldedAndSkipped) {
+    auto x = Value(0.5);
+    auto k = Value(3.0, false);
+    EXPECT_FALSE(k.requires_grad());
+    Tape<double> tape;
+    auto scale = (k * 2 + 1).exp().log();  // constants only: folded, no operation nodes
+    EXPECT_FALSE(scale.requires_grad());
+    auto y = scale * x + k / x;
+    EXPECT_EQ(y.topological_order().size(), 4u);  // x, the two operations and the sum
+    y.backward();
+    EXPECT_DOUBLE_EQ(y.get_data(), 7.0 * 0.5 + 3.0 / 0.5);
+    EXPECT_DOUBLE_EQ(x.get_grad(), 7.0 - 3.0 / 0.25);
+    EXPECT_DOUBLE_EQ(k.get_grad(), 0.0);
+
+    Program<double> program(y);  // constants are stored in the instructions
+    EXPECT_EQ(program.leaves(), 1u);
+    x.set_data(1.0);
+    EXPECT_DOUBLE_EQ(program.forward(), 7.0 + 3.0);
+
+    EXPECT_THROW(y.set_requires_grad(false), std::logic_error);
+    auto w = Value(1.5);
+    w.set_requires_grad(false);
+    auto z = w * x;
+    x.set_grad(0);
+    z.backward();
+    EXPECT_EQ(z.topological_order().size(), 2u);
+    EXPECT_DOUBLE_EQ(x.get_grad(), 1.5);
+    EXPECT_DOUBLE_EQ(w.get_grad(), 0.0);
+}
+
+TEST(Value, LeafFrozenAfterUseGetsNoGradient) {
+    auto a = Value(2.0);
+    auto w = Value(1.5);
+    auto y = (a * w).square() + w;
+    w.set_requires_grad(false);  // still an operand of y's graph
+    y.backward();
+    EXPECT_DOUBLE_EQ(a.get_grad(), 2 * 3.0 * 1.5);
+    EXPECT_DOUBLE_EQ(w.get_grad(), 0.0);
+
+    ThreadPool pool(2);
+    for (bool deterministic : {false, true}) {
+        a.set_grad(0);
+        y.backward(pool, deterministic);
+        EXPECT_DOUBLE_EQ(a.get_grad(), 2 * 3.0 * 1.5);
+        EXPECT_DOUBLE_EQ(w.get_grad(), 0.0);
+    }
+
+    Program<double> program(y);
+    a.set_grad(0);
+    program.forward();
+    program.backward();
+    EXPECT_DOUBLE_EQ(a.get_grad(), 2 * 3.0 * 1.5);
+    EXPECT_DOUBLE_EQ(w.get_grad(), 0.0);
+}